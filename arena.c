@@ -0,0 +1,134 @@
+#include "arena.h"
+#include <stdlib.h>
+#include <string.h>
+
+typedef union
+{
+    long double ld;
+    long long ll;
+    void *ptr;
+} ArenaAlign;
+
+struct ArenaBlock
+{
+    ArenaBlock *next;
+    size_t size;
+    size_t used;
+    ArenaAlign data[];
+};
+
+#define ARENA_ALIGN (sizeof(ArenaAlign))
+
+static size_t align_up(size_t n)
+{
+    return (n + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+}
+
+static ArenaBlock *block_new(size_t size)
+{
+    ArenaBlock *block = malloc(sizeof(ArenaBlock) + size);
+    if (!block) {
+        return NULL;
+    }
+    block->next = NULL;
+    block->size = size;
+    block->used = 0;
+    return block;
+}
+
+static void *arena_take(Arena *arena, size_t size, int aligned)
+{
+    if (!arena) {
+        return NULL;
+    }
+
+    size = size ? size : 1;
+    if (aligned) {
+        size = align_up(size);
+    }
+
+    ArenaBlock *head = arena->head;
+    size_t start = head ? (aligned ? align_up(head->used) : head->used) : 0;
+    if (head && start <= head->size && head->size - start >= size) {
+        void *ptr = (char *)head->data + start;
+        head->used = start + size;
+        return ptr;
+    }
+
+    // Oversized requests get a dedicated block behind the current head so
+    // the head keeps its remaining bump space.
+    if (head && size > ARENA_BLOCK_SIZE / 2) {
+        ArenaBlock *block = block_new(size);
+        if (!block) {
+            return NULL;
+        }
+        block->used = size;
+        block->next = head->next;
+        head->next = block;
+        arena->reserved += size;
+        return block->data;
+    }
+
+    ArenaBlock *block = block_new(size > ARENA_BLOCK_SIZE ? size : ARENA_BLOCK_SIZE);
+    if (!block) {
+        return NULL;
+    }
+    block->used = size;
+    block->next = head;
+    arena->head = block;
+    arena->reserved += block->size;
+    return block->data;
+}
+
+void *arena_alloc(Arena *arena, size_t size)
+{
+    return arena_take(arena, size, 1);
+}
+
+// Like arena_alloc() but without alignment, so strings pack back to back
+void *arena_alloc_bytes(Arena *arena, size_t size)
+{
+    return arena_take(arena, size, 0);
+}
+
+void *arena_grow(Arena *arena, void *ptr, size_t old_size, size_t new_size)
+{
+    if (!ptr) {
+        return arena_alloc(arena, new_size);
+    }
+    if (new_size <= old_size) {
+        return ptr;
+    }
+
+    // Extend in place when ptr is the most recent allocation of the head
+    ArenaBlock *head = arena->head;
+    size_t old_aligned = align_up(old_size);
+    size_t new_aligned = align_up(new_size);
+    if (head && (char *)ptr + old_aligned == (char *)head->data + head->used &&
+        head->used - old_aligned + new_aligned <= head->size) {
+        head->used += new_aligned - old_aligned;
+        return ptr;
+    }
+
+    void *new_ptr = arena_alloc(arena, new_size);
+    if (new_ptr) {
+        memcpy(new_ptr, ptr, old_size);
+    }
+    return new_ptr;
+}
+
+void arena_free(Arena *arena)
+{
+    if (!arena) {
+        return;
+    }
+
+    ArenaBlock *block = arena->head;
+    while (block) {
+        ArenaBlock *next = block->next;
+        free(block);
+        block = next;
+    }
+    arena->head = NULL;
+    arena->reserved = 0;
+}
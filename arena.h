@@ -0,0 +1,23 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+#define ARENA_BLOCK_SIZE (64 * 1024)
+
+typedef struct ArenaBlock ArenaBlock;
+
+// Bump allocator: memory is handed out from large blocks and only
+// released all at once by arena_free().
+typedef struct
+{
+    ArenaBlock *head;
+    size_t reserved; // bytes obtained from the system
+} Arena;
+
+void *arena_alloc(Arena *arena, size_t size);
+void *arena_alloc_bytes(Arena *arena, size_t size);
+void *arena_grow(Arena *arena, void *ptr, size_t old_size, size_t new_size);
+void arena_free(Arena *arena);
+
+#endif // ARENA_H
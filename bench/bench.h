@@ -0,0 +1,67 @@
+// Helpers shared by the benchmarks: timing, sorting samples, and a
+// throwaway HOME so the user's real ~/.taskman/tasks.db is never touched.
+//
+// Include after defining _POSIX_C_SOURCE (for clock_gettime, mkdtemp and
+// setenv).
+
+#ifndef BENCH_BENCH_H
+#define BENCH_BENCH_H
+
+#include "../database.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+static char bench_home[] = "/tmp/taskman-bench-XXXXXX";
+
+static inline double now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+// For qsort() of latency samples
+static inline int cmp_double(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+// Point HOME at a new temporary directory
+static inline int bench_home_create(void)
+{
+    if (!mkdtemp(bench_home)) {
+        perror("mkdtemp");
+        return -1;
+    }
+    setenv("HOME", bench_home, 1);
+    return 0;
+}
+
+// Delete the database file with its WAL and shared-memory files
+static inline void bench_remove_database(void)
+{
+    const char *suffixes[] = {"", "-wal", "-shm"};
+    char path[600];
+    for (int i = 0; i < 3; i++) {
+        snprintf(path, sizeof(path), "%s%s", db_get_path(), suffixes[i]);
+        unlink(path);
+    }
+}
+
+// Delete the database, the snapshot taskman runs left next to it and the
+// temporary HOME
+static inline void bench_home_remove(void)
+{
+    char path[sizeof(bench_home) + 32];
+    bench_remove_database();
+    snprintf(path, sizeof(path), "%s/.taskman/tasks.snap", bench_home);
+    unlink(path);
+    snprintf(path, sizeof(path), "%s/.taskman", bench_home);
+    rmdir(path);
+    rmdir(bench_home);
+}
+
+#endif // BENCH_BENCH_H
@@ -0,0 +1,48 @@
+#!/bin/bash
+# Compare two result files written by bench/suite.
+#
+# Usage: bench/compare.sh before.ndjson after.ndjson
+#
+# Prints p50 and p99 of every measurement found in both files and the
+# change in percent; negative is faster.
+
+set -e
+
+if [ $# -ne 2 ]; then
+    echo "Usage: $0 before.ndjson after.ndjson" >&2
+    exit 1
+fi
+
+awk '
+function field(line, name,    re, value) {
+    re = "\"" name "\":(\"[^\"]*\"|[-0-9.]+)"
+    if (!match(line, re)) {
+        return ""
+    }
+    value = substr(line, RSTART + length(name) + 3, RLENGTH - length(name) - 3)
+    gsub(/"/, "", value)
+    return value
+}
+function change(before, after) {
+    return before > 0 ? sprintf("%+.1f%%", (after - before) * 100 / before) : "n/a"
+}
+/"type":"result"/ {
+    key = field($0, "size") " " field($0, "layer") " " field($0, "op") " " field($0, "cache")
+    if (FNR == NR) {
+        p50[key] = field($0, "p50_ms")
+        p99[key] = field($0, "p99_ms")
+        next
+    }
+    if (!(key in p50)) {
+        next
+    }
+    if (!header++) {
+        printf "%-9s %-4s %-9s %-5s %10s %10s %8s %10s %10s %8s\n", "tasks", "via", "op", "cache",
+               "p50 before", "p50 after", "change", "p99 before", "p99 after", "change"
+    }
+    split(key, k, " ")
+    printf "%-9s %-4s %-9s %-5s %10.3f %10.3f %8s %10.3f %10.3f %8s\n", k[1], k[2], k[3], k[4],
+           p50[key], field($0, "p50_ms"), change(p50[key], field($0, "p50_ms")),
+           p99[key], field($0, "p99_ms"), change(p99[key], field($0, "p99_ms"))
+}
+' "$1" "$2"
@@ -0,0 +1,96 @@
+#!/bin/bash
+# Latency of task ID completion on a large database.
+#
+# Usage: bench/complete_bench.sh [task-count] [max-ms]
+#
+# Builds a throwaway database under a temporary HOME with a long run of
+# completed tasks, then times "taskman __complete <prefix>" and a whole Tab
+# press through _taskman_completion from taskman-completion.bash. Exits
+# non-zero when a median exceeds max-ms or the completion offers the wrong
+# tasks.
+
+set -e
+
+TASKS=${1:-1000000}
+MAX_MS=${2:-5}
+RUNS=15
+TASKMAN=${TASKMAN:-./taskman}
+
+export HOME=$(mktemp -d)
+export TASKMAN_NO_DAEMON=1
+trap 'rm -rf "$HOME"' EXIT
+
+echo "Generating $TASKS tasks..."
+# The first fifth is done, so short prefixes have to skip past it
+seq 1 "$TASKS" | awk -v done=$(( TASKS / 5 )) \
+    '{ printf "Generated task %d\t%s\t%d\n", $1, ($1 <= done || $1 % 3 == 0 ? "DONE" : "TODO"), 1700000000 + $1 }' \
+    | "$TASKMAN" import --format=tsv
+"$TASKMAN" status > /dev/null
+
+# Stand-ins for the bash-completion helpers the script expects
+taskman() {
+    "$TASKMAN" "$@"
+}
+_init_completion() {
+    cur=${COMP_WORDS[COMP_CWORD]}
+    prev=${COMP_WORDS[COMP_CWORD - 1]}
+    words=("${COMP_WORDS[@]}")
+    cword=$COMP_CWORD
+}
+source "$(dirname "$0")/../taskman-completion.bash"
+
+tab() {
+    COMP_WORDS=(taskman "$@")
+    COMP_CWORD=$#
+    COMPREPLY=()
+    _taskman_completion
+}
+
+now_ns() {
+    date +%s%N
+}
+
+median_ms() {
+    local times=()
+    for ((i = 0; i < RUNS; i++)); do
+        local start=$(now_ns)
+        "$@" > /dev/null
+        local end=$(now_ns)
+        times+=($(( (end - start) / 1000 )))
+    done
+    printf '%s\n' "${times[@]}" | sort -n | sed -n "$(( RUNS / 2 + 1 ))p" \
+        | awk '{ printf "%.2f", $1 / 1000 }'
+}
+
+failed=0
+report() {
+    local name=$1
+    shift
+    local ms=$(median_ms "$@")
+    printf '%-22s %8s ms\n' "$name" "$ms"
+    if awk -v ms="$ms" -v max="$MAX_MS" 'BEGIN { exit !(ms > max) }'; then
+        echo "  exceeds ${MAX_MS} ms"
+        failed=1
+    fi
+}
+
+middle=$(( TASKS / 2 + 1 ))
+echo "Median of $RUNS runs over $TASKS tasks:"
+report "__complete" "$TASKMAN" __complete ""
+report "__complete 1" "$TASKMAN" __complete 1
+report "__complete $middle" "$TASKMAN" __complete "$middle"
+report "Tab: done 1" tab done 1
+report "Tab: edit $middle" tab edit "$middle"
+
+# IDs come in order, pending only, and a unique one completes to just the ID
+expected=$(awk -v done=$(( TASKS / 5 )) -v tasks="$TASKS" 'BEGIN {
+    for (id = 1; id <= tasks && n < 50; id++) if (id > done && id % 3 != 0) { print id; n++ } }')
+[ "$("$TASKMAN" __complete "" | cut -f1)" = "$expected" ] || { echo "  wrong IDs for an empty prefix"; failed=1; }
+last=$TASKS
+while (( last % 3 == 0 )); do last=$(( last - 1 )); done
+tab done "$last"
+[ "${COMPREPLY[*]}" = "$last" ] || { echo "  done $last completed to '${COMPREPLY[*]}'"; failed=1; }
+tab done 3
+! printf '%s\n' "${COMPREPLY[@]}" | grep -Eq '^3( |$)' || { echo "  offered completed task 3"; failed=1; }
+
+exit $failed
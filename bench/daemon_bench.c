@@ -0,0 +1,184 @@
+// Requests per second and latency percentiles of taskman commands served
+// directly from the database file versus through a running taskmand.
+//
+// Usage: bench/daemon_bench [task-count]   (default: 100000)
+//
+// Run from the repository root after `make`: it starts ./taskman and
+// ./taskmand (override with $TASKMAN and $TASKMAND) against a throwaway
+// database under a temporary HOME. Four ways of issuing the same requests
+// are compared:
+//   cli-direct  taskman process per request, TASKMAN_NO_DAEMON=1
+//   cli-daemon  taskman process per request, forwarded to taskmand
+//   client      one connection, one request in flight at a time
+//   pipelined   one connection, PIPELINE_DEPTH requests in flight
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "../client.h"
+#include "bench.h"
+#include "synth.h"
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#define CLI_RUNS 100
+#define CLIENT_RUNS 5120 // a multiple of PIPELINE_DEPTH
+#define PIPELINE_DEPTH 64
+#define SEARCH_TERM "invoice vendor"
+
+typedef enum { OP_STATUS, OP_ADD, OP_LIST, OP_SEARCH, OP_COUNT } BenchOp;
+
+static const char *op_names[] = {"status", "add", "list", "search"};
+
+static void report(const char *mode, BenchOp op, double *samples, int runs, double total_ms)
+{
+    qsort(samples, (size_t)runs, sizeof(double), cmp_double);
+    printf("%-11s %-7s %6d %11.0f %9.3f %9.3f\n", mode, op_names[op], runs, runs / (total_ms / 1e3),
+           samples[runs / 2], samples[(int)(runs * 0.99)]);
+}
+
+static pid_t spawn(const char *path, char *const argv[], int direct)
+{
+    pid_t pid = fork();
+    if (pid == 0) {
+        int null = open("/dev/null", O_RDWR);
+        dup2(null, STDOUT_FILENO);
+        dup2(null, STDERR_FILENO);
+        if (direct) {
+            setenv("TASKMAN_NO_DAEMON", "1", 1);
+        }
+        execv(path, argv);
+        _exit(127);
+    }
+    return pid;
+}
+
+static void bench_cli(const char *mode, const char *taskman, BenchOp op, int direct)
+{
+    static double samples[CLI_RUNS];
+    char *status[] = {(char *)taskman, "status", NULL};
+    char *add[] = {(char *)taskman, "add", "benchmark task", NULL};
+    char *list[] = {(char *)taskman, "list", "--limit", "20", NULL};
+    char *search[] = {(char *)taskman, "search", SEARCH_TERM, NULL};
+    char **argvs[] = {status, add, list, search};
+
+    double begin = now_ms();
+    for (int r = 0; r < CLI_RUNS; r++) {
+        double start = now_ms();
+        pid_t pid = spawn(taskman, argvs[op], direct);
+        int wstatus;
+        if (pid < 0 || waitpid(pid, &wstatus, 0) < 0 || !WIFEXITED(wstatus) || WEXITSTATUS(wstatus) != 0) {
+            fprintf(stderr, "%s %s failed\n", mode, op_names[op]);
+            exit(1);
+        }
+        samples[r] = now_ms() - start;
+    }
+    report(mode, op, samples, CLI_RUNS, now_ms() - begin);
+}
+
+static void queue_request(Client *client, BenchOp op)
+{
+    static const ProtoOp proto_ops[] = {PROTO_STATUS, PROTO_ADD, PROTO_LIST, PROTO_SEARCH};
+    uint32_t id;
+    size_t start = client_begin(client, proto_ops[op], &id);
+    if (op == OP_ADD) {
+        proto_put_bytes(&client->out, "benchmark task", 14);
+    } else if (op == OP_LIST) {
+        proto_put_u8(&client->out, 1);
+        proto_put_u32(&client->out, 0);
+        proto_put_u32(&client->out, 20);
+    } else if (op == OP_SEARCH) {
+        proto_put_bytes(&client->out, SEARCH_TERM, strlen(SEARCH_TERM));
+    }
+    proto_end(&client->out, start);
+}
+
+// Read every frame of one response
+static void read_response(Client *client)
+{
+    ProtoFrame frame;
+    do {
+        if (client_next(client, &frame) != 0 || frame.op == PROTO_ERROR) {
+            fprintf(stderr, "taskmand request failed\n");
+            exit(1);
+        }
+    } while (frame.op == PROTO_ROW);
+}
+
+// depth requests are written at once and timed until their response
+static void bench_client(const char *mode, Client *client, BenchOp op, int depth)
+{
+    static double samples[CLIENT_RUNS];
+    double begin = now_ms();
+    for (int r = 0; r < CLIENT_RUNS; r += depth) {
+        double start = now_ms();
+        for (int i = 0; i < depth; i++) {
+            queue_request(client, op);
+        }
+        if (client_flush(client) != 0) {
+            fprintf(stderr, "Lost the connection to taskmand\n");
+            exit(1);
+        }
+        for (int i = 0; i < depth; i++) {
+            read_response(client);
+            samples[r + i] = now_ms() - start;
+        }
+    }
+    report(mode, op, samples, CLIENT_RUNS, now_ms() - begin);
+}
+
+int main(int argc, char *argv[])
+{
+    int count = argc > 1 ? atoi(argv[1]) : 100000;
+    const char *taskman = getenv("TASKMAN") ? getenv("TASKMAN") : "./taskman";
+    const char *taskmand = getenv("TASKMAND") ? getenv("TASKMAND") : "./taskmand";
+
+    if (bench_home_create() != 0) {
+        return 1;
+    }
+    if (db_init() != 0 || synth_populate(count) != 0) {
+        fprintf(stderr, "Failed to build a %d task database\n", count);
+        return 1;
+    }
+    db_close();
+
+    printf("%d tasks\n", count);
+    printf("%-11s %-7s %6s %11s %9s %9s\n", "mode", "op", "runs", "req/s", "p50 ms", "p99 ms");
+    for (int op = 0; op < OP_COUNT; op++) {
+        bench_cli("cli-direct", taskman, (BenchOp)op, 1);
+    }
+
+    char *daemon_argv[] = {(char *)taskmand, NULL};
+    pid_t daemon = spawn(taskmand, daemon_argv, 0);
+    Client client;
+    double deadline = now_ms() + 60000;
+    while (client_connect(&client) != 0) {
+        if (now_ms() > deadline || waitpid(daemon, NULL, WNOHANG) != 0) {
+            fprintf(stderr, "taskmand did not start\n");
+            return 1;
+        }
+        nanosleep(&(struct timespec){0, 10000000}, NULL);
+    }
+
+    for (int op = 0; op < OP_COUNT; op++) {
+        bench_cli("cli-daemon", taskman, (BenchOp)op, 0);
+    }
+    for (int op = 0; op < OP_COUNT; op++) {
+        bench_client("client", &client, (BenchOp)op, 1);
+    }
+    for (int op = 0; op < OP_COUNT; op++) {
+        bench_client("pipelined", &client, (BenchOp)op, PIPELINE_DEPTH);
+    }
+
+    client_close(&client);
+    kill(daemon, SIGTERM);
+    waitpid(daemon, NULL, 0);
+
+    bench_home_remove();
+    return 0;
+}
@@ -0,0 +1,55 @@
+// Generate a synthetic task database (see synth.h).
+//
+// Usage: HOME=/tmp/somewhere bench/gen_db <task-count>
+//
+// Writes $HOME/.taskman/tasks.db, so point HOME at a scratch directory.
+// A database that already holds tasks is left alone.
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "synth.h"
+#include <stdlib.h>
+#include <time.h>
+
+int main(int argc, char *argv[])
+{
+    long count = argc > 1 ? strtol(argv[1], NULL, 10) : 0;
+    if (argc != 2 || count <= 0 || count > 100000000) {
+        fprintf(stderr, "Usage: HOME=/tmp/somewhere %s <task-count>\n", argv[0]);
+        return 1;
+    }
+
+    if (db_init() != 0) {
+        return 1;
+    }
+    int existing = 0;
+    if (db_count_tasks(&existing, NULL) != 0 || existing > 0) {
+        fprintf(stderr, "%s already holds %d tasks; use an empty HOME\n", db_get_path(), existing);
+        db_close();
+        return 1;
+    }
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    int rc = synth_populate((int)count);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    int total = 0, completed = 0;
+    db_count_tasks(&total, &completed);
+    db_close();
+    if (rc != 0) {
+        fprintf(stderr, "Generation failed\n");
+        return 1;
+    }
+
+    double seconds = (double)(end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    long long bytes = 0;
+    for (int i = 1; i <= total; i++) {
+        Task task;
+        synth_task(i, total, &task);
+        bytes += (long long)strlen(task.description);
+    }
+    printf("%s: %d tasks (%.0f%% done, %.1f bytes per description) in %.1fs\n", db_get_path(), total,
+           total ? 100.0 * completed / total : 0.0, total ? (double)bytes / total : 0.0, seconds);
+    return 0;
+}
@@ -0,0 +1,139 @@
+// Memory and scan cost of the in-memory task store (TaskManager).
+//
+// Usage: bench/layout_bench [task-count ...]   (default: 100000 1000000)
+//
+// Each size is generated with bench/synth.h into a throwaway database,
+// loaded with db_load_tasks() and then scanned the ways taskmand and
+// interactive search do: counting pending tasks (status column only),
+// pending tasks in a date range (status and created) and a substring match
+// over the descriptions. Memory is what the store reserved plus the growth
+// in resident set size while loading (Linux only).
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "../database.h"
+#include "../match.h"
+#include "bench.h"
+#include "synth.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define SCAN_RUNS 20
+
+// Resident set size in KiB, or -1 where /proc is not available
+static long rss_kb(void)
+{
+    FILE *f = fopen("/proc/self/statm", "r");
+    long size, resident;
+    if (!f) {
+        return -1;
+    }
+    int ok = fscanf(f, "%ld %ld", &size, &resident) == 2;
+    fclose(f);
+    return ok ? resident * (sysconf(_SC_PAGESIZE) / 1024) : -1;
+}
+
+typedef int (*Scan)(const TaskManager *tm, const void *arg);
+
+static int count_pending(const TaskManager *tm, const void *arg)
+{
+    (void)arg;
+    int count = 0;
+    for (int i = 0; i < tm->count; i++) {
+        count += tm->status[i] != DONE;
+    }
+    return count;
+}
+
+// arg: the first and the end of a range of creation times
+static int count_pending_between(const TaskManager *tm, const void *arg)
+{
+    const time_t *range = arg;
+    int count = 0;
+    for (int i = 0; i < tm->count; i++) {
+        count += tm->status[i] != DONE && tm->created[i] >= range[0] && tm->created[i] < range[1];
+    }
+    return count;
+}
+
+static int count_matches(const TaskManager *tm, const void *arg)
+{
+    int count = 0;
+    for (int i = 0; i < tm->count; i++) {
+        count += match_query_test(arg, tm->descriptions[i], (size_t)tm->lengths[i]);
+    }
+    return count;
+}
+
+// Best time of SCAN_RUNS runs in ms; *result gets what the scan counted
+static double time_scan(Scan scan, const TaskManager *tm, const void *arg, int *result)
+{
+    double best = 1e9;
+    for (int r = 0; r < SCAN_RUNS; r++) {
+        double start = now_ms();
+        *result = scan(tm, arg);
+        double ms = now_ms() - start;
+        best = ms < best ? ms : best;
+    }
+    return best;
+}
+
+int main(int argc, char *argv[])
+{
+    static const int default_sizes[] = {100000, 1000000};
+
+    if (bench_home_create() != 0) {
+        return 1;
+    }
+
+    int nsizes = argc > 1 ? argc - 1 : 2;
+    printf("%-9s %9s %11s %9s %11s %11s %11s  %s\n", "tasks", "load ms", "store B/tsk", "rss B/tsk",
+           "pending ms", "by date ms", "substr ms", "pending/by date/substr");
+
+    for (int s = 0; s < nsizes; s++) {
+        int count = argc > 1 ? atoi(argv[s + 1]) : default_sizes[s];
+
+        bench_remove_database();
+        if (db_init() != 0 || synth_populate(count) != 0) {
+            fprintf(stderr, "Failed to build a %d task database\n", count);
+            db_close();
+            return 1;
+        }
+
+        TaskManager tm = {0};
+        long rss_before = rss_kb();
+        double start = now_ms();
+        if (db_load_tasks(&tm) != 0) {
+            db_close();
+            return 1;
+        }
+        double load_ms = now_ms() - start;
+        long rss_after = rss_kb();
+        size_t reserved = tm.arena.reserved + tm.text.reserved;
+
+        MatchQuery query;
+        match_query_init(&query, "deploy");
+        time_t range[2] = {SYNTH_START + SYNTH_SPAN / 4, SYNTH_START + SYNTH_SPAN / 2};
+        int pending, in_range, matches;
+        double pending_ms = time_scan(count_pending, &tm, NULL, &pending);
+        double range_ms = time_scan(count_pending_between, &tm, range, &in_range);
+        double match_ms = time_scan(count_matches, &tm, &query, &matches);
+
+        char rss[32] = "n/a";
+        if (rss_before >= 0 && rss_after >= 0 && tm.count > 0) {
+            snprintf(rss, sizeof(rss), "%.0f", (rss_after - rss_before) * 1024.0 / tm.count);
+        }
+        printf("%-9d %9.1f %11.0f %9s %11.3f %11.3f %11.3f  %d/%d/%d\n", tm.count, load_ms,
+               tm.count ? (double)reserved / tm.count : 0.0, rss, pending_ms, range_ms, match_ms, pending, in_range,
+               matches);
+
+        tm_free(&tm);
+        db_close();
+    }
+
+    bench_home_remove();
+    return 0;
+}
@@ -0,0 +1,224 @@
+// Compares the in-memory substring matchers with each other, with the old
+// byte-at-a-time strcasestr and with SQLite LIKE over the same texts.
+//
+// Usage: bench/match_bench [task-count]   (default: 1000000)
+//
+// Every implementation must report the same number of matches; the
+// program exits non-zero if they disagree.
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "../match.h"
+#include "bench.h"
+#include <ctype.h>
+#include <sqlite3.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define RUNS 5
+#define TEXT_SIZE 256
+
+static const char *words[] = {
+    "fix", "database", "migration", "deploy", "release", "customer", "report",
+    "review", "update", "write", "docs", "meeting", "budget", "invoice", "server",
+    "backup", "refactor", "parser", "login", "page", "email", "team", "weekly",
+    "plan", "test", "coverage", "build", "pipeline", "cleanup", "config", "api",
+    "latency", "dashboard", "alerts", "groceries", "dentist", "call", "mom",
+};
+
+static const char *syllables[] = {
+    "ka", "lo", "mi", "ra", "te", "vu", "zo", "pen", "dar", "sil",
+    "bro", "qui", "nex", "tal", "mor", "fi", "gan", "hu", "jor", "wex",
+};
+
+static const char *queries[] = {"deploy", "MIGR", "fix database", "kalomi", "zzz", "a"};
+
+// The matcher search.c used before: tolower() on every byte pair
+static const char *legacy_strcasestr(const char *haystack, const char *needle)
+{
+    size_t n = strlen(needle);
+    for (const char *p = haystack; *p; p++) {
+        size_t i = 0;
+        while (i < n && tolower((unsigned char)p[i]) == tolower((unsigned char)needle[i])) {
+            i++;
+        }
+        if (i == n) {
+            return p;
+        }
+    }
+    return n == 0 ? haystack : NULL;
+}
+
+static int legacy_matches(const char *text, const char *term)
+{
+    char word[TEXT_SIZE];
+    const char *p = term;
+    while (*p) {
+        while (*p == ' ') {
+            p++;
+        }
+        size_t len = strcspn(p, " ");
+        if (len == 0) {
+            break;
+        }
+        memcpy(word, p, len);
+        word[len] = '\0';
+        if (!legacy_strcasestr(text, word)) {
+            return 0;
+        }
+        p += len;
+    }
+    return 1;
+}
+
+static void generate(char *texts, int count)
+{
+    const int nwords = (int)(sizeof(words) / sizeof(words[0]));
+    unsigned seed = 42;
+
+    for (int i = 0; i < count; i++) {
+        char *text = texts + (size_t)i * TEXT_SIZE;
+        size_t n = 0;
+        int len = 4 + (int)((seed = seed * 1103515245 + 12345) >> 16) % 9;
+        for (int w = 0; w < len; w++) {
+            seed = seed * 1103515245 + 12345;
+            const char *word = words[(seed >> 16) % nwords];
+            size_t wl = strlen(word);
+            if (n > 0) {
+                text[n++] = ' ';
+            }
+            memcpy(text + n, word, wl);
+            n += wl;
+        }
+        text[n++] = ' ';
+        for (int k = 0; k < 3; k++) {
+            seed = seed * 1103515245 + 12345;
+            const char *syl = syllables[(seed >> 16) % 20];
+            memcpy(text + n, syl, strlen(syl));
+            n += strlen(syl);
+        }
+        text[n] = '\0';
+    }
+}
+
+static sqlite3 *load_sqlite(const char *texts, int count)
+{
+    sqlite3 *db;
+    sqlite3_stmt *stmt;
+    sqlite3_open(":memory:", &db);
+    sqlite3_exec(db, "CREATE TABLE tasks (description TEXT); BEGIN;", NULL, NULL, NULL);
+    sqlite3_prepare_v2(db, "INSERT INTO tasks VALUES (?)", -1, &stmt, NULL);
+    for (int i = 0; i < count; i++) {
+        sqlite3_bind_text(stmt, 1, texts + (size_t)i * TEXT_SIZE, -1, SQLITE_STATIC);
+        sqlite3_step(stmt);
+        sqlite3_reset(stmt);
+    }
+    sqlite3_finalize(stmt);
+    sqlite3_exec(db, "COMMIT;", NULL, NULL, NULL);
+    return db;
+}
+
+// Same semantics as the matchers: every word appears somewhere
+static int count_like(sqlite3 *db, const char *term)
+{
+    char sql[1024] = "SELECT COUNT(*) FROM tasks WHERE 1";
+    char copy[TEXT_SIZE];
+    snprintf(copy, sizeof(copy), "%s", term);
+    for (char *word = strtok(copy, " "); word; word = strtok(NULL, " ")) {
+        size_t used = strlen(sql);
+        snprintf(sql + used, sizeof(sql) - used, " AND description LIKE '%%%s%%'", word);
+    }
+
+    sqlite3_stmt *stmt;
+    int count = -1;
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) == SQLITE_OK && sqlite3_step(stmt) == SQLITE_ROW) {
+        count = sqlite3_column_int(stmt, 0);
+    }
+    sqlite3_finalize(stmt);
+    return count;
+}
+
+typedef enum { RUN_LEGACY, RUN_MATCH, RUN_LIKE } RunKind;
+
+static int run_once(RunKind kind, const char *texts, int count, const int *lengths, sqlite3 *db,
+                    const char *term)
+{
+    if (kind == RUN_LIKE) {
+        return count_like(db, term);
+    }
+
+    MatchQuery query;
+    match_query_init(&query, term);
+    int found = 0;
+    for (int i = 0; i < count; i++) {
+        const char *text = texts + (size_t)i * TEXT_SIZE;
+        found += kind == RUN_LEGACY ? legacy_matches(text, term)
+                                    : match_query_test(&query, text, (size_t)lengths[i]);
+    }
+    return found;
+}
+
+static int measure(const char *label, RunKind kind, const char *texts, int count, const int *lengths,
+                   sqlite3 *db, const char *term)
+{
+    double samples[RUNS];
+    int found = 0;
+    for (int r = 0; r < RUNS; r++) {
+        double start = now_ms();
+        found = run_once(kind, texts, count, lengths, db, term);
+        samples[r] = now_ms() - start;
+    }
+    qsort(samples, RUNS, sizeof(double), cmp_double);
+    printf("%-14s %-8s %8d %10.2f %10.1f\n", term, label, found, samples[RUNS / 2],
+           count / samples[RUNS / 2] / 1e3);
+    return found;
+}
+
+int main(int argc, char *argv[])
+{
+    int count = argc > 1 ? atoi(argv[1]) : 1000000;
+    if (count <= 0) {
+        return 1;
+    }
+
+    char *texts = calloc((size_t)count, TEXT_SIZE);
+    int *lengths = malloc((size_t)count * sizeof(int));
+    if (!texts || !lengths) {
+        return 1;
+    }
+    generate(texts, count);
+    for (int i = 0; i < count; i++) {
+        lengths[i] = (int)strlen(texts + (size_t)i * TEXT_SIZE);
+    }
+    sqlite3 *db = load_sqlite(texts, count);
+
+    MatchImpl detected = match_impl();
+    printf("%d texts, dispatch picked %s\n\n", count, match_impl_name(detected));
+    printf("%-14s %-8s %8s %10s %10s\n", "query", "impl", "matches", "p50 ms", "Mtexts/s");
+
+    int mismatch = 0;
+    for (size_t q = 0; q < sizeof(queries) / sizeof(queries[0]); q++) {
+        int expected = measure("legacy", RUN_LEGACY, texts, count, lengths, db, queries[q]);
+        for (int impl = MATCH_IMPL_SCALAR; impl <= MATCH_IMPL_AVX2; impl++) {
+            if (match_set_impl((MatchImpl)impl) != 0) {
+                continue;
+            }
+            mismatch |= measure(match_impl_name((MatchImpl)impl), RUN_MATCH, texts, count, lengths,
+                                db, queries[q]) != expected;
+        }
+        mismatch |= measure("like", RUN_LIKE, texts, count, lengths, db, queries[q]) != expected;
+        printf("\n");
+    }
+    match_set_impl(detected);
+
+    sqlite3_close(db);
+    free(lengths);
+    free(texts);
+    if (mismatch) {
+        fprintf(stderr, "Implementations disagree on the number of matches\n");
+        return 1;
+    }
+    return 0;
+}
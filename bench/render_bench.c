@@ -0,0 +1,188 @@
+// Bytes written per frame by the interactive search renderer, and a check
+// of what the diffing promises:
+//
+//   - every frame reaches the terminal with a single write()
+//   - a frame identical to the one on screen writes nothing
+//   - moving the highlight by one row rewrites just the old and the new
+//     highlighted row
+//
+// Usage: bench/render_bench [task-count]   (default: 40)
+//
+// Frames use a 120x60 viewport, so larger task counts show the cost of a
+// scrolled window rather than of the whole result list. Exits 1 when a
+// check fails.
+//
+// Renders a sequence of typical interactions and reports how many bytes
+// each frame sent to the terminal, next to the size of a full redraw
+// (what every keystroke cost before frames were diffed).
+
+#include "../search.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define CAPTURE_SIZE (1 << 20)
+
+// What the renderer wrote to the terminal since the last capture_reset()
+static int capture_fd = -1;
+static char captured[CAPTURE_SIZE];
+static size_t captured_len;
+static int captured_writes;
+
+// Replaces the C library's write() in this program, so every call the
+// renderer makes is counted and kept instead of reaching /dev/null
+ssize_t write(int fd, const void *buf, size_t len)
+{
+    if (fd != capture_fd || captured_len + len > CAPTURE_SIZE) {
+        errno = EBADF;
+        return -1;
+    }
+    memcpy(captured + captured_len, buf, len);
+    captured_len += len;
+    captured_writes++;
+    return (ssize_t)len;
+}
+
+static void capture_reset(void)
+{
+    captured_len = 0;
+    captured_writes = 0;
+}
+
+// Count the screen rows the frame moved to and then wrote or cleared, and
+// store the first max of them (0-based). The cursor is parked with one
+// last move that writes nothing.
+static int rewritten_rows(int *rows, int max)
+{
+    int count = 0;
+    size_t i = 0;
+    while (i + 1 < captured_len) {
+        int row;
+        char h;
+        int used;
+        if (captured[i] == '\033' && captured[i + 1] == '[' &&
+            sscanf(captured + i + 2, "%d;1%c%n", &row, &h, &used) == 2 && h == 'H') {
+            i += 2 + (size_t)used;
+            if (i < captured_len) {
+                if (count < max) {
+                    rows[count] = row - 1;
+                }
+                count++;
+            }
+            continue;
+        }
+        i++;
+    }
+    return count;
+}
+
+static void fill_pool(TaskManager *pool, int count)
+{
+    static const char *samples[] = {
+        "fix db migration", "buy milk", "deploy server", "fix the login page",
+        "db backup", "write weekly report", "review parser refactor",
+    };
+    for (int i = 0; i < count; i++) {
+        char description[64];
+        int len = snprintf(description, sizeof(description), "%s %d", samples[i % 7], i + 1);
+        tm_append(pool, i + 1, description, (size_t)len, i % 3 == 0 ? DONE : TODO, 1700000000 + i * 60);
+    }
+}
+
+static int filter(const TaskManager *pool, const char *term, int *matches)
+{
+    int count = 0;
+    for (int i = 0; i < pool->count; i++) {
+        if (task_matches_term(pool->descriptions[i], term)) {
+            matches[count++] = i;
+        }
+    }
+    return count;
+}
+
+int main(int argc, char *argv[])
+{
+    int count = argc > 1 ? atoi(argv[1]) : 40;
+    capture_fd = open("/dev/null", O_WRONLY);
+    if (capture_fd < 0 || count <= 1) {
+        return 1;
+    }
+
+    TaskManager pool = {0};
+    fill_pool(&pool, count);
+    int *matches = malloc((size_t)count * sizeof(int));
+
+    Screen screen;
+    screen_init(&screen, capture_fd);
+    Viewport view = {60, 120, 0};
+
+    // moved: the highlight moved by one row from the previous step's
+    struct {
+        const char *label;
+        const char *term;
+        int highlight;
+        int moved;
+    } steps[] = {
+        {"initial frame", "", 0, 0},
+        {"down arrow", "", 1, 1},
+        {"down arrow", "", 2, 1},
+        {"up arrow", "", 1, 1},
+        {"type 'f'", "f", 0, 0},
+        {"type 'i'", "fi", 0, 0},
+        {"type 'x'", "fix", 0, 0},
+        {"backspace", "fi", 0, 0},
+        {"no change", "fi", 0, 0},
+    };
+
+    printf("%-16s %8s %8s %8s\n", "step", "bytes", "lines", "writes");
+    size_t full_bytes = 0;
+    int failed = 0, previous = 0;
+    for (size_t i = 0; i < sizeof(steps) / sizeof(steps[0]); i++) {
+        int n = filter(&pool, steps[i].term, matches);
+        int top = view.top;
+        viewport_follow(&view, steps[i].highlight, n);
+        capture_reset();
+        display_search_results(&screen, &pool, matches, n, steps[i].term, steps[i].highlight, &view, 0,
+                               NULL);
+        if (i == 0) {
+            full_bytes = screen.last_bytes;
+        }
+        printf("%-16s %8zu %8d %8d\n", steps[i].label, screen.last_bytes,
+               screen.frames[screen.front].count, captured_writes);
+
+        if (captured_len != screen.last_bytes || captured_writes != (captured_len > 0)) {
+            printf("FAIL: %s took %d write() calls for %zu bytes\n", steps[i].label, captured_writes,
+                   captured_len);
+            failed = 1;
+        }
+        if (i > 0 && strcmp(steps[i].term, steps[i - 1].term) == 0 && steps[i].highlight == previous &&
+            captured_len != 0) {
+            printf("FAIL: %s redrew an unchanged frame (%zu bytes)\n", steps[i].label, captured_len);
+            failed = 1;
+        }
+        if (steps[i].moved && view.top == top) {
+            int rows[4];
+            int rewritten = rewritten_rows(rows, 4);
+            int old_row = SEARCH_HEADER_LINES + previous - top;
+            int new_row = SEARCH_HEADER_LINES + steps[i].highlight - top;
+            if (rewritten != 2 || !((rows[0] == old_row && rows[1] == new_row) ||
+                                    (rows[0] == new_row && rows[1] == old_row))) {
+                printf("FAIL: %s rewrote %d rows, expected rows %d and %d\n", steps[i].label, rewritten,
+                       old_row, new_row);
+                failed = 1;
+            }
+        }
+        previous = steps[i].highlight;
+    }
+    printf("\nfull redraw: %zu bytes, average diffed frame: %zu bytes\n", full_bytes,
+           (screen.total_bytes - full_bytes) / (size_t)(screen.frames_drawn - 1));
+
+    screen_free(&screen);
+    free(matches);
+    tm_free(&pool);
+    close(capture_fd);
+    return failed;
+}
@@ -0,0 +1,76 @@
+#!/bin/bash
+# Schema upgrade and query plan check.
+#
+# Usage: bench/schema_check.sh [task-count]
+#
+# Writes a database in the original format (just the tasks table, no
+# indexes, no user_version) under a temporary HOME and lets taskman
+# upgrade it in place. Then it runs the everyday commands with
+# TASKMAN_TRACE=json, collects every SQL statement they executed and fails
+# if EXPLAIN QUERY PLAN shows any of them scanning the tasks table or
+# sorting. Walking an index in order (how listing streams) is fine.
+
+set -e
+
+TASKS=${1:-20000}
+TASKMAN=${TASKMAN:-./taskman}
+SQLITE=${SQLITE:-sqlite3}
+
+export HOME=$(mktemp -d)
+export TASKMAN_NO_DAEMON=1
+trap 'rm -rf "$HOME"' EXIT
+DB=$HOME/.taskman/tasks.db
+mkdir -p "$HOME/.taskman"
+
+"$SQLITE" "$DB" <<EOF
+CREATE TABLE tasks (id INTEGER PRIMARY KEY, description TEXT NOT NULL,
+                    completed INTEGER NOT NULL DEFAULT 0, created INTEGER NOT NULL);
+WITH RECURSIVE n(x) AS (SELECT 1 UNION ALL SELECT x + 1 FROM n WHERE x < $TASKS)
+INSERT INTO tasks SELECT x, 'Old format task ' || x, x % 3 = 0, 1700000000 + x FROM n;
+EOF
+
+"$TASKMAN" status > /dev/null
+version=$("$SQLITE" "$DB" "PRAGMA user_version;")
+echo "Upgraded $TASKS tasks to schema version $version"
+failed=0
+if [ "$version" -lt 1 ]; then
+    echo "  user_version was not set"
+    failed=1
+fi
+"$TASKMAN" status | grep -q "Total tasks: $TASKS" || { echo "  wrong task count after upgrade"; failed=1; }
+"$TASKMAN" status --check > /dev/null || { echo "  counters disagree after upgrade"; failed=1; }
+
+# Opening a current database must not touch the schema
+before=$("$SQLITE" "$DB" "SELECT COUNT(*), group_concat(name) FROM sqlite_master;")
+"$TASKMAN" status > /dev/null
+after=$("$SQLITE" "$DB" "SELECT COUNT(*), group_concat(name) FROM sqlite_master;")
+[ "$before" = "$after" ] || { echo "  schema changed on a second open"; failed=1; }
+
+middle=$(( TASKS / 2 ))
+statements=$HOME/statements.txt
+traced() {
+    TASKMAN_TRACE=json "$@" 2>&1 > /dev/null | grep -o '"sql":"[^"]*"' | sed 's/^"sql":"//; s/"$//' >> "$statements"
+}
+traced "$TASKMAN" list --limit 20
+traced "$TASKMAN" list --limit 20 --after "$middle"
+traced "$TASKMAN" list-all --limit 20
+traced "$TASKMAN" list-all --limit 20 --after "$middle"
+traced "$TASKMAN" search "task 12"
+traced "$TASKMAN" status
+traced "$TASKMAN" __complete 12
+traced "$TASKMAN" add "Plan check task"
+traced "$TASKMAN" done "$middle"
+traced "$TASKMAN" edit "$middle" "Edited by the plan check"
+traced sh -c "echo y | \"$TASKMAN\" delete $(( middle + 1 ))"
+
+while IFS= read -r sql; do
+    plan=$("$SQLITE" "$DB" "EXPLAIN QUERY PLAN $sql")
+    if echo "$plan" | grep -Eq 'SCAN (tasks|t)$|SCAN (tasks|t) LEFT-JOIN|TEMP B-TREE'; then
+        echo "Full scan or sort in: $sql"
+        echo "$plan" | sed 's/^/    /'
+        failed=1
+    fi
+done < <(sort -u "$statements")
+
+echo "Checked $(sort -u "$statements" | wc -l) distinct statements"
+exit $failed
@@ -0,0 +1,121 @@
+// Compares search latency three ways on the same database:
+//
+//   like  SQL LIKE '%word%' per word, on a connection of its own
+//   scan  db_search_tasks() with the full-text index switched off, which
+//         runs task_matches() over every description
+//   fts   db_search_tasks() answered from the trigram index
+//
+// All three must find the same tasks; the exit status is 1 when any count
+// differs, so the benchmark doubles as an agreement check.
+//
+// Usage: bench/search_bench [task-count ...]   (default: 10000 100000 1000000)
+//
+// Each size is generated with bench/synth.h into a throwaway database
+// under a temporary HOME.
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "bench.h"
+#include "synth.h"
+#include <sqlite3.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define RUNS_PER_QUERY 15
+
+static const char *queries[] = {"deploy", "migr", "fix database", "customer report", "kalomi", "zzz", "db"};
+
+static int count_row(const TaskRow *row, void *ctx)
+{
+    (void)row;
+    (void)ctx;
+    return 0;
+}
+
+// Same semantics as task_matches(): every word appears somewhere, ASCII
+// case folded. The queries hold no LIKE wildcards.
+static int search_like(sqlite3 *conn, const char *term)
+{
+    char sql[1024] = "SELECT COUNT(*) FROM tasks WHERE 1";
+    char copy[256];
+    snprintf(copy, sizeof(copy), "%s", term);
+    for (char *word = strtok(copy, " "); word; word = strtok(NULL, " ")) {
+        size_t used = strlen(sql);
+        snprintf(sql + used, sizeof(sql) - used, " AND description LIKE '%%%s%%'", word);
+    }
+
+    sqlite3_stmt *stmt;
+    int count = -1;
+    if (sqlite3_prepare_v2(conn, sql, -1, &stmt, NULL) == SQLITE_OK && sqlite3_step(stmt) == SQLITE_ROW) {
+        count = sqlite3_column_int(stmt, 0);
+    }
+    sqlite3_finalize(stmt);
+    return count;
+}
+
+// Returns the number of matches
+static int measure(const char *mode, sqlite3 *conn, const char *query, int count)
+{
+    double samples[RUNS_PER_QUERY];
+    int matches = 0;
+
+    for (int r = 0; r < RUNS_PER_QUERY; r++) {
+        double start = now_ms();
+        matches = conn ? search_like(conn, query) : db_search_tasks(query, count_row, NULL);
+        samples[r] = now_ms() - start;
+    }
+    qsort(samples, RUNS_PER_QUERY, sizeof(double), cmp_double);
+
+    printf("%-9d %-5s %-18s %8d %10.3f %10.3f\n", count, mode, query, matches, samples[RUNS_PER_QUERY / 2],
+           samples[RUNS_PER_QUERY - 1]);
+    return matches;
+}
+
+int main(int argc, char *argv[])
+{
+    static const int default_sizes[] = {10000, 100000, 1000000};
+
+    if (bench_home_create() != 0) {
+        return 1;
+    }
+
+    int nsizes = argc > 1 ? argc - 1 : 3;
+    int mismatch = 0;
+    printf("%-9s %-5s %-18s %8s %10s %10s\n", "tasks", "mode", "query", "matches", "p50 ms", "max ms");
+
+    for (int s = 0; s < nsizes; s++) {
+        int count = argc > 1 ? atoi(argv[s + 1]) : default_sizes[s];
+
+        bench_remove_database();
+        sqlite3 *conn = NULL;
+        if (db_init() != 0 || synth_populate(count) != 0 ||
+            sqlite3_open_v2(db_get_path(), &conn, SQLITE_OPEN_READONLY, NULL) != SQLITE_OK) {
+            fprintf(stderr, "Failed to build a %d task database\n", count);
+            sqlite3_close(conn);
+            db_close();
+            return 1;
+        }
+        if (!db_fts_available()) {
+            printf("This SQLite has no FTS5 trigram tokenizer; fts runs scan\n");
+        }
+
+        for (size_t q = 0; q < sizeof(queries) / sizeof(queries[0]); q++) {
+            int expected = measure("like", conn, queries[q], count);
+            db_set_fts_enabled(0);
+            int scanned = measure("scan", NULL, queries[q], count);
+            db_set_fts_enabled(1);
+            int indexed = measure("fts", NULL, queries[q], count);
+            if (scanned != expected || indexed != expected) {
+                fprintf(stderr, "MISMATCH for \"%s\": like %d, scan %d, fts %d\n", queries[q], expected,
+                        scanned, indexed);
+                mismatch = 1;
+            }
+        }
+        sqlite3_close(conn);
+        db_close();
+    }
+
+    bench_home_remove();
+    return mismatch;
+}
@@ -0,0 +1,64 @@
+#!/bin/bash
+# Startup latency of point commands on a large database.
+#
+# Usage: bench/startup_bench.sh [task-count] [max-ms]
+#
+# Builds a throwaway database under a temporary HOME, then times add, done,
+# edit, delete and status. Exits non-zero when the median of a mutation
+# command exceeds max-ms, so the script doubles as a regression check for
+# point operations accidentally loading every task.
+
+set -e
+
+TASKS=${1:-1000000}
+MAX_MS=${2:-50}
+RUNS=9
+TASKMAN=${TASKMAN:-./taskman}
+
+export HOME=$(mktemp -d)
+trap 'rm -rf "$HOME"' EXIT
+
+echo "Generating $TASKS tasks..."
+seq 1 "$TASKS" | awk '{ printf "Generated task %d\t%s\t%d\n", $1, ($1 % 3 == 0 ? "DONE" : "TODO"), 1700000000 + $1 }' \
+    | "$TASKMAN" import --format=tsv
+
+now_ns() {
+    date +%s%N
+}
+
+median_ms() {
+    local times=()
+    for ((i = 0; i < RUNS; i++)); do
+        local start=$(now_ns)
+        "$@" > /dev/null
+        local end=$(now_ns)
+        times+=($(( (end - start) / 1000 )))
+    done
+    printf '%s\n' "${times[@]}" | sort -n | sed -n "$(( RUNS / 2 + 1 ))p" \
+        | awk '{ printf "%.2f", $1 / 1000 }'
+}
+
+failed=0
+report() {
+    local name=$1
+    shift
+    local ms=$(median_ms "$@")
+    printf '%-10s %8s ms\n' "$name" "$ms"
+    if [ "$name" != status ] && awk -v ms="$ms" -v max="$MAX_MS" 'BEGIN { exit !(ms > max) }'; then
+        echo "  exceeds ${MAX_MS} ms"
+        failed=1
+    fi
+}
+
+delete_yes() {
+    echo y | "$TASKMAN" delete "$1"
+}
+
+echo "Median of $RUNS runs over $TASKS tasks:"
+report add "$TASKMAN" add "Startup benchmark task"
+report done "$TASKMAN" done $(( TASKS / 2 ))
+report edit "$TASKMAN" edit $(( TASKS / 2 )) "Edited description"
+report delete delete_yes 999999999
+report status "$TASKMAN" status
+
+exit $failed
@@ -0,0 +1,389 @@
+// Latency percentiles of every taskman command on synthetic databases.
+//
+// Usage: bench/suite [--runs N] [--out FILE] [--cache DIR] [task-count ...]
+//        (default: 30 runs; 10000 100000 1000000 tasks; bench/results.ndjson)
+//
+// add, list, list-all, search, done, delete, edit and status are timed
+// twice over: through the database.h API in this process ("api") and by
+// running the taskman binary ($TASKMAN, default ./taskman, in direct
+// mode; "cli"). Each is measured
+//   cold  the database file is evicted from the OS page cache first, and
+//         api runs also open a fresh connection
+//   warm  api runs reuse one open connection; cli runs follow a warm-up
+// Listing and searching get fewer runs on large databases.
+//
+// A table is printed and one JSON object per measurement is written to
+// the output file; bench/compare.sh diffs two such files. Databases are
+// generated (see synth.h) into a temporary HOME, or copied from --cache
+// DIR, where freshly generated ones are also kept for the next run.
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "bench.h"
+#include "synth.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <sqlite3.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#define DEFAULT_RUNS 30
+#define SCAN_BUDGET 3000000 // tasks scanned per op before runs are cut back
+
+typedef enum { OP_ADD, OP_LIST, OP_LIST_ALL, OP_SEARCH, OP_DONE, OP_DELETE, OP_EDIT, OP_STATUS, OP_COUNT } BenchOp;
+
+static const char *op_names[] = {"add", "list", "list-all", "search", "done", "delete", "edit", "status"};
+static const char *search_terms[] = {"deploy", "database migration", "kalomi", "invoice vendor"};
+
+typedef struct
+{
+    const char *taskman;
+    int runs;
+    int size;
+    FILE *out;
+    unsigned seed;
+} Suite;
+
+static int is_scan(BenchOp op)
+{
+    return op == OP_LIST || op == OP_LIST_ALL || op == OP_SEARCH;
+}
+
+static int runs_for(const Suite *suite, BenchOp op)
+{
+    if (!is_scan(op)) {
+        return suite->runs;
+    }
+    long runs = SCAN_BUDGET / suite->size;
+    return runs < 3 ? 3 : runs > suite->runs ? suite->runs : (int)runs;
+}
+
+static int random_id(Suite *suite)
+{
+    unsigned r = synth_next(&suite->seed) * 65536u + synth_next(&suite->seed);
+    return 1 + (int)(r % (unsigned)suite->size);
+}
+
+// Drop the database from the page cache so the next access reads the disk
+static void evict(void)
+{
+    const char *suffixes[] = {"", "-wal"};
+    char path[600];
+    for (int i = 0; i < 2; i++) {
+        snprintf(path, sizeof(path), "%s%s", db_get_path(), suffixes[i]);
+        int fd = open(path, O_RDONLY);
+        if (fd >= 0) {
+            fdatasync(fd);
+            posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+            close(fd);
+        }
+    }
+}
+
+static int count_row(const TaskRow *row, void *ctx)
+{
+    (void)row;
+    (*(int *)ctx)++;
+    return 0;
+}
+
+static int api_run(Suite *suite, BenchOp op, int run)
+{
+    Task task;
+    TaskQuery query = {0};
+    int rows = 0;
+    switch (op) {
+        case OP_ADD:
+            synth_task(suite->size + run, suite->size, &task);
+            task.completed = TODO;
+            task.created = time(NULL);
+            return db_add_task(&task);
+        case OP_LIST:
+            query.pending_only = 1;
+            return db_each_task(&query, count_row, &rows) < 0 ? -1 : 0;
+        case OP_LIST_ALL:
+            return db_each_task(&query, count_row, &rows) < 0 ? -1 : 0;
+        case OP_SEARCH:
+            return db_search_tasks(search_terms[(unsigned)run % 4], count_row, &rows) < 0 ? -1 : 0;
+        case OP_DONE:
+            return db_set_task_status(random_id(suite), DONE) < 0 ? -1 : 0;
+        case OP_DELETE:
+            return db_delete_task(random_id(suite)) < 0 ? -1 : 0;
+        case OP_EDIT:
+            return db_set_task_description(random_id(suite), "Edited by the benchmark") < 0 ? -1 : 0;
+        default: {
+            TaskStats stats;
+            int rc = db_task_stats(&stats);
+            if (rc == 0) {
+                task_stats_clear(&stats);
+            }
+            return rc;
+        }
+    }
+}
+
+static int cli_run(Suite *suite, BenchOp op, int run)
+{
+    char id[16];
+    char description[SYNTH_MAX_DESCRIPTION];
+    char *argv[5] = {(char *)suite->taskman, (char *)op_names[op], NULL, NULL, NULL};
+    snprintf(id, sizeof(id), "%d", random_id(suite));
+    if (op == OP_ADD) {
+        Task task;
+        synth_task(suite->size + run, suite->size, &task);
+        snprintf(description, sizeof(description), "%s", task.description);
+        argv[2] = description;
+    } else if (op == OP_SEARCH) {
+        argv[2] = (char *)search_terms[(unsigned)run % 4];
+    } else if (op == OP_DONE || op == OP_DELETE || op == OP_EDIT) {
+        argv[2] = id;
+        argv[3] = op == OP_EDIT ? "Edited by the benchmark" : NULL;
+    }
+
+    // delete asks for confirmation
+    int confirm[2];
+    if (pipe(confirm) != 0) {
+        return -1;
+    }
+    pid_t pid = fork();
+    if (pid == 0) {
+        int null = open("/dev/null", O_WRONLY);
+        dup2(confirm[0], STDIN_FILENO);
+        dup2(null, STDOUT_FILENO);
+        dup2(null, STDERR_FILENO);
+        setenv("TASKMAN_NO_DAEMON", "1", 1);
+        execv(suite->taskman, argv);
+        _exit(127);
+    }
+    close(confirm[0]);
+    if (write(confirm[1], "y\n", 2) != 2) {
+        // the child may already be gone; its exit status tells
+    }
+    close(confirm[1]);
+
+    int status;
+    if (pid < 0 || waitpid(pid, &status, 0) != pid || !WIFEXITED(status) || WEXITSTATUS(status) == 127) {
+        return -1;
+    }
+    return 0;
+}
+
+static void report(Suite *suite, const char *layer, BenchOp op, const char *cache, double *samples, int runs)
+{
+    double sum = 0;
+    for (int i = 0; i < runs; i++) {
+        sum += samples[i];
+    }
+    qsort(samples, (size_t)runs, sizeof(double), cmp_double);
+    double p50 = samples[(runs - 1) * 50 / 100];
+    double p90 = samples[(runs - 1) * 90 / 100];
+    double p99 = samples[(runs - 1) * 99 / 100];
+
+    printf("%-9d %-4s %-9s %-5s %5d %10.3f %10.3f %10.3f %10.3f\n", suite->size, layer, op_names[op], cache,
+           runs, p50, p90, p99, samples[runs - 1]);
+    fprintf(suite->out,
+            "{\"type\":\"result\",\"size\":%d,\"layer\":\"%s\",\"op\":\"%s\",\"cache\":\"%s\",\"runs\":%d,"
+            "\"min_ms\":%.4f,\"p50_ms\":%.4f,\"p90_ms\":%.4f,\"p99_ms\":%.4f,\"max_ms\":%.4f,\"mean_ms\":%.4f}\n",
+            suite->size, layer, op_names[op], cache, runs, samples[0], p50, p90, p99, samples[runs - 1],
+            sum / runs);
+    fflush(suite->out);
+}
+
+static int measure_api(Suite *suite, BenchOp op, int cold)
+{
+    int runs = runs_for(suite, op);
+    double *samples = malloc(sizeof(double) * (size_t)runs);
+    if (!samples) {
+        return -1;
+    }
+
+    int rc = 0;
+    if (!cold) {
+        rc = db_init() != 0 || api_run(suite, op, -1) != 0; // warm-up
+    }
+    for (int r = 0; r < runs && rc == 0; r++) {
+        if (cold) {
+            evict();
+        }
+        double start = now_ms();
+        if (cold && db_init() != 0) {
+            rc = -1;
+            break;
+        }
+        rc = api_run(suite, op, r);
+        if (cold) {
+            db_close();
+        }
+        samples[r] = now_ms() - start;
+    }
+    if (!cold) {
+        db_close();
+    }
+
+    if (rc == 0) {
+        report(suite, "api", op, cold ? "cold" : "warm", samples, runs);
+    }
+    free(samples);
+    return rc == 0 ? 0 : -1;
+}
+
+static int measure_cli(Suite *suite, BenchOp op, int cold)
+{
+    int runs = runs_for(suite, op);
+    double *samples = malloc(sizeof(double) * (size_t)runs);
+    if (!samples) {
+        return -1;
+    }
+
+    int rc = cold ? 0 : cli_run(suite, op, -1);
+    for (int r = 0; r < runs && rc == 0; r++) {
+        if (cold) {
+            evict();
+        }
+        double start = now_ms();
+        rc = cli_run(suite, op, r);
+        samples[r] = now_ms() - start;
+    }
+
+    if (rc == 0) {
+        report(suite, "cli", op, cold ? "cold" : "warm", samples, runs);
+    }
+    free(samples);
+    return rc;
+}
+
+static int copy_file(const char *from, const char *to)
+{
+    int in = open(from, O_RDONLY);
+    if (in < 0) {
+        return -1;
+    }
+    int out = open(to, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (out < 0) {
+        close(in);
+        return -1;
+    }
+    static char buf[1 << 20];
+    ssize_t n;
+    int rc = 0;
+    while ((n = read(in, buf, sizeof(buf))) > 0) {
+        if (write(out, buf, (size_t)n) != n) {
+            rc = -1;
+            break;
+        }
+    }
+    close(in);
+    close(out);
+    return n < 0 ? -1 : rc;
+}
+
+// Put a pristine database of size tasks in place
+static int prepare_database(int size, const char *cache_dir)
+{
+    char cached[600];
+    bench_remove_database();
+    if (cache_dir) {
+        snprintf(cached, sizeof(cached), "%s/tasks-%d.db", cache_dir, size);
+        if (copy_file(cached, db_get_path()) == 0) {
+            return 0;
+        }
+    }
+
+    double start = now_ms();
+    if (db_init() != 0 || synth_populate(size) != 0) {
+        db_close();
+        return -1;
+    }
+    db_close(); // checkpoints the WAL into the file
+    fprintf(stderr, "Generated %d tasks in %.1fs\n", size, (now_ms() - start) / 1e3);
+
+    if (cache_dir) {
+        mkdir(cache_dir, 0755);
+        if (copy_file(db_get_path(), cached) != 0) {
+            fprintf(stderr, "Warning: Cannot keep %s: %s\n", cached, strerror(errno));
+        }
+    }
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    static const int default_sizes[] = {10000, 100000, 1000000};
+    Suite suite = {0};
+    suite.taskman = getenv("TASKMAN") ? getenv("TASKMAN") : "./taskman";
+    suite.runs = DEFAULT_RUNS;
+    suite.seed = 7;
+    const char *out_path = "bench/results.ndjson";
+    const char *cache_dir = NULL;
+    int sizes[64];
+    int nsizes = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--runs") == 0 && i + 1 < argc) {
+            suite.runs = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--out") == 0 && i + 1 < argc) {
+            out_path = argv[++i];
+        } else if (strcmp(argv[i], "--cache") == 0 && i + 1 < argc) {
+            cache_dir = argv[++i];
+        } else if (atoi(argv[i]) > 0 && nsizes < 64) {
+            sizes[nsizes++] = atoi(argv[i]);
+        } else {
+            fprintf(stderr, "Usage: %s [--runs N] [--out FILE] [--cache DIR] [task-count ...]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (nsizes == 0) {
+        memcpy(sizes, default_sizes, sizeof(default_sizes));
+        nsizes = 3;
+    }
+    if (suite.runs < 1) {
+        suite.runs = 1;
+    }
+
+    suite.out = fopen(out_path, "w");
+    if (!suite.out) {
+        fprintf(stderr, "Cannot write %s: %s\n", out_path, strerror(errno));
+        return 1;
+    }
+    if (bench_home_create() != 0) {
+        return 1;
+    }
+
+    fprintf(suite.out, "{\"type\":\"meta\",\"time\":%lld,\"sqlite\":\"%s\",\"cpus\":%ld,\"runs\":%d}\n",
+            (long long)time(NULL), sqlite3_libversion(), sysconf(_SC_NPROCESSORS_ONLN), suite.runs);
+    printf("%-9s %-4s %-9s %-5s %5s %10s %10s %10s %10s\n", "tasks", "via", "op", "cache", "runs", "p50 ms",
+           "p90 ms", "p99 ms", "max ms");
+
+    int failed = 0;
+    for (int s = 0; s < nsizes && !failed; s++) {
+        suite.size = sizes[s];
+        for (int layer = 0; layer < 2 && !failed; layer++) {
+            // Mutations pile up, so each layer starts from a fresh copy
+            if (prepare_database(suite.size, cache_dir) != 0) {
+                fprintf(stderr, "Failed to build a %d task database\n", suite.size);
+                failed = 1;
+                break;
+            }
+            for (int op = 0; op < OP_COUNT && !failed; op++) {
+                for (int cold = 1; cold >= 0 && !failed; cold--) {
+                    int rc = layer == 0 ? measure_api(&suite, (BenchOp)op, cold)
+                                        : measure_cli(&suite, (BenchOp)op, cold);
+                    if (rc != 0) {
+                        fprintf(stderr, "%s %s failed\n", layer == 0 ? "api" : "cli", op_names[op]);
+                        failed = 1;
+                    }
+                }
+            }
+        }
+    }
+
+    fclose(suite.out);
+    bench_home_remove();
+    if (!failed) {
+        printf("Results written to %s\n", out_path);
+    }
+    return failed;
+}
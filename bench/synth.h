@@ -0,0 +1,126 @@
+// Synthetic task databases for benchmarks.
+//
+// Descriptions mix common words (picked with a skew towards the frequent
+// ones), generated project names and ticket numbers. Most are 3 to 8
+// words long with a tail of long ones up to SYNTH_MAX_DESCRIPTION. Tasks are
+// created over five years in order; older tasks are mostly done and
+// recent ones mostly pending, for roughly 65% DONE overall.
+//
+// Everything is derived from the task number, so a given size always
+// produces the same database.
+
+#ifndef BENCH_SYNTH_H
+#define BENCH_SYNTH_H
+
+#include "../database.h"
+#include <stdio.h>
+#include <string.h>
+
+#define SYNTH_BATCH 10000
+#define SYNTH_START 1550000000 // 2019-02-12
+#define SYNTH_SPAN (5 * 365 * 24 * 3600)
+#define SYNTH_MAX_DESCRIPTION 256
+
+static const char *synth_words[] = {
+    "fix", "update", "review", "write", "check", "call", "email", "plan", "deploy", "test",
+    "the", "for", "and", "with", "to", "on", "about", "from", "before", "after",
+    "database", "migration", "release", "customer", "report", "docs", "meeting", "budget",
+    "invoice", "server", "backup", "refactor", "parser", "login", "page", "team", "weekly",
+    "build", "pipeline", "cleanup", "config", "api", "latency", "dashboard", "alerts",
+    "groceries", "dentist", "mom", "tickets", "flight", "hotel", "taxes", "insurance",
+    "onboarding", "interview", "candidate", "roadmap", "quarterly", "sprint", "retro",
+    "bug", "crash", "timeout", "memory", "leak", "cache", "index", "query", "schema",
+    "frontend", "backend", "mobile", "android", "ios", "payment", "checkout", "search",
+    "notification", "settings", "profile", "permissions", "export", "import", "upload",
+    "staging", "production", "rollback", "hotfix", "certificate", "domain", "dns", "vpn",
+    "laptop", "printer", "license", "contract", "vendor", "proposal", "slides", "demo",
+};
+
+static const char *synth_syllables[] = {
+    "ka", "lo", "mi", "ra", "te", "vu", "zo", "pen", "dar", "sil",
+    "bro", "qui", "nex", "tal", "mor", "fi", "gan", "hu", "jor", "wex",
+};
+
+static unsigned synth_next(unsigned *seed)
+{
+    *seed = *seed * 1103515245u + 12345u;
+    return *seed >> 16;
+}
+
+// The description stays valid until the next call
+static void synth_task(int n, int total, Task *task)
+{
+    static char d[SYNTH_MAX_DESCRIPTION];
+    const int nwords = (int)(sizeof(synth_words) / sizeof(synth_words[0]));
+    unsigned seed = (unsigned)n * 2654435761u;
+    size_t len = 0;
+
+    // 3-8 words usually, up to 40 for one task in twenty
+    unsigned r = synth_next(&seed) % 100;
+    int words = r < 95 ? 3 + (int)(synth_next(&seed) % 6) : 9 + (int)(synth_next(&seed) % 32);
+    for (int w = 0; w < words; w++) {
+        char word[32];
+        unsigned kind = synth_next(&seed) % 20;
+        if (kind == 0) {
+            snprintf(word, sizeof(word), "#%u", synth_next(&seed) % 20000);
+        } else if (kind == 1) {
+            size_t wl = 0;
+            for (int k = 0; k < 3; k++) {
+                const char *syl = synth_syllables[synth_next(&seed) % 20];
+                memcpy(word + wl, syl, strlen(syl));
+                wl += strlen(syl);
+            }
+            word[wl] = '\0';
+        } else {
+            // Squaring the uniform pick favours the front of the list
+            unsigned u = synth_next(&seed) % 1000;
+            snprintf(word, sizeof(word), "%s", synth_words[(int)(u * u / 1000000.0 * nwords)]);
+        }
+        size_t wl = strlen(word);
+        if (len + wl + 2 >= SYNTH_MAX_DESCRIPTION) {
+            break;
+        }
+        if (len > 0) {
+            d[len++] = ' ';
+        }
+        memcpy(d + len, word, wl);
+        len += wl;
+    }
+    if (len > 0 && d[0] >= 'a' && d[0] <= 'z') {
+        d[0] = (char)(d[0] - 'a' + 'A');
+    }
+    d[len] = '\0';
+
+    task->description = d;
+    task->id = n;
+    task->created = SYNTH_START + (time_t)((double)SYNTH_SPAN * n / total);
+    int recent = n > total - total / 5;
+    task->completed = synth_next(&seed) % 100 < (recent ? 20u : 76u) ? DONE : TODO;
+}
+
+// Fill the open database with count tasks, numbered from 1, in batches
+// through the same staging path as `taskman import`
+static int synth_populate(int count)
+{
+    for (int n = 1; n <= count; n += SYNTH_BATCH) {
+        if (db_begin() != 0) {
+            return -1;
+        }
+        int end = n + SYNTH_BATCH - 1 < count ? n + SYNTH_BATCH - 1 : count;
+        for (int i = n; i <= end; i++) {
+            Task task;
+            synth_task(i, count, &task);
+            if (db_stage_task(&task) != 0) {
+                db_rollback();
+                return -1;
+            }
+        }
+        if (db_flush_staged_tasks() != 0 || db_commit() != 0) {
+            db_rollback();
+            return -1;
+        }
+    }
+    return 0;
+}
+
+#endif // BENCH_SYNTH_H
@@ -0,0 +1,88 @@
+#!/bin/bash
+# Check that taskman watch follows changes made by other processes.
+#
+# Usage: bench/watch_check.sh [task-count]
+#
+# Runs "taskman watch --all" in a pseudo-terminal (util-linux script) on a
+# throwaway database, then adds, completes, edits and deletes tasks from
+# separate taskman runs, one by one and in bulk, and rewrites one task with
+# long descriptions until the watch has to compact its text. The watch must
+# merge each change into its view: after a forced full redraw the screen has
+# to list exactly what "taskman list-all" does, the view must have been
+# brought up to date from changed rows rather than reloads, and the process
+# must use no CPU time while nothing changes. Linux only (inotify, /proc).
+
+set -e
+
+TASKS=${1:-30}
+TASKMAN=${TASKMAN:-./taskman}
+
+export HOME=$(mktemp -d)
+export TASKMAN_NO_DAEMON=1
+trap 'rm -rf "$HOME"' EXIT
+SCREEN=$HOME/screen.out
+
+for i in $(seq 1 "$TASKS"); do
+    "$TASKMAN" add "Watched task $i" > /dev/null
+done
+
+cpu_ticks() {
+    awk '{ print $14 + $15 }' "/proc/$1/stat"
+}
+
+# The watch quits on q, sent once the changes below are done
+(sleep 6; printf q) | script -qfc "stty rows $(( TASKS + 40 )) cols 200; exec $TASKMAN watch --all" "$SCREEN" > /dev/null &
+sleep 1
+pid=$(pgrep -n -f "^$TASKMAN watch --all$")
+
+"$TASKMAN" add "Added while watching" > /dev/null
+"$TASKMAN" done 2 > /dev/null
+"$TASKMAN" edit 3 "Edited while watching" > /dev/null
+"$TASKMAN" delete --yes 4 > /dev/null
+"$TASKMAN" done 10-15 > /dev/null
+"$TASKMAN" edit --match "task 2" "Bulk edited" > /dev/null
+long=$(printf '%4000s' | tr ' ' x)
+for i in $(seq 1 40); do
+    "$TASKMAN" edit 5 "Long $i $long" > /dev/null
+done
+"$TASKMAN" edit 5 "Short again after long edits" > /dev/null
+sleep 1
+
+before=$(cpu_ticks "$pid")
+sleep 2
+idle=$(( $(cpu_ticks "$pid") - before ))
+
+# A resize redraws every line, so the last frame shows the whole view
+kill -WINCH "$pid"
+wait
+
+failed=0
+if [ "$idle" -ne 0 ]; then
+    echo "  used $idle CPU ticks while idle"
+    failed=1
+fi
+
+python3 - "$SCREEN" > "$HOME/watched.tsv" <<'EOF'
+import re, sys
+frames = open(sys.argv[1], encoding="utf-8", errors="replace").read().split("\x1b[2J")
+frame = [f for f in frames if "TaskMan Watch" in f][-1]
+for line in re.split(r"\x1b\[\d+;1H", frame):
+    line = re.sub(r"\x1b\[[0-9;?]*[A-Za-z]", "", line).rstrip()
+    row = re.match(r"^(\d+)\s+\[(TODO|DONE)\]\s+\S+ \S+\s+(.*)$", line)
+    if row:
+        print("\t".join(row.groups()))
+EOF
+"$TASKMAN" list-all --format=tsv | tail -n +2 | cut -f 1,2,5 > "$HOME/listed.tsv"
+if ! diff "$HOME/listed.tsv" "$HOME/watched.tsv" > /dev/null; then
+    echo "  watch shows something other than list-all:"
+    diff "$HOME/listed.tsv" "$HOME/watched.tsv" | sed 's/^/    /'
+    failed=1
+fi
+merges=$(grep -ao "read [0-9]* changed task(s)" "$SCREEN" | wc -l)
+if [ "$merges" -lt 6 ]; then
+    echo "  only $merges changes were merged, the rest reloaded every task"
+    failed=1
+fi
+
+echo "Watched $TASKS tasks: $(wc -l < "$HOME/watched.tsv") rows on screen, $merges merged changes, $idle idle CPU ticks"
+exit $failed
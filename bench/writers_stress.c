@@ -0,0 +1,192 @@
+// Many processes adding tasks to one database at the same time.
+//
+// Usage: bench/writers_stress [--cli] [writers] [tasks-per-writer]
+//        (default: 32 writers adding 200 tasks each)
+//
+// Each writer is a separate process with its own connection, like
+// concurrent taskman runs. With --cli every add really is a `taskman add`
+// process ($TASKMAN, default ./taskman, in direct mode). Afterwards every
+// task is looked up by its description: the run fails (exit 1) when any
+// task is missing or was stored twice. The database lives under a
+// temporary HOME.
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "bench.h"
+#include <fcntl.h>
+#include <sqlite3.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+typedef struct
+{
+    int added;
+    int failed;
+    int retries;
+} WriterResult;
+
+static int cli_add(const char *taskman, const char *description)
+{
+    pid_t pid = fork();
+    if (pid == 0) {
+        int null = open("/dev/null", O_WRONLY);
+        dup2(null, STDOUT_FILENO);
+        setenv("TASKMAN_NO_DAEMON", "1", 1);
+        execl(taskman, taskman, "add", description, (char *)NULL);
+        _exit(127);
+    }
+    int status;
+    return pid > 0 && waitpid(pid, &status, 0) == pid && WIFEXITED(status) && WEXITSTATUS(status) == 0 ? 0 : -1;
+}
+
+static void run_writer(int writer, int tasks, const char *taskman, int out)
+{
+    WriterResult result = {0, 0, 0};
+    if (!taskman && db_init() != 0) {
+        result.failed = tasks;
+        tasks = 0;
+    }
+
+    for (int i = 0; i < tasks; i++) {
+        char description[64];
+        Task task;
+        task.description = description;
+        snprintf(description, sizeof(description), "writer %d task %d", writer, i);
+        task.completed = TODO;
+        task.created = time(NULL);
+        int rc = taskman ? cli_add(taskman, task.description) : db_add_task(&task);
+        if (rc == 0) {
+            result.added++;
+        } else {
+            result.failed++;
+        }
+    }
+
+    if (!taskman) {
+        result.retries = db_busy_retries();
+        db_close();
+    }
+    if (write(out, &result, sizeof(result)) != (ssize_t)sizeof(result)) {
+        _exit(1);
+    }
+    _exit(0);
+}
+
+// Count descriptions that are missing and stored more than once
+static int verify(int writers, int tasks, int *lost, int *duplicated)
+{
+    sqlite3 *conn;
+    sqlite3_stmt *stmt;
+    if (sqlite3_open_v2(db_get_path(), &conn, SQLITE_OPEN_READONLY, NULL) != SQLITE_OK ||
+        sqlite3_prepare_v2(conn, "SELECT COUNT(*) FROM tasks WHERE description = ?;", -1, &stmt, NULL) != SQLITE_OK) {
+        fprintf(stderr, "Cannot verify: %s\n", sqlite3_errmsg(conn));
+        sqlite3_close(conn);
+        return -1;
+    }
+
+    *lost = 0;
+    *duplicated = 0;
+    char description[64];
+    for (int w = 0; w < writers; w++) {
+        for (int i = 0; i < tasks; i++) {
+            snprintf(description, sizeof(description), "writer %d task %d", w, i);
+            sqlite3_bind_text(stmt, 1, description, -1, SQLITE_STATIC);
+            int copies = sqlite3_step(stmt) == SQLITE_ROW ? sqlite3_column_int(stmt, 0) : 0;
+            sqlite3_reset(stmt);
+            *lost += copies == 0;
+            *duplicated += copies > 1 ? copies - 1 : 0;
+        }
+    }
+    sqlite3_finalize(stmt);
+    sqlite3_close(conn);
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    const char *taskman = NULL;
+    int arg = 1;
+    if (arg < argc && strcmp(argv[arg], "--cli") == 0) {
+        taskman = getenv("TASKMAN") ? getenv("TASKMAN") : "./taskman";
+        arg++;
+    }
+    int writers = arg < argc ? atoi(argv[arg++]) : 32;
+    int tasks = arg < argc ? atoi(argv[arg++]) : 200;
+    if (writers <= 0 || tasks <= 0) {
+        fprintf(stderr, "Usage: %s [--cli] [writers] [tasks-per-writer]\n", argv[0]);
+        return 1;
+    }
+
+    if (bench_home_create() != 0) {
+        return 1;
+    }
+
+    // Create the database up front so the writers only race on adds
+    if (db_init() != 0) {
+        return 1;
+    }
+    db_close();
+
+    int fds[2];
+    if (pipe(fds) != 0) {
+        perror("pipe");
+        return 1;
+    }
+
+    double start = now_ms();
+    for (int w = 0; w < writers; w++) {
+        pid_t pid = fork();
+        if (pid == 0) {
+            close(fds[0]);
+            run_writer(w, tasks, taskman, fds[1]);
+        }
+        if (pid < 0) {
+            perror("fork");
+            return 1;
+        }
+    }
+    close(fds[1]);
+
+    WriterResult total = {0, 0, 0};
+    WriterResult result;
+    int reported = 0;
+    while (read(fds[0], &result, sizeof(result)) == (ssize_t)sizeof(result)) {
+        total.added += result.added;
+        total.failed += result.failed;
+        total.retries += result.retries;
+        reported++;
+    }
+    while (wait(NULL) > 0) {
+    }
+    double elapsed = now_ms() - start;
+
+    int lost = 0, duplicated = 0;
+    if (verify(writers, tasks, &lost, &duplicated) != 0) {
+        return 1;
+    }
+
+    // The triggers kept the counters right through every collision
+    TaskStats stored, actual;
+    int counters = db_init() == 0 ? db_check_task_stats(&stored, &actual) : -1;
+    db_close();
+
+    printf("mode:          %s\n", taskman ? "cli" : "library");
+    printf("writers:       %d (%d reported)\n", writers, reported);
+    printf("tasks:         %d added, %d failed\n", total.added, total.failed);
+    printf("elapsed:       %.0f ms\n", elapsed);
+    printf("throughput:    %.0f adds/s\n", total.added / (elapsed / 1e3));
+    if (!taskman) {
+        printf("busy retries:  %d\n", total.retries);
+    }
+    printf("lost:          %d\n", lost);
+    printf("duplicated:    %d\n", duplicated);
+    printf("counters:      %s\n", counters == 0 ? "consistent" : "WRONG");
+
+    bench_home_remove();
+
+    return reported == writers && total.failed == 0 && lost == 0 && duplicated == 0 && counters == 0 ? 0 : 1;
+}
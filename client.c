@@ -0,0 +1,268 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "client.h"
+#include "trace.h"
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// Returns -1 quietly when no daemon is listening, so callers can fall
+// back to opening the database themselves
+int client_connect(Client *client)
+{
+    memset(client, 0, sizeof(*client));
+    client->fd = -1;
+
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (proto_socket_path(addr.sun_path, sizeof(addr.sun_path)) != 0) {
+        return -1;
+    }
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        close(fd);
+        return -1;
+    }
+    client->fd = fd;
+    return 0;
+}
+
+void client_close(Client *client)
+{
+    if (client->fd >= 0) {
+        close(client->fd);
+        client->fd = -1;
+    }
+    proto_buf_free(&client->out);
+    proto_buf_free(&client->in);
+}
+
+// Start a request frame in the send buffer; the caller appends the
+// payload and finishes it with proto_end()
+size_t client_begin(Client *client, ProtoOp op, uint32_t *id)
+{
+    *id = ++client->next_id;
+    return proto_begin(&client->out, op, *id);
+}
+
+int client_flush(Client *client)
+{
+    if (client->out.failed) {
+        return -1;
+    }
+    size_t done = 0;
+    while (done < client->out.len) {
+        ssize_t n = write(client->fd, client->out.data + done, client->out.len - done);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        done += (size_t)n;
+    }
+    client->out.len = 0;
+    return 0;
+}
+
+// Read the next response frame. Its payload stays valid until the next
+// call. Returns -1 when the daemon went away or sent garbage.
+int client_next(Client *client, ProtoFrame *frame)
+{
+    while (1) {
+        long used = proto_parse(client->in.data + client->in_pos, client->in.len - client->in_pos, frame);
+        if (used < 0) {
+            return -1;
+        }
+        if (used > 0) {
+            client->in_pos += (size_t)used;
+            return 0;
+        }
+
+        // Keep the partial frame and make room behind it
+        proto_buf_consume(&client->in, client->in_pos);
+        client->in_pos = 0;
+        size_t have = client->in.len;
+        if (!proto_reserve(&client->in, 64 * 1024)) {
+            return -1;
+        }
+        // Mostly time spent waiting for the daemon to answer
+        TraceSpan span = trace_begin("client.read");
+        ssize_t n;
+        do {
+            n = read(client->fd, client->in.data + have, 64 * 1024);
+        } while (n < 0 && errno == EINTR);
+        trace_end(span);
+        if (n <= 0) {
+            client->in.len = have;
+            return -1;
+        }
+        client->in.len = have + (size_t)n;
+    }
+}
+
+// Send one request carrying an optional task ID and text, and read the
+// single frame that answers it
+static int call(Client *client, ProtoOp op, int id, const char *text, ProtoFrame *reply)
+{
+    uint32_t request;
+    size_t start = client_begin(client, op, &request);
+    if (id >= 0) {
+        proto_put_u32(&client->out, (uint32_t)id);
+    }
+    if (text) {
+        proto_put_bytes(&client->out, text, strlen(text));
+    }
+    if (proto_end(&client->out, start) != 0 || client_flush(client) != 0 ||
+        client_next(client, reply) != 0 || reply->id != request) {
+        return -1;
+    }
+    if (reply->op == PROTO_ERROR) {
+        fprintf(stderr, "Error: taskmand: %.*s\n", (int)reply->len, (const char *)reply->payload);
+        return -1;
+    }
+    return 0;
+}
+
+// Value of an OK reply carrying one number
+static int call_count(Client *client, ProtoOp op, int id, const char *text)
+{
+    ProtoFrame reply;
+    if (call(client, op, id, text, &reply) != 0 || reply.op != PROTO_OK || reply.len < 4) {
+        return -1;
+    }
+    return (int)proto_get_u32(reply.payload);
+}
+
+// Hand the ROW frames of a reply to callback until END. Rows after the
+// callback asked to stop are still read so the stream stays in sync.
+static int read_rows(Client *client, ProtoFrame *frame, TaskRowCallback callback, void *ctx)
+{
+    int rows = 0;
+    int stopped = 0;
+    while (frame->op == PROTO_ROW) {
+        TaskRow row;
+        if (proto_get_row(frame, &row) != 0) {
+            return -1;
+        }
+        if (!stopped) {
+            rows++;
+            stopped = callback(&row, ctx) != 0;
+        }
+        if (client_next(client, frame) != 0) {
+            return -1;
+        }
+    }
+    return frame->op == PROTO_END ? rows : -1;
+}
+
+int client_add_task(Client *client, const char *description, int *id)
+{
+    int added = call_count(client, PROTO_ADD, -1, description);
+    if (added <= 0) {
+        return -1;
+    }
+    *id = added;
+    return 0;
+}
+
+// The description is malloc'd (see task_clear())
+static int copy_task(const TaskRow *row, void *ctx)
+{
+    Task *task = ctx;
+    task->description = malloc((size_t)row->description_len + 1);
+    if (!task->description) {
+        return 1;
+    }
+    task->id = row->id;
+    memcpy(task->description, row->description, (size_t)row->description_len);
+    task->description[row->description_len] = '\0';
+    task->completed = row->completed;
+    task->created = row->created;
+    return 0;
+}
+
+int client_get_task(Client *client, int id, Task *task)
+{
+    ProtoFrame reply;
+    if (call(client, PROTO_GET, id, NULL, &reply) != 0) {
+        return -1;
+    }
+    task->description = NULL;
+    int found = read_rows(client, &reply, copy_task, task);
+    return found > 0 && !task->description ? -1 : found;
+}
+
+int client_set_task_status(Client *client, int id, Status status)
+{
+    // The daemon only marks tasks as done; that is all the CLI needs
+    return status == DONE ? call_count(client, PROTO_DONE, id, NULL) : -1;
+}
+
+int client_delete_task(Client *client, int id)
+{
+    return call_count(client, PROTO_DELETE, id, NULL);
+}
+
+int client_set_task_description(Client *client, int id, const char *description)
+{
+    return call_count(client, PROTO_EDIT, id, description);
+}
+
+int client_each_task(Client *client, const TaskQuery *query, TaskRowCallback callback, void *ctx)
+{
+    uint32_t request;
+    size_t start = client_begin(client, PROTO_LIST, &request);
+    proto_put_u8(&client->out, query->pending_only ? 1 : 0);
+    proto_put_u32(&client->out, (uint32_t)query->after_id);
+    proto_put_u32(&client->out, (uint32_t)query->limit);
+
+    ProtoFrame frame;
+    if (proto_end(&client->out, start) != 0 || client_flush(client) != 0 ||
+        client_next(client, &frame) != 0 || frame.id != request) {
+        return -1;
+    }
+    if (frame.op == PROTO_ERROR) {
+        return TASKS_AFTER_NOT_FOUND; // the only error a listing gets
+    }
+    return read_rows(client, &frame, callback, ctx);
+}
+
+int client_search_tasks(Client *client, const char *term, TaskRowCallback callback, void *ctx)
+{
+    ProtoFrame reply;
+    if (call(client, PROTO_SEARCH, -1, term, &reply) != 0) {
+        return -1;
+    }
+    return read_rows(client, &reply, callback, ctx);
+}
+
+int client_task_stats(Client *client, TaskStats *tasks, DbStatementStats *stats)
+{
+    ProtoFrame reply;
+    if (call(client, PROTO_STATUS, -1, NULL, &reply) != 0 || reply.op != PROTO_OK || reply.len < 16) {
+        return -1;
+    }
+    tasks->total = (int)proto_get_u32(reply.payload);
+    tasks->completed = (int)proto_get_u32(reply.payload + 4);
+    stats->prepared = (int)proto_get_u32(reply.payload + 8);
+    stats->reused = (int)proto_get_u32(reply.payload + 12);
+
+    long oldest = proto_get_task(reply.payload + 16, reply.len - 16, &tasks->oldest_pending);
+    if (oldest < 0 || proto_get_task(reply.payload + 16 + oldest, reply.len - 16 - (size_t)oldest, &tasks->newest) < 0) {
+        if (oldest >= 0) {
+            task_clear(&tasks->oldest_pending);
+        }
+        return -1;
+    }
+    return 0;
+}
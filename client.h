@@ -0,0 +1,37 @@
+#ifndef CLIENT_H
+#define CLIENT_H
+
+#include "database.h"
+#include "protocol.h"
+
+// Connection to a running taskmand. The request helpers mirror the
+// db_* functions of the same name and return the same values, so the
+// CLI can use either one.
+typedef struct
+{
+    int fd;
+    uint32_t next_id;
+    ProtoBuf out;
+    ProtoBuf in;
+    size_t in_pos; // start of the next unread frame in in
+} Client;
+
+int client_connect(Client *client);
+void client_close(Client *client);
+
+// Low-level pipelining: queue any number of requests, flush them in one
+// write, then read the response frames back in order
+size_t client_begin(Client *client, ProtoOp op, uint32_t *id);
+int client_flush(Client *client);
+int client_next(Client *client, ProtoFrame *frame);
+
+int client_add_task(Client *client, const char *description, int *id);
+int client_get_task(Client *client, int id, Task *task);
+int client_set_task_status(Client *client, int id, Status status);
+int client_delete_task(Client *client, int id);
+int client_set_task_description(Client *client, int id, const char *description);
+int client_each_task(Client *client, const TaskQuery *query, TaskRowCallback callback, void *ctx);
+int client_search_tasks(Client *client, const char *term, TaskRowCallback callback, void *ctx);
+int client_task_stats(Client *client, TaskStats *tasks, DbStatementStats *stats);
+
+#endif // CLIENT_H
@@ -1,41 +1,616 @@
+#define _POSIX_C_SOURCE 200809L
+
 #include "database.h"
+#include "match.h"
+#include "trace.h"
 #include <sqlite3.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <ctype.h>
+#include <limits.h>
 #include <sys/stat.h>
 #include <unistd.h>
 #include <pwd.h>
+#include <time.h>
 
 static sqlite3 *db = NULL;
 static char db_path[512] = {0};
+static char archive_path[512] = {0};
+static int archive_attached = 0;
+static int schema_version = 0;
+static int busy_retries = 0;
+static int fts_enabled = -1; // not yet looked up; see fts_available()
+
+// Several taskman processes (and taskmand) may write at once. In WAL mode
+// readers never wait for a writer, and a writer that finds the database
+// locked backs off and retries for up to DB_BUSY_TIMEOUT_MS.
+#define DB_BUSY_TIMEOUT_MS 5000
+#define DB_BUSY_MAX_DELAY_MS 32
+
+// Tasks moved to the archive per transaction, and free pages handed back
+// per incremental_vacuum step
+#define DB_ARCHIVE_BATCH 5000
+#define DB_VACUUM_STEP_PAGES "1000"
+
+// Settings stored in the file, applied by migrate() together with the
+// schema
+static const char *FILE_SETTINGS_SQL = 
+    // Only takes effect in a new, empty file; see db_archive_tasks()
+    "PRAGMA auto_vacuum = INCREMENTAL;"
+    "PRAGMA journal_mode = WAL;";
 
-// SQL statements
+// Per connection, and only sets a flag: no I/O. With WAL, NORMAL only
+// risks the last commits on power loss, never corruption
+static const char *SYNCHRONOUS_SQL = 
+    "PRAGMA synchronous = NORMAL;";
+
+// Schema migrations, applied in order and recorded in PRAGMA
+// user_version (see migrate()). Databases written before user_version was
+// kept may already have some of these tables and indexes, so every
+// CREATE and DROP is guarded with IF [NOT] EXISTS. ALTER TABLE ADD COLUMN
+// has no such guard: 4 and 5 rely on user_version alone, which is safe
+// because their columns are newer than user_version.
+//
+// 1: the tasks table and the indexes that listing, status and paging
+// walk. (created) covers creation-order listing, (completed, created)
+// pending-only listing and the oldest pending task; both end in the rowid,
+// so ties are already in (created, id) order and nothing is ever sorted.
 static const char *CREATE_TABLE_SQL = 
     "CREATE TABLE IF NOT EXISTS tasks ("
     "id INTEGER PRIMARY KEY,"
     "description TEXT NOT NULL,"
     "completed INTEGER NOT NULL DEFAULT 0,"
     "created INTEGER NOT NULL"
-    ");";
+    ");"
+    "CREATE INDEX IF NOT EXISTS idx_tasks_created ON tasks (created);"
+    "CREATE INDEX IF NOT EXISTS idx_tasks_completed_created ON tasks (completed, created);";
 
 static const char *INSERT_TASK_SQL = 
     "INSERT INTO tasks (id, description, completed, created) VALUES (?, ?, ?, ?);";
 
+// The ID is left to SQLite, which picks MAX(rowid) + 1 while it holds the
+// write lock, so concurrent adds can never be given the same ID
+static const char *ADD_TASK_SQL = 
+    "INSERT INTO tasks (description, completed, created) VALUES (?, ?, ?);";
+
 static const char *UPDATE_TASK_SQL = 
     "UPDATE tasks SET description = ?, completed = ? WHERE id = ?;";
 
 static const char *DELETE_TASK_SQL = 
     "DELETE FROM tasks WHERE id = ?;";
 
+static const char *SELECT_TASK_SQL = 
+    "SELECT id, description, completed, created FROM tasks WHERE id = ?;";
+
+static const char *SET_COMPLETED_SQL = 
+    "UPDATE tasks SET completed = ? WHERE id = ?;";
+
+static const char *SET_DESCRIPTION_SQL = 
+    "UPDATE tasks SET description = ? WHERE id = ?;";
+
+static const char *COUNT_BY_STATUS_SQL = 
+    "SELECT COUNT(*), COALESCE(SUM(completed = 1), 0) FROM tasks;";
+
+// 2: task totals kept in a one-row table by triggers, so counting never
+// scans. The migration runs in one transaction, so no write can slip in
+// between the count and the triggers.
+static const char *CREATE_COUNTERS_SQL = 
+    "CREATE TABLE IF NOT EXISTS task_counters ("
+    "id INTEGER PRIMARY KEY CHECK (id = 1),"
+    "total INTEGER NOT NULL,"
+    "completed INTEGER NOT NULL"
+    ");"
+    "INSERT OR IGNORE INTO task_counters (id, total, completed) "
+    "SELECT 1, COUNT(*), COALESCE(SUM(completed = 1), 0) FROM tasks;"
+    "CREATE TRIGGER IF NOT EXISTS task_counters_insert AFTER INSERT ON tasks BEGIN "
+    "UPDATE task_counters SET total = total + 1, completed = completed + (new.completed = 1); "
+    "END;"
+    "CREATE TRIGGER IF NOT EXISTS task_counters_delete AFTER DELETE ON tasks BEGIN "
+    "UPDATE task_counters SET total = total - 1, completed = completed - (old.completed = 1); "
+    "END;"
+    "CREATE TRIGGER IF NOT EXISTS task_counters_update AFTER UPDATE OF completed ON tasks BEGIN "
+    "UPDATE task_counters SET completed = completed + (new.completed = 1) - (old.completed = 1); "
+    "END;";
+
+static const char *COUNT_FROM_COUNTERS_SQL = 
+    "SELECT total, completed FROM task_counters;";
+
+// Counters plus the oldest pending and the newest task, each found with
+// one step along an index
+static const char *TASK_STATS_SQL = 
+    "SELECT c.total, c.completed, "
+    "p.id, p.description, p.completed, p.created, n.id, n.description, n.completed, n.created "
+    "FROM task_counters AS c "
+    "LEFT JOIN (SELECT id, description, completed, created FROM tasks WHERE completed = 0 "
+    "ORDER BY created, id LIMIT 1) AS p "
+    "LEFT JOIN (SELECT id, description, completed, created FROM tasks "
+    "ORDER BY created DESC, id DESC LIMIT 1) AS n;";
+
+// The same answer computed from scratch: counted by a full scan, and
+// with the indexes bypassed, for a database without counters and for
+// checking the maintained ones
+static const char *TASK_STATS_SCAN_SQL = 
+    "SELECT c.total, c.completed, "
+    "p.id, p.description, p.completed, p.created, n.id, n.description, n.completed, n.created "
+    "FROM (SELECT COUNT(*) AS total, COALESCE(SUM(completed = 1), 0) AS completed FROM tasks) AS c "
+    "LEFT JOIN (SELECT id, description, completed, created FROM tasks NOT INDEXED WHERE completed = 0 "
+    "ORDER BY created, id LIMIT 1) AS p "
+    "LEFT JOIN (SELECT id, description, completed, created FROM tasks NOT INDEXED "
+    "ORDER BY created DESC, id DESC LIMIT 1) AS n;";
+
 static const char *SELECT_ALL_TASKS_SQL = 
-    "SELECT id, description, completed, created FROM tasks ORDER BY created ASC;";
+    "SELECT id, description, completed, created FROM tasks ORDER BY created, id;";
+
+// Pending tasks with IDs in [?1, ?2] for shell completion, descriptions cut
+// to ?3 characters. Left to itself SQLite picks
+// idx_tasks_completed_created and sorts every pending task, hence the
+// INDEXED BY.
+static const char *COMPLETE_IDS_SQL =
+    "SELECT id, substr(description, 1, ?3), completed, created FROM tasks INDEXED BY idx_tasks_pending_id "
+    "WHERE id BETWEEN ?1 AND ?2 AND completed = 0 ORDER BY id LIMIT ?4;";
+
+// The same on a database not yet migrated to idx_tasks_pending_id: a rowid
+// range, skipping completed tasks one row at a time
+static const char *COMPLETE_IDS_SCAN_SQL =
+    "SELECT id, substr(description, 1, ?3), completed, created FROM tasks "
+    "WHERE id BETWEEN ?1 AND ?2 AND +completed = 0 ORDER BY id LIMIT ?4;";
+
+// Keyset-paginated listing in (created, id) order. ?1 is the task to
+// continue after and ?2 the row limit (-1 for no limit).
+static const char *LIST_ALL_SQL = 
+    "SELECT id, description, completed, created FROM tasks "
+    "ORDER BY created, id LIMIT ?2;";
+
+static const char *LIST_ALL_AFTER_SQL = 
+    "SELECT id, description, completed, created FROM tasks "
+    "WHERE (created, id) > (SELECT created, id FROM tasks WHERE id = ?1) "
+    "ORDER BY created, id LIMIT ?2;";
+
+static const char *LIST_PENDING_SQL = 
+    "SELECT id, description, completed, created FROM tasks WHERE completed = 0 "
+    "ORDER BY created, id LIMIT ?2;";
+
+static const char *LIST_PENDING_AFTER_SQL = 
+    "SELECT id, description, completed, created FROM tasks WHERE completed = 0 "
+    "AND (created, id) > (SELECT created, id FROM tasks WHERE id = ?1) "
+    "ORDER BY created, id LIMIT ?2;";
+
+// Whether the task a page continues after exists; only asked when the
+// page came back empty
+static const char *TASK_EXISTS_SQL = 
+    "SELECT EXISTS (SELECT 1 FROM tasks WHERE id = ?1);";
+
+static const char *COUNT_TASKS_SQL = 
+    "SELECT COUNT(*) FROM tasks;";
 
 static const char *SELECT_MAX_ID_SQL = 
     "SELECT MAX(id) FROM tasks;";
 
+// Changes whenever another connection commits to the database
+static const char *DATA_VERSION_SQL = 
+    "PRAGMA data_version;";
+
+// The same word matching as the daemon and the snapshot (match.h), by
+// scanning every description
 static const char *SEARCH_TASKS_SQL = 
-    "SELECT id, description, completed, created FROM tasks WHERE description LIKE ? ORDER BY created ASC;";
+    "SELECT id, description, completed, created FROM tasks WHERE task_matches(description, ?1) "
+    "ORDER BY created, id;";
+
+// The same answer from the trigram index: ?2 is an FTS5 query for the
+// words of the term ?1 that are long enough to index, and task_matches()
+// checks the candidates it returns
+static const char *FTS_SEARCH_TASKS_SQL = 
+    "SELECT t.id, t.description, t.completed, t.created "
+    "FROM tasks_fts JOIN tasks AS t ON t.id = tasks_fts.rowid "
+    "WHERE tasks_fts MATCH ?2 AND task_matches(t.description, ?1) "
+    "ORDER BY t.created, t.id;";
+
+// 3: used to create a word-prefix FTS5 index that disagreed with the
+// substring matching of the daemon and the snapshot; 7 drops it and 8
+// replaces it. The number stays taken so versions keep their meaning.
+
+// 4: a generation number bumped by every change to a task, and a log of
+// the tasks changed in each generation, so a copy of the tasks (the
+// snapshot, see snapshot.h) can catch up by reading only what changed.
+// The log keeps one row per task and is pruned by the snapshot; it holds
+// every change after changes_from. The counter triggers are replaced by
+// ones that also keep the log.
+//
+// New tasks normally get the highest ID, and a copy finds those by ID
+// range instead, so adds and imports only log the rare insert below the
+// current maximum.
+static const char *CREATE_CHANGE_LOG_SQL = 
+    "ALTER TABLE task_counters ADD COLUMN generation INTEGER NOT NULL DEFAULT 0;"
+    "ALTER TABLE task_counters ADD COLUMN changes_from INTEGER NOT NULL DEFAULT 0;"
+    "CREATE TABLE IF NOT EXISTS task_changes ("
+    "id INTEGER PRIMARY KEY,"
+    "generation INTEGER NOT NULL"
+    ");"
+    "CREATE INDEX IF NOT EXISTS idx_task_changes_generation ON task_changes (generation);"
+    "DROP TRIGGER IF EXISTS task_counters_insert;"
+    "DROP TRIGGER IF EXISTS task_counters_delete;"
+    "DROP TRIGGER IF EXISTS task_counters_update;"
+    "CREATE TRIGGER IF NOT EXISTS task_counters_insert AFTER INSERT ON tasks BEGIN "
+    "UPDATE task_counters SET total = total + 1, completed = completed + (new.completed = 1), "
+    "generation = generation + 1; "
+    "INSERT OR REPLACE INTO task_changes (id, generation) SELECT new.id, generation FROM task_counters "
+    "WHERE new.id < (SELECT MAX(id) FROM tasks); "
+    "END;"
+    "CREATE TRIGGER IF NOT EXISTS task_counters_delete AFTER DELETE ON tasks BEGIN "
+    "UPDATE task_counters SET total = total - 1, completed = completed - (old.completed = 1), "
+    "generation = generation + 1; "
+    "INSERT OR REPLACE INTO task_changes (id, generation) SELECT old.id, generation FROM task_counters; "
+    "END;"
+    "CREATE TRIGGER IF NOT EXISTS task_counters_update AFTER UPDATE ON tasks BEGIN "
+    "UPDATE task_counters SET completed = completed + (new.completed = 1) - (old.completed = 1), "
+    "generation = generation + 1; "
+    "INSERT OR REPLACE INTO task_changes (id, generation) SELECT new.id, generation FROM task_counters; "
+    "INSERT OR REPLACE INTO task_changes (id, generation) "
+    "SELECT old.id, generation FROM task_counters WHERE old.id <> new.id; "
+    "END;";
+
+static const char *GENERATION_SQL = 
+    "SELECT generation, changes_from FROM task_counters;";
+
+// Both walk the generation index: left to itself SQLite scans the whole
+// log in ID order, which is every change since the last prune
+static const char *CHANGED_IDS_SQL = 
+    "SELECT id FROM task_changes INDEXED BY idx_task_changes_generation WHERE generation > ?1;";
+
+// Changed tasks that still exist, and the tasks above ID ?2
+static const char *CHANGED_TASKS_SQL = 
+    "SELECT t.id, t.description, t.completed, t.created "
+    "FROM task_changes AS c INDEXED BY idx_task_changes_generation "
+    "JOIN tasks AS t ON t.id = c.id WHERE c.generation > ?1 AND t.id <= ?2 "
+    "UNION ALL "
+    "SELECT id, description, completed, created FROM tasks WHERE id > ?2;";
+
+static const char *PRUNE_CHANGES_SQL = 
+    "DELETE FROM task_changes WHERE generation <= ?1;";
+
+static const char *SET_CHANGES_FROM_SQL = 
+    "UPDATE task_counters SET changes_from = MAX(changes_from, ?1);";
+
+// 5: the highest ID ever moved to the archive (see db_archive_tasks()).
+// New IDs start above it, so a task never reuses the ID of an archived one
+// even when the newest tasks were archived.
+static const char *CREATE_ARCHIVE_FLOOR_SQL = 
+    "ALTER TABLE task_counters ADD COLUMN archived_max_id INTEGER NOT NULL DEFAULT 0;";
+
+// 6: pending tasks by ID, for shell completion of task IDs. Partial, so
+// it only holds pending tasks and a prefix never steps over completed ones.
+static const char *CREATE_PENDING_ID_INDEX_SQL = 
+    "CREATE INDEX IF NOT EXISTS idx_tasks_pending_id ON tasks (id) WHERE completed = 0;";
+
+// 7: drop the word-prefix index of 3
+static const char *DROP_FTS_SQL = 
+    "DROP TRIGGER IF EXISTS tasks_fts_insert;"
+    "DROP TRIGGER IF EXISTS tasks_fts_delete;"
+    "DROP TRIGGER IF EXISTS tasks_fts_update;"
+    "DROP TABLE IF EXISTS tasks_fts;";
+
+// 8: a trigram FTS5 index over the descriptions, kept in sync by triggers.
+// A trigram index answers substring queries, so it finds every task
+// task_matches() accepts (and, folding non-ASCII case too, a few more,
+// which the search filters out again). SQLite builds without FTS5 or the
+// trigram tokenizer (before 3.34) skip it and search by scanning.
+static const char *CREATE_FTS_TABLE_SQL = 
+    "CREATE VIRTUAL TABLE IF NOT EXISTS tasks_fts USING fts5("
+    "description, content='tasks', content_rowid='id', tokenize='trigram');";
+
+// Kept apart: bulk loads drop it for a batch (see db_flush_staged_tasks())
+static const char *CREATE_FTS_INSERT_TRIGGER_SQL = 
+    "CREATE TRIGGER IF NOT EXISTS tasks_fts_insert AFTER INSERT ON tasks BEGIN "
+    "INSERT INTO tasks_fts (rowid, description) VALUES (new.id, new.description); "
+    "END;";
+
+// Segments are merged 16 at a time rather than 4, which writes each row's
+// trigrams fewer times over: 10-20% off bulk loads, and searches measured
+// no slower.
+static const char *CREATE_FTS_SQL = 
+    "INSERT INTO tasks_fts (tasks_fts, rank) VALUES ('automerge', 16);"
+    "INSERT INTO tasks_fts (tasks_fts) VALUES ('rebuild');"
+    "CREATE TRIGGER IF NOT EXISTS tasks_fts_delete AFTER DELETE ON tasks BEGIN "
+    "INSERT INTO tasks_fts (tasks_fts, rowid, description) VALUES ('delete', old.id, old.description); "
+    "END;"
+    "CREATE TRIGGER IF NOT EXISTS tasks_fts_update AFTER UPDATE OF description ON tasks BEGIN "
+    "INSERT INTO tasks_fts (tasks_fts, rowid, description) VALUES ('delete', old.id, old.description); "
+    "INSERT INTO tasks_fts (rowid, description) VALUES (new.id, new.description); "
+    "END;";
+
+// Merges the index segments into one after large changes
+static const char *OPTIMIZE_FTS_SQL = 
+    "INSERT INTO tasks_fts (tasks_fts) VALUES ('optimize');";
+
+static const char *ADD_TASK_ABOVE_ARCHIVE_SQL = 
+    "INSERT INTO tasks (id, description, completed, created) "
+    "SELECT MAX(COALESCE((SELECT MAX(id) FROM tasks), 0), archived_max_id) + 1, ?1, ?2, ?3 "
+    "FROM task_counters;";
+
+static const char *NEXT_ID_SQL = 
+    "SELECT MAX(COALESCE((SELECT MAX(id) FROM tasks), 0), archived_max_id) + 1 FROM task_counters;";
+
+// The archive is a second database file, archive.db next to tasks.db,
+// attached as "archive" when a command needs it. Completed tasks are
+// moved there in batches; listing and search leave it alone unless asked.
+// Both files reclaim the pages freed by moving tasks with
+// incremental_vacuum rather than a full VACUUM.
+static const char *CREATE_ARCHIVE_SQL = 
+    "PRAGMA archive.auto_vacuum = INCREMENTAL;"
+    "PRAGMA archive.journal_mode = WAL;"
+    "CREATE TABLE IF NOT EXISTS archive.tasks ("
+    "id INTEGER PRIMARY KEY,"
+    "description TEXT NOT NULL,"
+    "completed INTEGER NOT NULL,"
+    "created INTEGER NOT NULL,"
+    "archived INTEGER NOT NULL"
+    ");"
+    "CREATE INDEX IF NOT EXISTS archive.idx_tasks_created ON tasks (created);";
+
+// One batch: the oldest completed tasks created up to ?1, at most ?2
+static const char *SELECT_ARCHIVABLE_SQL = 
+    "INSERT INTO temp.selected_tasks "
+    "SELECT id FROM tasks WHERE completed = 1 AND created <= ?1 ORDER BY created LIMIT ?2;";
+
+// REPLACE, so a batch copied before a crash but not yet deleted from
+// tasks is simply copied again by the next run
+static const char *ARCHIVE_SELECTED_SQL = 
+    "INSERT OR REPLACE INTO archive.tasks (id, description, completed, created, archived) "
+    "SELECT t.id, t.description, t.completed, t.created, ?1 "
+    "FROM temp.selected_tasks AS s JOIN tasks AS t ON t.id = s.id;";
+
+static const char *RAISE_ARCHIVE_FLOOR_SQL = 
+    "UPDATE task_counters SET archived_max_id = "
+    "MAX(archived_max_id, COALESCE((SELECT MAX(id) FROM temp.selected_tasks), 0));";
+
+static const char *AUTO_VACUUM_SQL = 
+    "PRAGMA main.auto_vacuum;";
+
+static const char *FREELIST_COUNT_SQL = 
+    "PRAGMA main.freelist_count;";
+
+// Listing in (created, id) order across both files. Each side walks its
+// created index and SQLite merges the two streams, so nothing is sorted.
+static const char *LIST_WITH_ARCHIVE_SQL = 
+    "SELECT id, description, completed, created FROM tasks "
+    "UNION ALL "
+    "SELECT id, description, completed, created FROM archive.tasks "
+    "ORDER BY created, id LIMIT ?2;";
+
+static const char *LIST_WITH_ARCHIVE_AFTER_SQL = 
+    "WITH after AS (SELECT created, id FROM tasks WHERE id = ?1 "
+    "UNION ALL SELECT created, id FROM archive.tasks WHERE id = ?1 LIMIT 1) "
+    "SELECT id, description, completed, created FROM tasks "
+    "WHERE (created, id) > (SELECT created, id FROM after) "
+    "UNION ALL "
+    "SELECT id, description, completed, created FROM archive.tasks "
+    "WHERE (created, id) > (SELECT created, id FROM after) "
+    "ORDER BY created, id LIMIT ?2;";
+
+static const char *TASK_EXISTS_WITH_ARCHIVE_SQL = 
+    "SELECT EXISTS (SELECT 1 FROM tasks WHERE id = ?1) "
+    "OR EXISTS (SELECT 1 FROM archive.tasks WHERE id = ?1);";
+
+static const char *USER_VERSION_SQL = 
+    "PRAGMA user_version;";
+
+// Bulk loads insert into a temporary staging table and move each batch
+// into tasks with one statement, in ID order, rather than running an
+// INSERT per row against the table.
+static const char *CREATE_STAGING_SQL = 
+    "CREATE TEMP TABLE IF NOT EXISTS staged_tasks ("
+    "id INTEGER PRIMARY KEY,"
+    "description TEXT NOT NULL,"
+    "completed INTEGER NOT NULL,"
+    "created INTEGER NOT NULL"
+    ");";
+
+static const char *STAGE_TASK_SQL = 
+    "INSERT INTO temp.staged_tasks (id, description, completed, created) VALUES (?, ?, ?, ?);";
+
+static const char *FLUSH_STAGED_SQL = 
+    "INSERT INTO tasks (id, description, completed, created) "
+    "SELECT id, description, completed, created FROM temp.staged_tasks ORDER BY id;"
+    "DELETE FROM temp.staged_tasks;";
+
+// The same with the full-text insert trigger dropped for the batch, which
+// is then indexed by one statement. The trigger comes back before the
+// transaction commits, so no other connection ever sees it missing.
+static const char *FLUSH_STAGED_FTS_SQL = 
+    "DROP TRIGGER IF EXISTS tasks_fts_insert;"
+    "INSERT INTO tasks (id, description, completed, created) "
+    "SELECT id, description, completed, created FROM temp.staged_tasks ORDER BY id;"
+    "INSERT INTO tasks_fts (rowid, description) SELECT id, description FROM temp.staged_tasks ORDER BY id;"
+    "DELETE FROM temp.staged_tasks;";
+
+// Bulk commands first collect the IDs they apply to in a temporary table
+// and then change every selected task with one statement. task_matches()
+// is the matcher of "taskman search <term>", so a --match selects what
+// that search lists.
+static const char *CREATE_SELECTION_SQL = 
+    "CREATE TEMP TABLE IF NOT EXISTS selected_tasks (id INTEGER PRIMARY KEY);";
+
+static const char *SELECT_RANGE_SQL = 
+    "INSERT OR IGNORE INTO temp.selected_tasks "
+    "SELECT id FROM tasks WHERE id BETWEEN ?1 AND ?2 AND (?3 IS NULL OR task_matches(description, ?3));";
+
+static const char *CLEAR_SELECTION_SQL = 
+    "DELETE FROM temp.selected_tasks;";
+
+static const char *COUNT_SELECTION_SQL = 
+    "SELECT COUNT(*) FROM temp.selected_tasks;";
+
+static const char *SET_SELECTED_COMPLETED_SQL = 
+    "UPDATE tasks SET completed = ?1 "
+    "WHERE id IN (SELECT id FROM temp.selected_tasks) AND completed != ?1;";
+
+static const char *SET_SELECTED_DESCRIPTION_SQL = 
+    "UPDATE tasks SET description = ? WHERE id IN (SELECT id FROM temp.selected_tasks);";
+
+static const char *DELETE_SELECTED_SQL = 
+    "DELETE FROM tasks WHERE id IN (SELECT id FROM temp.selected_tasks);";
+
+// Prepared statement cache: each statement is prepared on first use and
+// then reused for the lifetime of the connection.
+typedef enum
+{
+    STMT_INSERT_TASK,
+    STMT_ADD_TASK,
+    STMT_UPDATE_TASK,
+    STMT_DELETE_TASK,
+    STMT_SELECT_TASK,
+    STMT_SET_COMPLETED,
+    STMT_SET_DESCRIPTION,
+    STMT_COUNT_BY_STATUS,
+    STMT_COUNT_FROM_COUNTERS,
+    STMT_TASK_STATS,
+    STMT_TASK_STATS_SCAN,
+    STMT_SELECT_ALL,
+    STMT_COUNT_TASKS,
+    STMT_MAX_ID,
+    STMT_SEARCH_TASKS,
+    STMT_FTS_SEARCH_TASKS,
+    STMT_STAGE_TASK,
+    STMT_LIST_ALL,
+    STMT_LIST_ALL_AFTER,
+    STMT_LIST_PENDING,
+    STMT_LIST_PENDING_AFTER,
+    STMT_TASK_EXISTS,
+    STMT_DATA_VERSION,
+    STMT_GENERATION,
+    STMT_CHANGED_IDS,
+    STMT_CHANGED_TASKS,
+    STMT_PRUNE_CHANGES,
+    STMT_SET_CHANGES_FROM,
+    STMT_SELECT_RANGE,
+    STMT_SET_SELECTED_COMPLETED,
+    STMT_SET_SELECTED_DESCRIPTION,
+    STMT_DELETE_SELECTED,
+    STMT_ADD_TASK_ABOVE_ARCHIVE,
+    STMT_NEXT_ID,
+    STMT_SELECT_ARCHIVABLE,
+    STMT_ARCHIVE_SELECTED,
+    STMT_RAISE_ARCHIVE_FLOOR,
+    STMT_LIST_WITH_ARCHIVE,
+    STMT_LIST_WITH_ARCHIVE_AFTER,
+    STMT_TASK_EXISTS_WITH_ARCHIVE,
+    STMT_CACHE_SIZE
+} StatementId;
+
+static sqlite3_stmt *stmt_cache[STMT_CACHE_SIZE];
+static DbStatementStats stmt_stats;
+
+static const char *statement_sql(StatementId id)
+{
+    switch (id) {
+        case STMT_INSERT_TASK: return INSERT_TASK_SQL;
+        case STMT_ADD_TASK: return ADD_TASK_SQL;
+        case STMT_UPDATE_TASK: return UPDATE_TASK_SQL;
+        case STMT_DELETE_TASK: return DELETE_TASK_SQL;
+        case STMT_SELECT_TASK: return SELECT_TASK_SQL;
+        case STMT_SET_COMPLETED: return SET_COMPLETED_SQL;
+        case STMT_SET_DESCRIPTION: return SET_DESCRIPTION_SQL;
+        case STMT_COUNT_BY_STATUS: return COUNT_BY_STATUS_SQL;
+        case STMT_SELECT_ALL: return SELECT_ALL_TASKS_SQL;
+        case STMT_COUNT_TASKS: return COUNT_TASKS_SQL;
+        case STMT_MAX_ID: return SELECT_MAX_ID_SQL;
+        case STMT_SEARCH_TASKS: return SEARCH_TASKS_SQL;
+        case STMT_FTS_SEARCH_TASKS: return FTS_SEARCH_TASKS_SQL;
+        case STMT_STAGE_TASK: return STAGE_TASK_SQL;
+        case STMT_LIST_ALL: return LIST_ALL_SQL;
+        case STMT_LIST_ALL_AFTER: return LIST_ALL_AFTER_SQL;
+        case STMT_LIST_PENDING: return LIST_PENDING_SQL;
+        case STMT_LIST_PENDING_AFTER: return LIST_PENDING_AFTER_SQL;
+        case STMT_TASK_EXISTS: return TASK_EXISTS_SQL;
+        case STMT_DATA_VERSION: return DATA_VERSION_SQL;
+        case STMT_GENERATION: return GENERATION_SQL;
+        case STMT_CHANGED_IDS: return CHANGED_IDS_SQL;
+        case STMT_CHANGED_TASKS: return CHANGED_TASKS_SQL;
+        case STMT_PRUNE_CHANGES: return PRUNE_CHANGES_SQL;
+        case STMT_SET_CHANGES_FROM: return SET_CHANGES_FROM_SQL;
+        case STMT_SELECT_RANGE: return SELECT_RANGE_SQL;
+        case STMT_SET_SELECTED_COMPLETED: return SET_SELECTED_COMPLETED_SQL;
+        case STMT_SET_SELECTED_DESCRIPTION: return SET_SELECTED_DESCRIPTION_SQL;
+        case STMT_DELETE_SELECTED: return DELETE_SELECTED_SQL;
+        case STMT_ADD_TASK_ABOVE_ARCHIVE: return ADD_TASK_ABOVE_ARCHIVE_SQL;
+        case STMT_NEXT_ID: return NEXT_ID_SQL;
+        case STMT_SELECT_ARCHIVABLE: return SELECT_ARCHIVABLE_SQL;
+        case STMT_ARCHIVE_SELECTED: return ARCHIVE_SELECTED_SQL;
+        case STMT_RAISE_ARCHIVE_FLOOR: return RAISE_ARCHIVE_FLOOR_SQL;
+        case STMT_LIST_WITH_ARCHIVE: return LIST_WITH_ARCHIVE_SQL;
+        case STMT_LIST_WITH_ARCHIVE_AFTER: return LIST_WITH_ARCHIVE_AFTER_SQL;
+        case STMT_TASK_EXISTS_WITH_ARCHIVE: return TASK_EXISTS_WITH_ARCHIVE_SQL;
+        case STMT_COUNT_FROM_COUNTERS: return COUNT_FROM_COUNTERS_SQL;
+        case STMT_TASK_STATS: return TASK_STATS_SQL;
+        case STMT_TASK_STATS_SCAN: return TASK_STATS_SCAN_SQL;
+        default: return NULL;
+    }
+}
+
+// Fetch a ready-to-bind statement, preparing it only the first time
+static sqlite3_stmt *db_statement(StatementId id)
+{
+    if (stmt_cache[id]) {
+        stmt_stats.reused++;
+        return stmt_cache[id];
+    }
+
+    TraceSpan span = trace_begin("db.prepare");
+    sqlite3_stmt *stmt = NULL;
+    int rc = sqlite3_prepare_v3(db, statement_sql(id), -1, SQLITE_PREPARE_PERSISTENT, &stmt, NULL);
+    trace_end(span);
+    if (rc != SQLITE_OK) {
+        return NULL;
+    }
+
+    stmt_cache[id] = stmt;
+    stmt_stats.prepared++;
+    return stmt;
+}
+
+// Return a statement to the cache. Resetting also ends its read
+// transaction, so cached statements never hold locks between calls.
+static void db_statement_done(sqlite3_stmt *stmt)
+{
+    sqlite3_reset(stmt);
+    sqlite3_clear_bindings(stmt);
+}
+
+// Hand a statement's lifetime counters to the profiler before it is finalized
+static void trace_stmt(sqlite3_stmt *stmt)
+{
+    if (trace_on && stmt) {
+        trace_statement(sqlite3_sql(stmt), sqlite3_stmt_status(stmt, SQLITE_STMTSTATUS_RUN, 0),
+                        sqlite3_stmt_status(stmt, SQLITE_STMTSTATUS_VM_STEP, 0),
+                        sqlite3_stmt_status(stmt, SQLITE_STMTSTATUS_FULLSCAN_STEP, 0),
+                        sqlite3_stmt_status(stmt, SQLITE_STMTSTATUS_SORT, 0),
+                        sqlite3_stmt_status(stmt, SQLITE_STMTSTATUS_AUTOINDEX, 0));
+    }
+}
+
+// Same for a connection's page cache, before it is closed
+static void trace_conn(sqlite3 *conn)
+{
+    if (trace_on && conn) {
+        int hits = 0, misses = 0, writes = 0, high;
+        sqlite3_db_status(conn, SQLITE_DBSTATUS_CACHE_HIT, &hits, &high, 0);
+        sqlite3_db_status(conn, SQLITE_DBSTATUS_CACHE_MISS, &misses, &high, 0);
+        sqlite3_db_status(conn, SQLITE_DBSTATUS_CACHE_WRITE, &writes, &high, 0);
+        trace_cache(hits, misses, writes);
+    }
+}
+
+static void statement_cache_clear(void)
+{
+    for (int i = 0; i < STMT_CACHE_SIZE; i++) {
+        if (stmt_cache[i]) {
+            trace_stmt(stmt_cache[i]);
+            sqlite3_finalize(stmt_cache[i]);
+            stmt_cache[i] = NULL;
+        }
+    }
+}
 
 // Initialize database path
 static void init_db_path(void)
@@ -60,231 +635,1667 @@ static void init_db_path(void)
     }
     
     snprintf(db_path, sizeof(db_path), "%s/.taskman/tasks.db", home_dir);
+    snprintf(archive_path, sizeof(archive_path), "%s/.taskman/archive.db", home_dir);
 }
 
-int db_init(void)
+void task_clear(Task *task)
 {
-    init_db_path();
-    
-    int rc = sqlite3_open(db_path, &db);
-    if (rc != SQLITE_OK) {
-        fprintf(stderr, "Error: Cannot open database: %s\n", sqlite3_errmsg(db));
-        return -1;
-    }
-
-    // Create table if it doesn't exist
-    char *err_msg = NULL;
-    rc = sqlite3_exec(db, CREATE_TABLE_SQL, NULL, NULL, &err_msg);
-    if (rc != SQLITE_OK) {
-        fprintf(stderr, "Error: Cannot create table: %s\n", err_msg);
-        sqlite3_free(err_msg);
-        sqlite3_close(db);
-        db = NULL;
-        return -1;
+    if (task) {
+        free(task->description);
+        task->description = NULL;
     }
-
-    return 0;
 }
 
-void db_close(void)
+void task_stats_clear(TaskStats *stats)
 {
-    if (db) {
-        sqlite3_close(db);
-        db = NULL;
-    }
+    task_clear(&stats->oldest_pending);
+    task_clear(&stats->newest);
 }
 
-int db_load_tasks(TaskManager *tm)
+// Copy a description into a new malloc'd string
+static char *copy_description(const char *text, size_t len)
 {
-    if (!db || !tm) {
-        return -1;
+    char *copy = malloc(len + 1);
+    if (copy) {
+        memcpy(copy, text, len);
+        copy[len] = '\0';
     }
+    return copy;
+}
 
-    tm->count = 0;
-    
-    sqlite3_stmt *stmt;
-    int rc = sqlite3_prepare_v2(db, SELECT_ALL_TASKS_SQL, -1, &stmt, NULL);
-    if (rc != SQLITE_OK) {
-        fprintf(stderr, "Error: Cannot prepare select statement: %s\n", sqlite3_errmsg(db));
+int tm_reserve(TaskManager *tm, int capacity)
+{
+    if (!tm || capacity < 0) {
         return -1;
     }
-
-    while ((rc = sqlite3_step(stmt)) == SQLITE_ROW && tm->count < MAX_TASKS) {
-        Task *task = &tm->tasks[tm->count];
-        
-        task->id = sqlite3_column_int(stmt, 0);
-        const char *desc = (const char *)sqlite3_column_text(stmt, 1);
-        strncpy(task->description, desc, MAX_TASK_LENGTH - 1);
-        task->description[MAX_TASK_LENGTH - 1] = '\0';
-        task->completed = (Status)sqlite3_column_int(stmt, 2);
-        task->created = (time_t)sqlite3_column_int64(stmt, 3);
-        
-        tm->count++;
+    if (capacity <= tm->capacity) {
+        return 0;
     }
 
-    sqlite3_finalize(stmt);
-    
-    if (rc != SQLITE_DONE && rc != SQLITE_ROW) {
-        fprintf(stderr, "Error: Cannot load tasks: %s\n", sqlite3_errmsg(db));
+    size_t old_n = (size_t)tm->capacity, new_n = (size_t)capacity;
+    int *ids = arena_grow(&tm->arena, tm->ids, old_n * sizeof(int), new_n * sizeof(int));
+    unsigned char *status = ids ? arena_grow(&tm->arena, tm->status, old_n, new_n) : NULL;
+    time_t *created = status ? arena_grow(&tm->arena, tm->created, old_n * sizeof(time_t),
+                                          new_n * sizeof(time_t))
+                             : NULL;
+    const char **descriptions = created ? arena_grow(&tm->arena, tm->descriptions, old_n * sizeof(char *),
+                                                     new_n * sizeof(char *))
+                                        : NULL;
+    int *lengths = descriptions ? arena_grow(&tm->arena, tm->lengths, old_n * sizeof(int), new_n * sizeof(int))
+                                : NULL;
+    if (!lengths) {
+        fprintf(stderr, "Error: Out of memory reserving %d tasks\n", capacity);
         return -1;
     }
 
+    tm->ids = ids;
+    tm->status = status;
+    tm->created = created;
+    tm->descriptions = descriptions;
+    tm->lengths = lengths;
+    tm->capacity = capacity;
     return 0;
 }
 
-int db_save_task(const Task *task)
+// Add a task at the end of the store. The description (len bytes, any
+// length) is copied into the string arena. Returns the task's index, or
+// -1 when out of memory.
+int tm_append(TaskManager *tm, int id, const char *description, size_t len, Status completed, time_t created)
 {
-    if (!db || !task) {
+    if (!tm) {
         return -1;
     }
 
-    sqlite3_stmt *stmt;
-    int rc = sqlite3_prepare_v2(db, INSERT_TASK_SQL, -1, &stmt, NULL);
-    if (rc != SQLITE_OK) {
-        fprintf(stderr, "Error: Cannot prepare insert statement: %s\n", sqlite3_errmsg(db));
-        return -1;
+    if (tm->count == tm->capacity) {
+        int capacity = tm->capacity ? tm->capacity * 2 : TASKS_INITIAL_CAPACITY;
+        if (tm_reserve(tm, capacity) != 0) {
+            return -1;
+        }
     }
 
-    sqlite3_bind_int(stmt, 1, task->id);
-    sqlite3_bind_text(stmt, 2, task->description, -1, SQLITE_STATIC);
-    sqlite3_bind_int(stmt, 3, (int)task->completed);
-    sqlite3_bind_int64(stmt, 4, (sqlite3_int64)task->created);
-
-    rc = sqlite3_step(stmt);
-    sqlite3_finalize(stmt);
-
-    if (rc != SQLITE_DONE) {
-        fprintf(stderr, "Error: Cannot save task: %s\n", sqlite3_errmsg(db));
+    int index = tm->count;
+    tm->ids[index] = id;
+    tm->status[index] = (unsigned char)completed;
+    tm->created[index] = created;
+    if (tm_set_description(tm, index, description, len) != 0) {
         return -1;
     }
-
-    return 0;
+    tm->count++;
+    return index;
 }
 
-int db_update_task(const Task *task)
+// Point task index at a copy of description. The old text stays in the
+// arena until tm_free().
+int tm_set_description(TaskManager *tm, int index, const char *description, size_t len)
 {
-    if (!db || !task) {
+    if (len > INT_MAX - 1) {
         return -1;
     }
-
-    sqlite3_stmt *stmt;
-    int rc = sqlite3_prepare_v2(db, UPDATE_TASK_SQL, -1, &stmt, NULL);
-    if (rc != SQLITE_OK) {
-        fprintf(stderr, "Error: Cannot prepare update statement: %s\n", sqlite3_errmsg(db));
+    char *text = arena_alloc_bytes(&tm->text, len + 1);
+    if (!text) {
+        fprintf(stderr, "Error: Out of memory storing a task description\n");
         return -1;
     }
+    memcpy(text, description, len);
+    text[len] = '\0';
+    tm->descriptions[index] = text;
+    tm->lengths[index] = (int)len;
+    return 0;
+}
 
-    sqlite3_bind_text(stmt, 1, task->description, -1, SQLITE_STATIC);
-    sqlite3_bind_int(stmt, 2, (int)task->completed);
-    sqlite3_bind_int(stmt, 3, task->id);
+// Copy every field of task from over task to
+void tm_move(TaskManager *tm, int to, int from)
+{
+    tm->ids[to] = tm->ids[from];
+    tm->status[to] = tm->status[from];
+    tm->created[to] = tm->created[from];
+    tm->descriptions[to] = tm->descriptions[from];
+    tm->lengths[to] = tm->lengths[from];
+}
 
-    rc = sqlite3_step(stmt);
-    sqlite3_finalize(stmt);
+// Removes a task by moving the last one into its slot; callers that need
+// creation order sort before displaying.
+void tm_remove(TaskManager *tm, int index)
+{
+    if (!tm || index < 0 || index >= tm->count) {
+        return;
+    }
 
-    if (rc != SQLITE_DONE) {
-        fprintf(stderr, "Error: Cannot update task: %s\n", sqlite3_errmsg(db));
-        return -1;
+    tm->count--;
+    if (index != tm->count) {
+        tm_move(tm, index, tm->count);
     }
+}
 
-    return 0;
+// Empty the store, keeping the columns but releasing the descriptions
+void tm_clear(TaskManager *tm)
+{
+    arena_free(&tm->text);
+    tm->count = 0;
 }
 
-int db_delete_task(int id)
+void tm_free(TaskManager *tm)
 {
-    if (!db) {
-        return -1;
+    if (!tm) {
+        return;
     }
 
-    sqlite3_stmt *stmt;
-    int rc = sqlite3_prepare_v2(db, DELETE_TASK_SQL, -1, &stmt, NULL);
-    if (rc != SQLITE_OK) {
-        fprintf(stderr, "Error: Cannot prepare delete statement: %s\n", sqlite3_errmsg(db));
-        return -1;
+    arena_free(&tm->arena);
+    arena_free(&tm->text);
+    tm->ids = NULL;
+    tm->status = NULL;
+    tm->created = NULL;
+    tm->descriptions = NULL;
+    tm->lengths = NULL;
+    tm->count = 0;
+    tm->capacity = 0;
+}
+
+// Fill one task from the current row of a (id, description, completed,
+// created) query. The description is malloc'd; returns -1 when out of memory.
+static int read_task_row(sqlite3_stmt *stmt, Task *task)
+{
+    task->id = sqlite3_column_int(stmt, 0);
+    const char *desc = (const char *)sqlite3_column_text(stmt, 1);
+    task->description = copy_description(desc ? desc : "", (size_t)sqlite3_column_bytes(stmt, 1));
+    task->completed = (Status)sqlite3_column_int(stmt, 2);
+    task->created = (time_t)sqlite3_column_int64(stmt, 3);
+    return task->description ? 0 : -1;
+}
+
+// Collect all rows of a prepared statement into the task store
+static int read_task_rows(sqlite3_stmt *stmt, TaskManager *tm)
+{
+    int rc;
+    while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+        const char *desc = (const char *)sqlite3_column_text(stmt, 1);
+        if (tm_append(tm, sqlite3_column_int(stmt, 0), desc ? desc : "", (size_t)sqlite3_column_bytes(stmt, 1),
+                      (Status)sqlite3_column_int(stmt, 2), (time_t)sqlite3_column_int64(stmt, 3)) < 0) {
+            return SQLITE_NOMEM;
+        }
     }
+    return rc;
+}
 
-    sqlite3_bind_int(stmt, 1, id);
+// Run one statement that returns a single integer
+static int query_int(const char *sql, int fallback)
+{
+    sqlite3_stmt *stmt;
+    int value = fallback;
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) == SQLITE_OK) {
+        if (sqlite3_step(stmt) == SQLITE_ROW) {
+            value = sqlite3_column_int(stmt, 0);
+        }
+        trace_stmt(stmt);
+        sqlite3_finalize(stmt);
+    }
+    return value;
+}
 
-    rc = sqlite3_step(stmt);
-    sqlite3_finalize(stmt);
+// A catalog lookup; no statement is run
+static int table_exists(const char *table)
+{
+    return sqlite3_table_column_metadata(db, NULL, table, NULL, NULL, NULL, NULL, NULL, NULL) == SQLITE_OK;
+}
 
-    if (rc != SQLITE_DONE) {
-        fprintf(stderr, "Error: Cannot delete task: %s\n", sqlite3_errmsg(db));
-        return -1;
+// Whether the trigram index of migration 8 exists. Looked up on first use,
+// so commands that never search or bulk load do not pay for it.
+static int fts_available(void)
+{
+    if (fts_enabled < 0) {
+        fts_enabled = table_exists("tasks_fts");
     }
+    return fts_enabled;
+}
+
+static int create_tasks_table(void)
+{
+    return sqlite3_exec(db, CREATE_TABLE_SQL, NULL, NULL, NULL) == SQLITE_OK ? 0 : -1;
+}
 
+static int create_counters(void)
+{
+    return sqlite3_exec(db, CREATE_COUNTERS_SQL, NULL, NULL, NULL) == SQLITE_OK ? 0 : -1;
+}
+
+static int retired_migration(void)
+{
     return 0;
 }
 
-int db_get_next_id(void)
+static int create_change_log(void)
 {
-    if (!db) {
-        return 1;
-    }
+    return sqlite3_exec(db, CREATE_CHANGE_LOG_SQL, NULL, NULL, NULL) == SQLITE_OK ? 0 : -1;
+}
 
-    sqlite3_stmt *stmt;
-    int rc = sqlite3_prepare_v2(db, SELECT_MAX_ID_SQL, -1, &stmt, NULL);
-    if (rc != SQLITE_OK) {
-        fprintf(stderr, "Error: Cannot prepare max id statement: %s\n", sqlite3_errmsg(db));
-        return 1;
-    }
+static int create_archive_floor(void)
+{
+    return sqlite3_exec(db, CREATE_ARCHIVE_FLOOR_SQL, NULL, NULL, NULL) == SQLITE_OK ? 0 : -1;
+}
 
-    int max_id = 0;
-    if (sqlite3_step(stmt) == SQLITE_ROW) {
-        if (sqlite3_column_type(stmt, 0) != SQLITE_NULL) {
-            max_id = sqlite3_column_int(stmt, 0);
-        }
-    }
+static int create_pending_id_index(void)
+{
+    return sqlite3_exec(db, CREATE_PENDING_ID_INDEX_SQL, NULL, NULL, NULL) == SQLITE_OK ? 0 : -1;
+}
 
-    sqlite3_finalize(stmt);
-    return max_id + 1;
+static int drop_fts(void)
+{
+    return sqlite3_exec(db, DROP_FTS_SQL, NULL, NULL, NULL) == SQLITE_OK ? 0 : -1;
 }
 
-int db_search_tasks(TaskManager *tm, const char *search_term)
+static int create_fts(void)
 {
-    if (!db || !tm || !search_term) {
-        return -1;
+    if (sqlite3_exec(db, CREATE_FTS_TABLE_SQL, NULL, NULL, NULL) != SQLITE_OK) {
+        return 0; // no FTS5 or no trigram tokenizer: search scans
     }
-
-    tm->count = 0;
-    
-    // Prepare search pattern with wildcards
-    char pattern[MAX_TASK_LENGTH + 2];
-    snprintf(pattern, sizeof(pattern), "%%%s%%", search_term);
-    
-    sqlite3_stmt *stmt;
-    int rc = sqlite3_prepare_v2(db, SEARCH_TASKS_SQL, -1, &stmt, NULL);
-    if (rc != SQLITE_OK) {
-        fprintf(stderr, "Error: Cannot prepare search statement: %s\n", sqlite3_errmsg(db));
+    if (sqlite3_exec(db, CREATE_FTS_SQL, NULL, NULL, NULL) != SQLITE_OK ||
+        sqlite3_exec(db, CREATE_FTS_INSERT_TRIGGER_SQL, NULL, NULL, NULL) != SQLITE_OK) {
         return -1;
     }
+    return 0;
+}
 
-    sqlite3_bind_text(stmt, 1, pattern, -1, SQLITE_STATIC);
+static int (*const migrations[])(void) = {
+    create_tasks_table,
+    create_counters,
+    retired_migration, // 3: the full-text index
+    create_change_log,
+    create_archive_floor,
+    create_pending_id_index,
+    drop_fts,
+    create_fts,
+};
 
-    while ((rc = sqlite3_step(stmt)) == SQLITE_ROW && tm->count < MAX_TASKS) {
-        Task *task = &tm->tasks[tm->count];
-        
-        task->id = sqlite3_column_int(stmt, 0);
-        const char *desc = (const char *)sqlite3_column_text(stmt, 1);
-        strncpy(task->description, desc, MAX_TASK_LENGTH - 1);
-        task->description[MAX_TASK_LENGTH - 1] = '\0';
-        task->completed = (Status)sqlite3_column_int(stmt, 2);
-        task->created = (time_t)sqlite3_column_int64(stmt, 3);
-        
-        tm->count++;
+#define SCHEMA_VERSION ((int)(sizeof(migrations) / sizeof(migrations[0])))
+#define SCHEMA_COUNTERS 2   // first version with task_counters
+#define SCHEMA_CHANGE_LOG 4 // first version with generations and task_changes
+#define SCHEMA_ARCHIVE 5    // first version with task_counters.archived_max_id
+
+// Bring the schema up to SCHEMA_VERSION. A current database costs one
+// PRAGMA read. Otherwise the file settings are applied (which can fail
+// harmlessly, e.g. on a read-only file) and the missing migrations run in
+// a single write transaction together with the version bump, so a crash
+// or a concurrent taskman can never leave a half-migrated file behind.
+static int migrate(void)
+{
+    schema_version = query_int(USER_VERSION_SQL, 0);
+    if (schema_version >= SCHEMA_VERSION) {
+        return 0;
     }
 
-    sqlite3_finalize(stmt);
-    
-    if (rc != SQLITE_DONE && rc != SQLITE_ROW) {
-        fprintf(stderr, "Error: Cannot search tasks: %s\n", sqlite3_errmsg(db));
+    // Outside the transaction: journal_mode cannot change inside one
+    sqlite3_exec(db, FILE_SETTINGS_SQL, NULL, NULL, NULL);
+
+    if (sqlite3_exec(db, "BEGIN IMMEDIATE;", NULL, NULL, NULL) != SQLITE_OK) {
         return -1;
     }
+    // Someone else may have migrated while we waited for the lock
+    int version = query_int(USER_VERSION_SQL, 0);
+    while (version < SCHEMA_VERSION && migrations[version]() == 0) {
+        version++;
+    }
 
+    char sql[64];
+    snprintf(sql, sizeof(sql), "PRAGMA user_version = %d;", version);
+    if (version < SCHEMA_VERSION || sqlite3_exec(db, sql, NULL, NULL, NULL) != SQLITE_OK ||
+        sqlite3_exec(db, "COMMIT;", NULL, NULL, NULL) != SQLITE_OK) {
+        sqlite3_exec(db, "ROLLBACK;", NULL, NULL, NULL);
+        return -1;
+    }
+    schema_version = version;
     return 0;
 }
 
+// Exponential backoff with jitter, so writers that collided do not retry
+// in lockstep. count restarts at 0 for every new wait.
+static int busy_handler(void *arg, int count)
+{
+    static int waited_ms;
+    static unsigned seed;
+    (void)arg;
+
+    if (count == 0) {
+        waited_ms = 0;
+        seed ^= (unsigned)getpid();
+    }
+    if (waited_ms >= DB_BUSY_TIMEOUT_MS) {
+        return 0; // give up: the statement fails with SQLITE_BUSY
+    }
+
+    int delay = count < 5 ? 1 << count : DB_BUSY_MAX_DELAY_MS;
+    seed = seed * 1103515245 + 12345;
+    delay = delay / 2 + (int)((seed >> 16) % (unsigned)(delay / 2 + 1));
+    if (delay < 1) {
+        delay = 1;
+    }
+    struct timespec ts = {0, delay * 1000000L};
+    nanosleep(&ts, NULL);
+    waited_ms += delay;
+    busy_retries++;
+    return 1;
+}
+
+// SQL function task_matches(description, term): 1 when the description
+// contains every word of term. The split term is kept as auxiliary data,
+// so it is prepared once per statement rather than once per row.
+static void task_matches(sqlite3_context *ctx, int argc, sqlite3_value **argv)
+{
+    (void)argc;
+    const char *text = (const char *)sqlite3_value_text(argv[0]);
+    const char *term = (const char *)sqlite3_value_text(argv[1]);
+    if (!text || !term) {
+        sqlite3_result_null(ctx);
+        return;
+    }
+
+    MatchQuery *query = sqlite3_get_auxdata(ctx, 1);
+    int fresh = !query;
+    if (fresh) {
+        query = malloc(sizeof(*query));
+        if (!query) {
+            sqlite3_result_error_nomem(ctx);
+            return;
+        }
+        match_query_init(query, term);
+    }
+    sqlite3_result_int(ctx, match_query_test(query, text, (size_t)sqlite3_value_bytes(argv[0])));
+    if (fresh) {
+        sqlite3_set_auxdata(ctx, 1, query, free); // may free it right away
+    }
+}
+
+int db_init(void)
+{
+    TraceSpan span = trace_begin("db.path");
+    init_db_path();
+    trace_end(span);
+
+    span = trace_begin("db.open");
+    int rc = sqlite3_open(db_path, &db);
+    trace_end(span);
+    if (rc != SQLITE_OK) {
+        fprintf(stderr, "Error: Cannot open database: %s\n", sqlite3_errmsg(db));
+        return -1;
+    }
+    sqlite3_busy_handler(db, busy_handler, NULL);
+    sqlite3_create_function(db, "task_matches", 2, SQLITE_UTF8 | SQLITE_DETERMINISTIC, NULL, task_matches,
+                            NULL, NULL);
+
+    sqlite3_exec(db, SYNCHRONOUS_SQL, NULL, NULL, NULL);
+
+    // An old file that cannot be upgraded (e.g. read-only) is still
+    // usable at the version it has, minus the counters or the change log
+    span = trace_begin("db.migrate");
+    rc = migrate();
+    trace_end(span);
+    if (rc != 0 && !table_exists("tasks")) {
+        fprintf(stderr, "Error: Cannot create table: %s\n", sqlite3_errmsg(db));
+        sqlite3_close(db);
+        db = NULL;
+        return -1;
+    }
+    statement_cache_clear();
+    stmt_stats.prepared = 0;
+    stmt_stats.reused = 0;
+    fts_enabled = -1;
+
+    return 0;
+}
+
+void db_close(void)
+{
+    if (db) {
+        statement_cache_clear();
+        archive_attached = 0;
+        trace_conn(db);
+        sqlite3_close(db);
+        db = NULL;
+    }
+}
+
+static int db_exec(const char *sql, const char *what)
+{
+    if (!db) {
+        return -1;
+    }
+
+    char *err_msg = NULL;
+    if (sqlite3_exec(db, sql, NULL, NULL, &err_msg) != SQLITE_OK) {
+        fprintf(stderr, "Error: Cannot %s: %s\n", what, err_msg ? err_msg : sqlite3_errmsg(db));
+        sqlite3_free(err_msg);
+        return -1;
+    }
+    return 0;
+}
+
+int db_begin(void)
+{
+    // Includes any wait for another writer's lock
+    TraceSpan span = trace_begin("db.begin");
+    int rc = db_exec("BEGIN IMMEDIATE;", "begin transaction");
+    trace_end(span);
+    return rc;
+}
+
+int db_commit(void)
+{
+    TraceSpan span = trace_begin("db.commit");
+    int rc = db_exec("COMMIT;", "commit transaction");
+    trace_end(span);
+    return rc;
+}
+
+int db_rollback(void)
+{
+    if (!db || sqlite3_get_autocommit(db)) {
+        return 0; // no transaction is open
+    }
+    return db_exec("ROLLBACK;", "roll back transaction");
+}
+
+int db_stage_task(const Task *task)
+{
+    if (!db || !task) {
+        return -1;
+    }
+
+    sqlite3_stmt *stmt = db_statement(STMT_STAGE_TASK);
+    if (!stmt) {
+        if (db_exec(CREATE_STAGING_SQL, "create staging table") != 0 ||
+            !(stmt = db_statement(STMT_STAGE_TASK))) {
+            fprintf(stderr, "Error: Cannot prepare staging statement: %s\n", sqlite3_errmsg(db));
+            return -1;
+        }
+    }
+
+    sqlite3_bind_int(stmt, 1, task->id);
+    sqlite3_bind_text(stmt, 2, task->description, -1, SQLITE_STATIC);
+    sqlite3_bind_int(stmt, 3, (int)task->completed);
+    sqlite3_bind_int64(stmt, 4, (sqlite3_int64)task->created);
+
+    int rc = sqlite3_step(stmt);
+    db_statement_done(stmt);
+
+    if (rc != SQLITE_DONE) {
+        fprintf(stderr, "Error: Cannot stage task: %s\n", sqlite3_errmsg(db));
+        return -1;
+    }
+
+    return 0;
+}
+
+int db_flush_staged_tasks(void)
+{
+    if (!fts_available()) {
+        return db_exec(FLUSH_STAGED_SQL, "save staged tasks");
+    }
+    if (db_exec(FLUSH_STAGED_FTS_SQL, "save staged tasks") != 0) {
+        return -1;
+    }
+    return db_exec(CREATE_FTS_INSERT_TRIGGER_SQL, "restore the full-text trigger");
+}
+
+// Size the store from a COUNT(*) statement, then fill it from a
+// SELECT of all tasks. Returns the SQLite result of the final step.
+static int load_task_rows(sqlite3_stmt *count, sqlite3_stmt *select, TaskManager *tm)
+{
+    tm_clear(tm);
+
+    // Size the store up front so a full load never has to grow it
+    int total = 0;
+    int rc = sqlite3_step(count);
+    if (rc == SQLITE_ROW) {
+        total = sqlite3_column_int(count, 0);
+    } else if (rc != SQLITE_DONE) {
+        return rc;
+    }
+
+    if (tm_reserve(tm, total) != 0) {
+        return SQLITE_NOMEM;
+    }
+
+    return read_task_rows(select, tm);
+}
+
+int db_load_tasks(TaskManager *tm)
+{
+    if (!db || !tm) {
+        return -1;
+    }
+
+    sqlite3_stmt *count = db_statement(STMT_COUNT_TASKS);
+    sqlite3_stmt *select = db_statement(STMT_SELECT_ALL);
+    if (!count || !select) {
+        fprintf(stderr, "Error: Cannot prepare load statements: %s\n", sqlite3_errmsg(db));
+        return -1;
+    }
+
+    TraceSpan span = trace_begin("db.load_tasks");
+    int rc = load_task_rows(count, select, tm);
+    trace_end(span);
+    db_statement_done(count);
+    db_statement_done(select);
+    
+    if (rc != SQLITE_DONE) {
+        fprintf(stderr, "Error: Cannot load tasks: %s\n", sqlite3_errmsg(db));
+        return -1;
+    }
+
+    return 0;
+}
+
+int db_save_task(const Task *task)
+{
+    if (!db || !task) {
+        return -1;
+    }
+
+    sqlite3_stmt *stmt = db_statement(STMT_INSERT_TASK);
+    if (!stmt) {
+        fprintf(stderr, "Error: Cannot prepare insert statement: %s\n", sqlite3_errmsg(db));
+        return -1;
+    }
+
+    sqlite3_bind_int(stmt, 1, task->id);
+    sqlite3_bind_text(stmt, 2, task->description, -1, SQLITE_STATIC);
+    sqlite3_bind_int(stmt, 3, (int)task->completed);
+    sqlite3_bind_int64(stmt, 4, (sqlite3_int64)task->created);
+
+    int rc = sqlite3_step(stmt);
+    db_statement_done(stmt);
+
+    if (rc != SQLITE_DONE) {
+        fprintf(stderr, "Error: Cannot save task: %s\n", sqlite3_errmsg(db));
+        return -1;
+    }
+
+    return 0;
+}
+
+// Insert a new task and store the ID SQLite gave it in task->id
+int db_add_task(Task *task)
+{
+    if (!db || !task) {
+        return -1;
+    }
+
+    sqlite3_stmt *stmt = db_statement(schema_version >= SCHEMA_ARCHIVE ? STMT_ADD_TASK_ABOVE_ARCHIVE : STMT_ADD_TASK);
+    if (!stmt) {
+        fprintf(stderr, "Error: Cannot prepare insert statement: %s\n", sqlite3_errmsg(db));
+        return -1;
+    }
+
+    sqlite3_bind_text(stmt, 1, task->description, -1, SQLITE_STATIC);
+    sqlite3_bind_int(stmt, 2, (int)task->completed);
+    sqlite3_bind_int64(stmt, 3, (sqlite3_int64)task->created);
+
+    int rc = sqlite3_step(stmt);
+    if (rc == SQLITE_DONE) {
+        task->id = (int)sqlite3_last_insert_rowid(db);
+    }
+    db_statement_done(stmt);
+
+    if (rc != SQLITE_DONE) {
+        fprintf(stderr, "Error: Cannot save task: %s\n", sqlite3_errmsg(db));
+        return -1;
+    }
+
+    return 0;
+}
+
+int db_update_task(const Task *task)
+{
+    if (!db || !task) {
+        return -1;
+    }
+
+    sqlite3_stmt *stmt = db_statement(STMT_UPDATE_TASK);
+    if (!stmt) {
+        fprintf(stderr, "Error: Cannot prepare update statement: %s\n", sqlite3_errmsg(db));
+        return -1;
+    }
+
+    sqlite3_bind_text(stmt, 1, task->description, -1, SQLITE_STATIC);
+    sqlite3_bind_int(stmt, 2, (int)task->completed);
+    sqlite3_bind_int(stmt, 3, task->id);
+
+    int rc = sqlite3_step(stmt);
+    db_statement_done(stmt);
+
+    if (rc != SQLITE_DONE) {
+        fprintf(stderr, "Error: Cannot update task: %s\n", sqlite3_errmsg(db));
+        return -1;
+    }
+
+    return 0;
+}
+
+int db_delete_task(int id)
+{
+    if (!db) {
+        return -1;
+    }
+
+    sqlite3_stmt *stmt = db_statement(STMT_DELETE_TASK);
+    if (!stmt) {
+        fprintf(stderr, "Error: Cannot prepare delete statement: %s\n", sqlite3_errmsg(db));
+        return -1;
+    }
+
+    sqlite3_bind_int(stmt, 1, id);
+
+    int rc = sqlite3_step(stmt);
+    db_statement_done(stmt);
+
+    if (rc != SQLITE_DONE) {
+        fprintf(stderr, "Error: Cannot delete task: %s\n", sqlite3_errmsg(db));
+        return -1;
+    }
+
+    return sqlite3_changes(db);
+}
+
+// The statement that fills temp.selected_tasks. The table is created on
+// first use, before anything that refers to it is prepared.
+static sqlite3_stmt *selection_statement(void)
+{
+    sqlite3_stmt *stmt = db_statement(STMT_SELECT_RANGE);
+    if (!stmt) {
+        if (db_exec(CREATE_SELECTION_SQL, "create selection table") != 0 ||
+            !(stmt = db_statement(STMT_SELECT_RANGE))) {
+            fprintf(stderr, "Error: Cannot prepare selection statement: %s\n", sqlite3_errmsg(db));
+            return NULL;
+        }
+    }
+    return stmt;
+}
+
+// Fill temp.selected_tasks with the existing tasks selector picks.
+// Returns how many there are, or -1 on error.
+static int select_tasks(const TaskSelector *selector)
+{
+    sqlite3_stmt *stmt = selection_statement();
+    if (!stmt) {
+        return -1;
+    }
+    if (db_exec(CLEAR_SELECTION_SQL, "clear selection") != 0) {
+        return -1;
+    }
+
+    // No IDs means every task, narrowed down by the match
+    IdRange all = {INT_MIN, INT_MAX};
+    const IdRange *ranges = selector->range_count > 0 ? selector->ranges : &all;
+    int count = selector->range_count > 0 ? selector->range_count : 1;
+    int selected = 0;
+    for (int i = 0; i < count; i++) {
+        sqlite3_bind_int(stmt, 1, ranges[i].first);
+        sqlite3_bind_int(stmt, 2, ranges[i].last);
+        if (selector->match) {
+            sqlite3_bind_text(stmt, 3, selector->match, -1, SQLITE_STATIC);
+        }
+        int rc = sqlite3_step(stmt);
+        db_statement_done(stmt);
+        if (rc != SQLITE_DONE) {
+            fprintf(stderr, "Error: Cannot select tasks: %s\n", sqlite3_errmsg(db));
+            return -1;
+        }
+        selected += sqlite3_changes(db);
+    }
+    return selected;
+}
+
+int db_count_selected(const TaskSelector *selector)
+{
+    if (!db || !selector) {
+        return -1;
+    }
+    return select_tasks(selector);
+}
+
+// Select the tasks and run the bound statement over them, all in one
+// transaction. Returns the rows it changed and sets *selected. A NULL
+// selector keeps the selection db_count_selected() made.
+static int change_selected(const TaskSelector *selector, sqlite3_stmt *stmt, int *selected)
+{
+    int changed = -1;
+    if (db_begin() != 0) {
+        db_statement_done(stmt);
+        return -1;
+    }
+    *selected = selector ? select_tasks(selector) : query_int(COUNT_SELECTION_SQL, -1);
+    if (*selected >= 0) {
+        int rc = sqlite3_step(stmt);
+        if (rc == SQLITE_DONE) {
+            changed = sqlite3_changes(db);
+        } else {
+            fprintf(stderr, "Error: Cannot update tasks: %s\n", sqlite3_errmsg(db));
+        }
+    }
+    db_statement_done(stmt);
+
+    if (changed < 0 || db_commit() != 0) {
+        db_rollback();
+        return -1;
+    }
+    return changed;
+}
+
+int db_set_selected_status(const TaskSelector *selector, Status status, int *selected)
+{
+    if (!db || !selector) {
+        return -1;
+    }
+
+    if (!selection_statement()) {
+        return -1;
+    }
+    sqlite3_stmt *stmt = db_statement(STMT_SET_SELECTED_COMPLETED);
+    if (!stmt) {
+        fprintf(stderr, "Error: Cannot prepare update statement: %s\n", sqlite3_errmsg(db));
+        return -1;
+    }
+    sqlite3_bind_int(stmt, 1, (int)status);
+    return change_selected(selector, stmt, selected);
+}
+
+int db_set_selected_description(const TaskSelector *selector, const char *description, int *selected)
+{
+    if (!db || !selector || !description) {
+        return -1;
+    }
+
+    if (!selection_statement()) {
+        return -1;
+    }
+    sqlite3_stmt *stmt = db_statement(STMT_SET_SELECTED_DESCRIPTION);
+    if (!stmt) {
+        fprintf(stderr, "Error: Cannot prepare update statement: %s\n", sqlite3_errmsg(db));
+        return -1;
+    }
+    sqlite3_bind_text(stmt, 1, description, -1, SQLITE_STATIC);
+    return change_selected(selector, stmt, selected);
+}
+
+int db_delete_selected(const TaskSelector *selector, int *selected)
+{
+    if (!db || !selector) {
+        return -1;
+    }
+
+    if (!selection_statement()) {
+        return -1;
+    }
+    sqlite3_stmt *stmt = db_statement(STMT_DELETE_SELECTED);
+    if (!stmt) {
+        fprintf(stderr, "Error: Cannot prepare delete statement: %s\n", sqlite3_errmsg(db));
+        return -1;
+    }
+    return change_selected(selector, stmt, selected);
+}
+
+// Delete the tasks the last db_count_selected() picked and no others, so
+// tasks added or edited to match while the user was asked are left alone
+int db_delete_counted(int *selected)
+{
+    if (!db) {
+        return -1;
+    }
+
+    if (!selection_statement()) {
+        return -1;
+    }
+    sqlite3_stmt *stmt = db_statement(STMT_DELETE_SELECTED);
+    if (!stmt) {
+        fprintf(stderr, "Error: Cannot prepare delete statement: %s\n", sqlite3_errmsg(db));
+        return -1;
+    }
+    return change_selected(NULL, stmt, selected);
+}
+
+// Attach archive.db as "archive". Unless create is set, a missing file is
+// left alone and 1 returned. ATTACH cannot run inside a transaction.
+static int attach_archive(int create)
+{
+    if (archive_attached) {
+        return 0;
+    }
+    struct stat st;
+    if (!create && stat(archive_path, &st) != 0) {
+        return 1;
+    }
+
+    sqlite3_stmt *stmt = NULL;
+    int rc = sqlite3_prepare_v2(db, "ATTACH DATABASE ? AS archive;", -1, &stmt, NULL);
+    if (rc == SQLITE_OK) {
+        sqlite3_bind_text(stmt, 1, archive_path, -1, SQLITE_STATIC);
+        rc = sqlite3_step(stmt);
+    }
+    sqlite3_finalize(stmt);
+    if (rc != SQLITE_DONE) {
+        fprintf(stderr, "Error: Cannot open archive: %s\n", sqlite3_errmsg(db));
+        return -1;
+    }
+    archive_attached = 1;
+    return create ? db_exec(CREATE_ARCHIVE_SQL, "create archive") : 0;
+}
+
+// Step a cached statement that returns no rows
+static int step_statement(StatementId id, const char *what)
+{
+    sqlite3_stmt *stmt = db_statement(id);
+    if (!stmt) {
+        fprintf(stderr, "Error: Cannot prepare %s statement: %s\n", what, sqlite3_errmsg(db));
+        return -1;
+    }
+    int rc = sqlite3_step(stmt);
+    db_statement_done(stmt);
+    if (rc != SQLITE_DONE) {
+        fprintf(stderr, "Error: Cannot %s: %s\n", what, sqlite3_errmsg(db));
+        return -1;
+    }
+    return 0;
+}
+
+// Move up to batch completed tasks created up to before into the archive,
+// in one transaction. Returns how many were moved, or -1 on error.
+static int archive_batch(time_t before, int batch)
+{
+    sqlite3_stmt *select = db_statement(STMT_SELECT_ARCHIVABLE);
+    sqlite3_stmt *copy = db_statement(STMT_ARCHIVE_SELECTED);
+    if (!select || !copy) {
+        fprintf(stderr, "Error: Cannot prepare archive statement: %s\n", sqlite3_errmsg(db));
+        return -1;
+    }
+    if (db_begin() != 0) {
+        return -1;
+    }
+
+    int moved = -1;
+    sqlite3_bind_int64(select, 1, (sqlite3_int64)before);
+    sqlite3_bind_int(select, 2, batch);
+    sqlite3_bind_int64(copy, 1, (sqlite3_int64)time(NULL));
+    if (db_exec(CLEAR_SELECTION_SQL, "clear selection") == 0 && sqlite3_step(select) == SQLITE_DONE) {
+        moved = sqlite3_changes(db);
+        if (moved > 0 && (sqlite3_step(copy) != SQLITE_DONE ||
+                          step_statement(STMT_RAISE_ARCHIVE_FLOOR, "record archived IDs") != 0 ||
+                          step_statement(STMT_DELETE_SELECTED, "delete archived tasks") != 0)) {
+            moved = -1;
+        }
+    }
+    if (moved < 0) {
+        fprintf(stderr, "Error: Cannot archive tasks: %s\n", sqlite3_errmsg(db));
+    }
+    db_statement_done(select);
+    db_statement_done(copy);
+
+    if (moved < 0 || db_commit() != 0) {
+        db_rollback();
+        return -1;
+    }
+    return moved;
+}
+
+int db_archive_tasks(time_t before, ArchiveStats *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+    if (!db || schema_version < SCHEMA_ARCHIVE) {
+        fprintf(stderr, "Error: The database must be upgraded before archiving\n");
+        return -1;
+    }
+
+    // Incremental vacuum has to be switched on by one full VACUUM in
+    // databases created before it was the default
+    if (query_int(AUTO_VACUUM_SQL, 0) != 2) {
+        TraceSpan span = trace_begin("db.vacuum");
+        int rc = db_exec("PRAGMA main.auto_vacuum = INCREMENTAL; VACUUM;", "enable incremental vacuum");
+        trace_end(span);
+        if (rc != 0) {
+            return -1;
+        }
+        stats->vacuumed = 1;
+    }
+
+    if (attach_archive(1) != 0 || !selection_statement()) {
+        return -1;
+    }
+
+    TraceSpan span = trace_begin("db.archive");
+    int moved;
+    while ((moved = archive_batch(before, DB_ARCHIVE_BATCH)) > 0) {
+        stats->archived += moved;
+        stats->batches++;
+    }
+    trace_end(span);
+    if (moved < 0) {
+        return -1;
+    }
+
+    // After a large run, a copy that catches up from the change log would
+    // read about as much as rebuilding, so the log entries are dropped
+    // (copies older than that rebuild)
+    if (stats->archived >= DB_ARCHIVE_BATCH) {
+        long long generation, changes_from;
+        if (db_generation(&generation, &changes_from) == 0) {
+            db_prune_changes(generation, 1);
+        }
+        // Deleting that many rows leaves the full-text index in many
+        // small segments
+        if (fts_available()) {
+            span = trace_begin("db.fts_optimize");
+            db_exec(OPTIMIZE_FTS_SQL, "optimize the full-text index");
+            trace_end(span);
+        }
+    }
+
+    // Give the freed pages back a slice at a time; each slice is its own
+    // short write, so other writers are never held up for long
+    span = trace_begin("db.incremental_vacuum");
+    int free_pages = query_int(FREELIST_COUNT_SQL, 0);
+    while (free_pages > 0) {
+        if (db_exec("PRAGMA main.incremental_vacuum(" DB_VACUUM_STEP_PAGES ");", "reclaim free pages") != 0) {
+            break;
+        }
+        int left = query_int(FREELIST_COUNT_SQL, 0);
+        if (left >= free_pages) {
+            break;
+        }
+        stats->pages_freed += free_pages - left;
+        free_pages = left;
+    }
+    // Fold the moved rows out of the WAL, so readers do not wade through
+    // them and the file shrinks now rather than at the next checkpoint
+    sqlite3_wal_checkpoint_v2(db, "main", SQLITE_CHECKPOINT_TRUNCATE, NULL, NULL);
+    trace_end(span);
+    stats->page_size = query_int("PRAGMA main.page_size;", 0);
+    return 0;
+}
+
+// Hand each (id, description, completed, created) row of stmt to the
+// callback. Rows point straight into SQLite's column buffers and are only
+// valid for the duration of the callback. Returns the SQLite result of
+// the last step, SQLITE_DONE also when the callback stopped early.
+static int stream_rows(sqlite3_stmt *stmt, TaskRowCallback callback, void *ctx, int *rows)
+{
+    int rc;
+    TaskRow row;
+    while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+        row.id = sqlite3_column_int(stmt, 0);
+        row.description = (const char *)sqlite3_column_text(stmt, 1);
+        row.description_len = sqlite3_column_bytes(stmt, 1);
+        row.completed = (Status)sqlite3_column_int(stmt, 2);
+        row.created = (time_t)sqlite3_column_int64(stmt, 3);
+        if (!row.description) {
+            row.description = "";
+        }
+        (*rows)++;
+        if (callback(&row, ctx) != 0) {
+            return SQLITE_DONE;
+        }
+    }
+    return rc;
+}
+
+int db_each_task(const TaskQuery *query, TaskRowCallback callback, void *ctx)
+{
+    if (!db || !query || !callback) {
+        return -1;
+    }
+
+    // The archive only holds completed tasks, and may not exist yet
+    int archive = query->archive && !query->pending_only && attach_archive(0) == 0;
+
+    StatementId id;
+    if (query->pending_only) {
+        id = query->after_id ? STMT_LIST_PENDING_AFTER : STMT_LIST_PENDING;
+    } else if (archive) {
+        id = query->after_id ? STMT_LIST_WITH_ARCHIVE_AFTER : STMT_LIST_WITH_ARCHIVE;
+    } else {
+        id = query->after_id ? STMT_LIST_ALL_AFTER : STMT_LIST_ALL;
+    }
+
+    sqlite3_stmt *stmt = db_statement(id);
+    if (!stmt) {
+        fprintf(stderr, "Error: Cannot prepare list statement: %s\n", sqlite3_errmsg(db));
+        return -1;
+    }
+
+    if (query->after_id) {
+        sqlite3_bind_int(stmt, 1, query->after_id);
+    }
+    sqlite3_bind_int(stmt, 2, query->limit > 0 ? query->limit : -1);
+
+    TraceSpan span = trace_begin("db.each_task");
+    int rows = 0;
+    int rc = stream_rows(stmt, callback, ctx, &rows);
+    db_statement_done(stmt);
+    trace_end(span);
+
+    if (rc != SQLITE_DONE) {
+        fprintf(stderr, "Error: Cannot list tasks: %s\n", sqlite3_errmsg(db));
+        return -1;
+    }
+    // An empty page is either the end of the list or a cursor naming a
+    // task that is gone
+    if (rows == 0 && query->after_id) {
+        stmt = db_statement(archive ? STMT_TASK_EXISTS_WITH_ARCHIVE : STMT_TASK_EXISTS);
+        if (!stmt) {
+            return -1;
+        }
+        sqlite3_bind_int(stmt, 1, query->after_id);
+        int exists = sqlite3_step(stmt) == SQLITE_ROW ? sqlite3_column_int(stmt, 0) : -1;
+        db_statement_done(stmt);
+        if (exists <= 0) {
+            return exists == 0 ? TASKS_AFTER_NOT_FOUND : -1;
+        }
+    }
+    return rows;
+}
+
+int db_get_task(int id, Task *task)
+{
+    if (!db || !task) {
+        return -1;
+    }
+    task->description = NULL;
+
+    sqlite3_stmt *stmt = db_statement(STMT_SELECT_TASK);
+    if (!stmt) {
+        fprintf(stderr, "Error: Cannot prepare select statement: %s\n", sqlite3_errmsg(db));
+        return -1;
+    }
+
+    sqlite3_bind_int(stmt, 1, id);
+
+    int found = 0;
+    int rc = sqlite3_step(stmt);
+    if (rc == SQLITE_ROW) {
+        found = read_task_row(stmt, task) == 0 ? 1 : -1;
+    } else if (rc != SQLITE_DONE) {
+        fprintf(stderr, "Error: Cannot read task: %s\n", sqlite3_errmsg(db));
+        found = -1;
+    }
+    db_statement_done(stmt);
+
+    return found;
+}
+
+int db_set_task_status(int id, Status status)
+{
+    if (!db) {
+        return -1;
+    }
+
+    sqlite3_stmt *stmt = db_statement(STMT_SET_COMPLETED);
+    if (!stmt) {
+        fprintf(stderr, "Error: Cannot prepare update statement: %s\n", sqlite3_errmsg(db));
+        return -1;
+    }
+
+    sqlite3_bind_int(stmt, 1, (int)status);
+    sqlite3_bind_int(stmt, 2, id);
+
+    int rc = sqlite3_step(stmt);
+    db_statement_done(stmt);
+
+    if (rc != SQLITE_DONE) {
+        fprintf(stderr, "Error: Cannot update task: %s\n", sqlite3_errmsg(db));
+        return -1;
+    }
+
+    return sqlite3_changes(db);
+}
+
+int db_set_task_description(int id, const char *description)
+{
+    if (!db || !description) {
+        return -1;
+    }
+
+    sqlite3_stmt *stmt = db_statement(STMT_SET_DESCRIPTION);
+    if (!stmt) {
+        fprintf(stderr, "Error: Cannot prepare update statement: %s\n", sqlite3_errmsg(db));
+        return -1;
+    }
+
+    sqlite3_bind_text(stmt, 1, description, -1, SQLITE_STATIC);
+    sqlite3_bind_int(stmt, 2, id);
+
+    int rc = sqlite3_step(stmt);
+    db_statement_done(stmt);
+
+    if (rc != SQLITE_DONE) {
+        fprintf(stderr, "Error: Cannot update task: %s\n", sqlite3_errmsg(db));
+        return -1;
+    }
+
+    return sqlite3_changes(db);
+}
+
+int db_count_tasks(int *total, int *completed)
+{
+    if (!db) {
+        return -1;
+    }
+
+    sqlite3_stmt *stmt = db_statement(schema_version >= SCHEMA_COUNTERS ? STMT_COUNT_FROM_COUNTERS : STMT_COUNT_BY_STATUS);
+    if (!stmt) {
+        fprintf(stderr, "Error: Cannot prepare count statement: %s\n", sqlite3_errmsg(db));
+        return -1;
+    }
+
+    TraceSpan span = trace_begin("db.count_tasks");
+    int rc = sqlite3_step(stmt);
+    trace_end(span);
+    if (rc == SQLITE_ROW) {
+        if (total) {
+            *total = sqlite3_column_int(stmt, 0);
+        }
+        if (completed) {
+            *completed = sqlite3_column_int(stmt, 1);
+        }
+    }
+    db_statement_done(stmt);
+
+    if (rc != SQLITE_ROW) {
+        fprintf(stderr, "Error: Cannot count tasks: %s\n", sqlite3_errmsg(db));
+        return -1;
+    }
+    return 0;
+}
+
+// Fill one of the tasks of a stats row from columns first..first+3; a
+// NULL ID (no such task) leaves it with ID 0
+static void read_stats_task(sqlite3_stmt *stmt, int first, Task *task)
+{
+    memset(task, 0, sizeof(*task));
+    if (sqlite3_column_type(stmt, first) == SQLITE_NULL) {
+        return;
+    }
+    task->id = sqlite3_column_int(stmt, first);
+    const char *description = (const char *)sqlite3_column_text(stmt, first + 1);
+    task->description = copy_description(description ? description : "",
+                                         (size_t)sqlite3_column_bytes(stmt, first + 1));
+    task->completed = (Status)sqlite3_column_int(stmt, first + 2);
+    task->created = (time_t)sqlite3_column_int64(stmt, first + 3);
+}
+
+static int read_task_stats(StatementId id, TaskStats *stats)
+{
+    sqlite3_stmt *stmt = db_statement(id);
+    if (!stmt) {
+        fprintf(stderr, "Error: Cannot prepare stats statement: %s\n", sqlite3_errmsg(db));
+        return -1;
+    }
+
+    TraceSpan span = trace_begin("db.task_stats");
+    int rc = sqlite3_step(stmt);
+    if (rc == SQLITE_ROW) {
+        stats->total = sqlite3_column_int(stmt, 0);
+        stats->completed = sqlite3_column_int(stmt, 1);
+        read_stats_task(stmt, 2, &stats->oldest_pending);
+        read_stats_task(stmt, 6, &stats->newest);
+        if ((stats->oldest_pending.id && !stats->oldest_pending.description) ||
+            (stats->newest.id && !stats->newest.description)) {
+            task_stats_clear(stats);
+            rc = SQLITE_NOMEM;
+        }
+    }
+    db_statement_done(stmt);
+    trace_end(span);
+
+    if (rc != SQLITE_ROW) {
+        fprintf(stderr, "Error: Cannot read task stats: %s\n", sqlite3_errmsg(db));
+        return -1;
+    }
+    return 0;
+}
+
+int db_task_stats(TaskStats *stats)
+{
+    if (!db || !stats) {
+        return -1;
+    }
+    return read_task_stats(schema_version >= SCHEMA_COUNTERS ? STMT_TASK_STATS : STMT_TASK_STATS_SCAN, stats);
+}
+
+// Recompute the stats with full scans and compare them with the
+// maintained ones. Returns 0 when they agree, 1 when they do not and -1
+// on error (including a database without counters). Unless it fails, both
+// are to be released with task_stats_clear().
+int db_check_task_stats(TaskStats *stored, TaskStats *actual)
+{
+    if (!db || !stored || !actual) {
+        return -1;
+    }
+    if (schema_version < SCHEMA_COUNTERS) {
+        fprintf(stderr, "Error: The database has no task counters\n");
+        return -1;
+    }
+
+    // One read transaction, so a concurrent writer cannot slip in between
+    if (db_exec("BEGIN;", "begin transaction") != 0) {
+        return -1;
+    }
+    memset(stored, 0, sizeof(*stored));
+    memset(actual, 0, sizeof(*actual));
+    int ok = read_task_stats(STMT_TASK_STATS, stored) == 0 && read_task_stats(STMT_TASK_STATS_SCAN, actual) == 0;
+    db_exec("COMMIT;", "end transaction");
+    if (!ok) {
+        task_stats_clear(stored);
+        task_stats_clear(actual);
+        return -1;
+    }
+
+    return stored->total != actual->total || stored->completed != actual->completed ||
+           stored->oldest_pending.id != actual->oldest_pending.id || stored->newest.id != actual->newest.id;
+}
+
+int db_get_next_id(void)
+{
+    if (!db) {
+        return 1;
+    }
+
+    sqlite3_stmt *stmt = db_statement(schema_version >= SCHEMA_ARCHIVE ? STMT_NEXT_ID : STMT_MAX_ID);
+    if (!stmt) {
+        fprintf(stderr, "Error: Cannot prepare max id statement: %s\n", sqlite3_errmsg(db));
+        return 1;
+    }
+
+    // MAX(id) is NULL for an empty table; NEXT_ID_SQL already adds one
+    int next_id = 1;
+    if (sqlite3_step(stmt) == SQLITE_ROW) {
+        if (sqlite3_column_type(stmt, 0) != SQLITE_NULL) {
+            next_id = sqlite3_column_int(stmt, 0) + (schema_version >= SCHEMA_ARCHIVE ? 0 : 1);
+        }
+    }
+
+    db_statement_done(stmt);
+    return next_id;
+}
+
+// Lets a long-lived connection notice commits made by other processes;
+// its own writes leave the value unchanged
+int db_data_version(void)
+{
+    if (!db) {
+        return -1;
+    }
+
+    sqlite3_stmt *stmt = db_statement(STMT_DATA_VERSION);
+    if (!stmt) {
+        return -1;
+    }
+
+    int version = -1;
+    if (sqlite3_step(stmt) == SQLITE_ROW) {
+        version = sqlite3_column_int(stmt, 0);
+    }
+    db_statement_done(stmt);
+    return version;
+}
+
+// Turn a search term into an FTS5 query for the trigram index: every word
+// of three or more characters becomes a quoted substring, and the terms
+// are implicitly ANDed. Shorter words have no trigram and are left to
+// task_matches(). Returns the number of terms, 0 when none can be looked
+// up in the index.
+static int build_fts_query(const char *search_term, char *query, size_t size)
+{
+    if (strlen(search_term) >= MATCH_MAX_TERM) {
+        return 0; // cut by the matcher, possibly inside a character
+    }
+
+    MatchQuery words;
+    match_query_init(&words, search_term);
+
+    size_t n = 0;
+    int terms = 0;
+    for (int w = 0; w < words.count; w++) {
+        const unsigned char *word = words.term + words.words[w].start;
+        int len = words.words[w].len, chars = 0;
+        for (int i = 0; i < len; i++) {
+            chars += (word[i] & 0xC0) != 0x80;
+        }
+        if (chars < 3) {
+            continue;
+        }
+
+        // Quotes are doubled inside an FTS5 string
+        if (n + 2 * (size_t)len + 4 >= size) {
+            return 0;
+        }
+        if (terms > 0) {
+            query[n++] = ' ';
+        }
+        query[n++] = '"';
+        for (int i = 0; i < len; i++) {
+            if (word[i] == '"') {
+                query[n++] = '"';
+            }
+            query[n++] = (char)word[i];
+        }
+        query[n++] = '"';
+        terms++;
+    }
+
+    query[n] = '\0';
+    return terms;
+}
+
+int db_search_tasks(const char *search_term, TaskRowCallback callback, void *ctx)
+{
+    if (!db || !search_term || !callback) {
+        return -1;
+    }
+
+    // Searches the index when it exists and the term has a word it can
+    // look up, and scans otherwise; both return the same rows
+    char fts_query[MATCH_MAX_TERM * 2 + 8];
+    sqlite3_stmt *stmt = NULL;
+    if (fts_available() && build_fts_query(search_term, fts_query, sizeof(fts_query)) > 0) {
+        stmt = db_statement(STMT_FTS_SEARCH_TASKS);
+        if (stmt) {
+            sqlite3_bind_text(stmt, 2, fts_query, -1, SQLITE_STATIC);
+        } else {
+            fts_enabled = 0; // e.g. a build without FTS5 opening an indexed file
+        }
+    }
+    if (!stmt) {
+        stmt = db_statement(STMT_SEARCH_TASKS);
+    }
+    if (!stmt) {
+        fprintf(stderr, "Error: Cannot prepare search statement: %s\n", sqlite3_errmsg(db));
+        return -1;
+    }
+
+    sqlite3_bind_text(stmt, 1, search_term, -1, SQLITE_STATIC);
+
+    TraceSpan span = trace_begin("db.search");
+    int rows = 0;
+    int rc = stream_rows(stmt, callback, ctx, &rows);
+    db_statement_done(stmt);
+    trace_end(span);
+
+    if (rc != SQLITE_DONE) {
+        fprintf(stderr, "Error: Cannot search tasks: %s\n", sqlite3_errmsg(db));
+        return -1;
+    }
+    return rows;
+}
+
+int db_fts_available(void)
+{
+    return db ? fts_available() : 0;
+}
+
+void db_set_fts_enabled(int enabled)
+{
+    // Can only switch back on when the index exists
+    fts_enabled = enabled ? -1 : 0;
+}
+
+void db_get_statement_stats(DbStatementStats *stats)
+{
+    if (stats) {
+        *stats = stmt_stats;
+    }
+}
+
+// Times this process waited for another writer's lock
+int db_busy_retries(void)
+{
+    return busy_retries;
+}
+
+// A read transaction, for reading a consistent view with several queries
+int db_begin_read(void)
+{
+    return db_exec("BEGIN;", "begin transaction");
+}
+
+// The current generation, and the oldest one whose changes are still all
+// in the log. Returns -1 when the database predates generations.
+int db_generation(long long *generation, long long *changes_from)
+{
+    if (!db || schema_version < SCHEMA_CHANGE_LOG) {
+        return -1;
+    }
+
+    sqlite3_stmt *stmt = db_statement(STMT_GENERATION);
+    if (!stmt) {
+        return -1;
+    }
+    int rc = sqlite3_step(stmt);
+    if (rc == SQLITE_ROW) {
+        *generation = sqlite3_column_int64(stmt, 0);
+        *changes_from = sqlite3_column_int64(stmt, 1);
+    }
+    db_statement_done(stmt);
+    return rc == SQLITE_ROW ? 0 : -1;
+}
+
+static int compare_ints(const void *a, const void *b)
+{
+    int x = *(const int *)a, y = *(const int *)b;
+    return (x > y) - (x < y);
+}
+
+// IDs of the tasks changed or deleted after generation since (and those
+// added below the highest ID), in ascending order. Returns their number, with *ids malloc'd, or -1.
+int db_changed_ids(long long since, int **ids)
+{
+    *ids = NULL;
+    sqlite3_stmt *stmt = db ? db_statement(STMT_CHANGED_IDS) : NULL;
+    if (!stmt) {
+        return -1;
+    }
+    sqlite3_bind_int64(stmt, 1, since);
+
+    int count = 0, capacity = 0;
+    int rc;
+    while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+        if (count == capacity) {
+            capacity = capacity ? capacity * 2 : 64;
+            int *grown = realloc(*ids, (size_t)capacity * sizeof(int));
+            if (!grown) {
+                rc = SQLITE_NOMEM;
+                break;
+            }
+            *ids = grown;
+        }
+        (*ids)[count++] = sqlite3_column_int(stmt, 0);
+    }
+    db_statement_done(stmt);
+
+    if (rc != SQLITE_DONE) {
+        free(*ids);
+        *ids = NULL;
+        return -1;
+    }
+    if (count > 1) {
+        qsort(*ids, (size_t)count, sizeof(int), compare_ints);
+    }
+    return count;
+}
+
+// The tasks changed after generation since that still exist, plus every
+// task with an ID above max_id (which adds do not log), in no particular
+// order. Returns the number of rows or -1.
+int db_each_changed_task(long long since, int max_id, TaskRowCallback callback, void *ctx)
+{
+    sqlite3_stmt *stmt = db ? db_statement(STMT_CHANGED_TASKS) : NULL;
+    if (!stmt) {
+        return -1;
+    }
+    sqlite3_bind_int64(stmt, 1, since);
+    sqlite3_bind_int(stmt, 2, max_id);
+
+    int rows = 0;
+    int rc = stream_rows(stmt, callback, ctx, &rows);
+    db_statement_done(stmt);
+    return rc == SQLITE_DONE ? rows : -1;
+}
+
+// Forget the changes up to and including generation through. Unless wait
+// is set this is left for later, silently, when another connection holds
+// the write lock (or the file is read-only), so readers never wait on it.
+int db_prune_changes(long long through, int wait)
+{
+    sqlite3_stmt *prune = db ? db_statement(STMT_PRUNE_CHANGES) : NULL;
+    sqlite3_stmt *mark = db ? db_statement(STMT_SET_CHANGES_FROM) : NULL;
+    if (!prune || !mark) {
+        return -1;
+    }
+    if (!wait) {
+        sqlite3_busy_handler(db, NULL, NULL);
+        int rc = sqlite3_exec(db, "BEGIN IMMEDIATE;", NULL, NULL, NULL);
+        sqlite3_busy_handler(db, busy_handler, NULL);
+        if (rc != SQLITE_OK) {
+            return -1;
+        }
+    } else if (db_begin() != 0) {
+        return -1;
+    }
+
+    sqlite3_bind_int64(prune, 1, through);
+    sqlite3_bind_int64(mark, 1, through);
+    int ok = sqlite3_step(prune) == SQLITE_DONE && sqlite3_step(mark) == SQLITE_DONE;
+    db_statement_done(prune);
+    db_statement_done(mark);
+
+    if (!ok || db_commit() != 0) {
+        db_rollback();
+        return -1;
+    }
+    return 0;
+}
+
+struct DbReader
+{
+    sqlite3 *conn;
+};
+
+DbReader *db_reader_open(void)
+{
+    init_db_path();
+
+    DbReader *reader = calloc(1, sizeof(*reader));
+    if (!reader) {
+        return NULL;
+    }
+    if (sqlite3_open_v2(db_path, &reader->conn, SQLITE_OPEN_READONLY, NULL) != SQLITE_OK) {
+        sqlite3_close(reader->conn);
+        free(reader);
+        return NULL;
+    }
+    sqlite3_busy_timeout(reader->conn, DB_BUSY_TIMEOUT_MS);
+    return reader;
+}
+
+// Load every task in creation order. Returns -1 on error, including when
+// the load was interrupted; nothing is printed since the caller may be a
+// background thread drawing to a raw-mode terminal.
+int db_reader_load_tasks(DbReader *reader, TaskManager *tm)
+{
+    if (!reader || !tm) {
+        return -1;
+    }
+
+    sqlite3_stmt *count = NULL;
+    sqlite3_stmt *select = NULL;
+    int rc = SQLITE_ERROR;
+    if (sqlite3_prepare_v2(reader->conn, COUNT_TASKS_SQL, -1, &count, NULL) == SQLITE_OK &&
+        sqlite3_prepare_v2(reader->conn, SELECT_ALL_TASKS_SQL, -1, &select, NULL) == SQLITE_OK) {
+        TraceSpan span = trace_begin("db.reader_load");
+        rc = load_task_rows(count, select, tm);
+        trace_end(span);
+    }
+    trace_stmt(count);
+    trace_stmt(select);
+    sqlite3_finalize(count);
+    sqlite3_finalize(select);
+    return rc == SQLITE_DONE ? 0 : -1;
+}
+
+// Pending tasks whose ID starts with the digits in prefix, in ID order:
+// for "12" that is 12, then 120-129, 1200-1299 and so on, each one range
+// of idx_tasks_pending_id, so only the rows handed out are read. Stops after limit rows.
+// Returns the number of rows or -1 on error.
+int db_reader_complete_ids(DbReader *reader, const char *prefix, int limit, int width, TaskRowCallback callback,
+                           void *ctx)
+{
+    if (!reader || !prefix || !callback) {
+        return -1;
+    }
+
+    long long first = 0;
+    for (const char *p = prefix; *p; p++) {
+        if (*p < '0' || *p > '9' || first > INT_MAX) {
+            return 0; // not an ID prefix
+        }
+        first = first * 10 + (*p - '0');
+    }
+    if (*prefix == '0') {
+        return 0;
+    }
+
+    sqlite3_stmt *stmt = NULL;
+    if (sqlite3_prepare_v2(reader->conn, COMPLETE_IDS_SQL, -1, &stmt, NULL) != SQLITE_OK &&
+        sqlite3_prepare_v2(reader->conn, COMPLETE_IDS_SCAN_SQL, -1, &stmt, NULL) != SQLITE_OK) {
+        sqlite3_finalize(stmt);
+        return -1;
+    }
+
+    TraceSpan span = trace_begin("db.complete_ids");
+    int rows = 0;
+    int rc = SQLITE_DONE;
+    // An empty prefix matches every ID, as one range starting at 1
+    long long count = *prefix ? 1 : INT_MAX;
+    first = *prefix ? first : 1;
+    for (; rows < limit && first <= INT_MAX; first *= 10, count *= 10) {
+        long long last = first + count - 1;
+        sqlite3_bind_int64(stmt, 1, first);
+        sqlite3_bind_int64(stmt, 2, last < INT_MAX ? last : INT_MAX);
+        sqlite3_bind_int(stmt, 3, width);
+        sqlite3_bind_int(stmt, 4, limit - rows);
+        rc = stream_rows(stmt, callback, ctx, &rows);
+        sqlite3_reset(stmt);
+        if (rc != SQLITE_DONE || !*prefix) {
+            break;
+        }
+    }
+    trace_end(span);
+    trace_stmt(stmt);
+    sqlite3_finalize(stmt);
+    return rc == SQLITE_DONE ? rows : -1;
+}
+
+// Safe to call from any thread while the reader is open
+void db_reader_interrupt(DbReader *reader)
+{
+    if (reader) {
+        sqlite3_interrupt(reader->conn);
+    }
+}
+
+void db_reader_close(DbReader *reader)
+{
+    if (reader) {
+        trace_conn(reader->conn);
+        sqlite3_close(reader->conn);
+        free(reader);
+    }
+}
+
 const char *db_get_path(void)
 {
     init_db_path();
     return db_path;
 }
+
+const char *db_archive_path(void)
+{
+    init_db_path();
+    return archive_path;
+}
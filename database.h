@@ -1,10 +1,11 @@
 #ifndef DATABASE_H
 #define DATABASE_H
 
+#include <stddef.h>
 #include <time.h>
+#include "arena.h"
 
-#define MAX_TASK_LENGTH 256
-#define MAX_TASKS 100
+#define TASKS_INITIAL_CAPACITY 64
 
 typedef enum
 {
@@ -12,29 +13,169 @@ typedef enum
     DONE = 1
 } Status;
 
+// One task on its own. Descriptions have no length limit: functions that
+// fill in a Task (db_get_task(), db_task_stats(), ...) allocate the
+// description and task_clear() frees it. Functions that only read a Task
+// take the description from wherever the caller keeps it.
 typedef struct
 {
     int id;
-    char description[MAX_TASK_LENGTH];
+    char *description;
     Status completed;
     time_t created;
 } Task;
 
+// Growable task store with one array per field, so a scan by status or
+// date touches only those columns. Descriptions are packed one after
+// another into a separate string arena and found through descriptions[];
+// the columns live in the other arena, so a whole TaskManager is released
+// with a single tm_free().
 typedef struct
 {
-    Task tasks[MAX_TASKS];
+    int *ids;
+    unsigned char *status; // Status of each task
+    time_t *created;
+    const char **descriptions;
+    int *lengths; // strlen() of each description
     int count;
+    int capacity;
+    Arena arena;
+    Arena text;
 } TaskManager;
 
-// Database operations
+typedef struct
+{
+    int prepared; // statements compiled by sqlite3_prepare
+    int reused;   // calls served from the statement cache
+} DbStatementStats;
+
+// What `taskman status` shows. A task that does not exist (nothing
+// pending, or no tasks at all) has ID 0.
+typedef struct
+{
+    int total;
+    int completed;
+    Task oldest_pending;
+    Task newest;
+} TaskStats;
+
+// A task as seen while streaming rows from the database. The description
+// points into SQLite's buffer and is only valid inside the callback.
+typedef struct
+{
+    int id;
+    const char *description;
+    int description_len;
+    Status completed;
+    time_t created;
+} TaskRow;
+
+// Return non-zero from the callback to stop the scan early
+typedef int (*TaskRowCallback)(const TaskRow *row, void *ctx);
+
+typedef struct
+{
+    int pending_only; // skip DONE tasks
+    int after_id;     // continue after this task in listing order (0 = start)
+    int limit;        // maximum rows (0 = no limit)
+    int archive;      // include archived tasks (database only)
+} TaskQuery;
+
+// Returned instead of a row count when after_id names no task, by
+// db_each_task() as well as the daemon and snapshot listings
+#define TASKS_AFTER_NOT_FOUND (-2)
+
+// What db_archive_tasks() did
+typedef struct
+{
+    int archived;     // tasks moved to the archive
+    int batches;      // transactions they were moved in
+    int vacuumed;     // a full VACUUM switched on incremental vacuum first
+    long pages_freed; // pages handed back to the file system
+    int page_size;
+} ArchiveStats;
+
+// Tasks a bulk command applies to: IDs and ID ranges (first == last for
+// a single ID), narrowed to the tasks containing every word of match when
+// it is set. With no ranges the match alone decides.
+typedef struct
+{
+    int first;
+    int last;
+} IdRange;
+
+typedef struct
+{
+    const IdRange *ranges;
+    int range_count;
+    const char *match;
+} TaskSelector;
+
+void task_clear(Task *task);
+void task_stats_clear(TaskStats *stats);
+
+// Task store operations
+int tm_reserve(TaskManager *tm, int capacity);
+int tm_append(TaskManager *tm, int id, const char *description, size_t len, Status completed, time_t created);
+int tm_set_description(TaskManager *tm, int index, const char *description, size_t len);
+void tm_move(TaskManager *tm, int to, int from);
+void tm_remove(TaskManager *tm, int index);
+void tm_clear(TaskManager *tm);
+void tm_free(TaskManager *tm);
+
+// Database operations. Point operations by ID return the number of
+// affected rows (0 when the task does not exist) or -1 on error.
 int db_init(void);
 void db_close(void);
+int db_begin(void);
+int db_commit(void);
+int db_rollback(void);
 int db_load_tasks(TaskManager *tm);
 int db_save_task(const Task *task);
+int db_add_task(Task *task);
+int db_stage_task(const Task *task);
+int db_flush_staged_tasks(void);
 int db_update_task(const Task *task);
 int db_delete_task(int id);
+int db_each_task(const TaskQuery *query, TaskRowCallback callback, void *ctx);
+int db_get_task(int id, Task *task);
+int db_set_task_status(int id, Status status);
+int db_set_task_description(int id, const char *description);
+int db_count_selected(const TaskSelector *selector);
+int db_set_selected_status(const TaskSelector *selector, Status status, int *selected);
+int db_set_selected_description(const TaskSelector *selector, const char *description, int *selected);
+int db_delete_selected(const TaskSelector *selector, int *selected);
+int db_delete_counted(int *selected);
+int db_archive_tasks(time_t before, ArchiveStats *stats);
+int db_count_tasks(int *total, int *completed);
+int db_task_stats(TaskStats *stats);
+int db_check_task_stats(TaskStats *stored, TaskStats *actual);
 int db_get_next_id(void);
-int db_search_tasks(TaskManager *tm, const char *search_term);
+int db_data_version(void);
+int db_search_tasks(const char *search_term, TaskRowCallback callback, void *ctx);
+int db_fts_available(void);
+void db_set_fts_enabled(int enabled);
 const char *db_get_path(void);
+const char *db_archive_path(void);
+
+// Change tracking for copies of the tasks kept outside SQLite
+int db_begin_read(void);
+int db_generation(long long *generation, long long *changes_from);
+int db_changed_ids(long long since, int **ids);
+int db_each_changed_task(long long since, int max_id, TaskRowCallback callback, void *ctx);
+int db_prune_changes(long long through, int wait);
+void db_get_statement_stats(DbStatementStats *stats);
+int db_busy_retries(void);
+
+// A separate read-only connection for background threads. Its queries can
+// be aborted from another thread with db_reader_interrupt().
+typedef struct DbReader DbReader;
+
+DbReader *db_reader_open(void);
+int db_reader_load_tasks(DbReader *reader, TaskManager *tm);
+int db_reader_complete_ids(DbReader *reader, const char *prefix, int limit, int width, TaskRowCallback callback,
+                           void *ctx);
+void db_reader_interrupt(DbReader *reader);
+void db_reader_close(DbReader *reader);
 
 #endif // DATABASE_H
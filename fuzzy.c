@@ -0,0 +1,325 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "fuzzy.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// Scoring in the spirit of fzf's v1 algorithm: every matched character
+// earns SCORE_MATCH, characters at the start of a word earn a bonus (twice
+// as much for the first pattern character), runs keep the bonus they
+// started with and gaps cost a little per skipped character.
+#define SCORE_MATCH 16
+#define SCORE_GAP_START -3
+#define SCORE_GAP_EXTENSION -1
+#define BONUS_BOUNDARY 8
+#define BONUS_CAMEL 7
+#define BONUS_CONSECUTIVE 4
+
+static unsigned char fold(unsigned char c)
+{
+    return c >= 'A' && c <= 'Z' ? (unsigned char)(c | 0x20) : c;
+}
+
+static int is_alnum(unsigned char c)
+{
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c >= 0x80;
+}
+
+// One bit per letter and digit, the remaining bytes share the rest
+static uint64_t char_bit(unsigned char c)
+{
+    c = fold(c);
+    if (c >= 'a' && c <= 'z') {
+        return 1ULL << (c - 'a');
+    }
+    if (c >= '0' && c <= '9') {
+        return 1ULL << (26 + c - '0');
+    }
+    return 1ULL << (36 + c % 28);
+}
+
+// Set of characters in text. A pattern can only match a text whose mask
+// contains all of the pattern's bits, which rejects most tasks with one AND.
+uint64_t fuzzy_mask(const char *text, size_t len)
+{
+    uint64_t mask = 0;
+    for (size_t i = 0; i < len; i++) {
+        mask |= char_bit((unsigned char)text[i]);
+    }
+    return mask;
+}
+
+void fuzzy_pattern_init(FuzzyPattern *pattern, const char *term)
+{
+    pattern->len = 0;
+    pattern->mask = 0;
+    for (const char *p = term; *p && pattern->len < MATCH_MAX_TERM - 1; p++) {
+        if (*p != ' ') {
+            pattern->chars[pattern->len++] = fold((unsigned char)*p);
+            pattern->mask |= char_bit((unsigned char)*p);
+        }
+    }
+}
+
+// Whether the pattern's characters appear in order
+int fuzzy_is_match(const FuzzyPattern *pattern, const char *text, size_t len)
+{
+    int matched = 0;
+    for (size_t i = 0; i < len && matched < pattern->len; i++) {
+        matched += fold((unsigned char)text[i]) == pattern->chars[matched];
+    }
+    return matched == pattern->len;
+}
+
+static int bonus_at(const char *text, size_t i)
+{
+    unsigned char cur = (unsigned char)text[i];
+    unsigned char prev = i > 0 ? (unsigned char)text[i - 1] : ' ';
+    if (!is_alnum(prev) && is_alnum(cur)) {
+        return BONUS_BOUNDARY;
+    }
+    if ((prev >= 'a' && prev <= 'z' && cur >= 'A' && cur <= 'Z') ||
+        (!(prev >= '0' && prev <= '9') && cur >= '0' && cur <= '9')) {
+        return BONUS_CAMEL;
+    }
+    return 0;
+}
+
+// Score the best short window containing the pattern, or -1 when the text
+// does not match. positions (pattern->len entries) receives the byte
+// offset of every matched character when not NULL.
+int fuzzy_score(const FuzzyPattern *pattern, const char *text, size_t len, int *positions)
+{
+    if (pattern->len == 0) {
+        return 0;
+    }
+
+    // The leftmost place the whole pattern fits ends the window...
+    size_t end = 0;
+    int matched = 0;
+    for (size_t i = 0; i < len; i++) {
+        if (fold((unsigned char)text[i]) == pattern->chars[matched] && ++matched == pattern->len) {
+            end = i + 1;
+            break;
+        }
+    }
+    if (matched < pattern->len) {
+        return -1;
+    }
+
+    // ...and walking back from there finds the latest start for it
+    size_t start = end;
+    for (int pi = pattern->len - 1; pi >= 0; ) {
+        start--;
+        if (fold((unsigned char)text[start]) == pattern->chars[pi]) {
+            pi--;
+        }
+    }
+
+    int score = 0;
+    int pi = 0;
+    int run = 0;
+    int run_bonus = 0;
+    int in_gap = 0;
+    for (size_t i = start; i < end && pi < pattern->len; i++) {
+        if (fold((unsigned char)text[i]) != pattern->chars[pi]) {
+            score += in_gap ? SCORE_GAP_EXTENSION : SCORE_GAP_START;
+            in_gap = 1;
+            run = 0;
+            continue;
+        }
+
+        int bonus = bonus_at(text, i);
+        if (run == 0) {
+            run_bonus = bonus;
+        } else {
+            if (bonus == BONUS_BOUNDARY) {
+                run_bonus = bonus;
+            }
+            bonus = bonus > run_bonus ? bonus : run_bonus;
+            bonus = bonus > BONUS_CONSECUTIVE ? bonus : BONUS_CONSECUTIVE;
+        }
+        score += SCORE_MATCH + (pi == 0 ? bonus * 2 : bonus);
+        if (positions) {
+            positions[pi] = (int)i;
+        }
+        pi++;
+        run++;
+        in_gap = 0;
+    }
+    return score;
+}
+
+// a ranks below b: lower score, or the same score for a later task
+static int hit_worse(const FuzzyHit *a, const FuzzyHit *b)
+{
+    return a->score < b->score || (a->score == b->score && a->index > b->index);
+}
+
+// Bounded min-heap holding the best hits seen so far; the root is the
+// worst of them, so a new hit only has to beat the root to get in
+typedef struct
+{
+    FuzzyHit *hits;
+    int count;
+    int cap;
+} HitHeap;
+
+static void heap_sift_down(HitHeap *heap, int i)
+{
+    while (1) {
+        int worst = i;
+        int left = 2 * i + 1;
+        int right = left + 1;
+        if (left < heap->count && hit_worse(&heap->hits[left], &heap->hits[worst])) {
+            worst = left;
+        }
+        if (right < heap->count && hit_worse(&heap->hits[right], &heap->hits[worst])) {
+            worst = right;
+        }
+        if (worst == i) {
+            return;
+        }
+        FuzzyHit tmp = heap->hits[i];
+        heap->hits[i] = heap->hits[worst];
+        heap->hits[worst] = tmp;
+        i = worst;
+    }
+}
+
+static void heap_offer(HitHeap *heap, FuzzyHit hit)
+{
+    if (heap->count < heap->cap) {
+        int i = heap->count++;
+        heap->hits[i] = hit;
+        while (i > 0 && hit_worse(&heap->hits[i], &heap->hits[(i - 1) / 2])) {
+            FuzzyHit tmp = heap->hits[i];
+            heap->hits[i] = heap->hits[(i - 1) / 2];
+            heap->hits[(i - 1) / 2] = tmp;
+            i = (i - 1) / 2;
+        }
+    } else if (heap->cap > 0 && hit_worse(&heap->hits[0], &hit)) {
+        heap->hits[0] = hit;
+        heap_sift_down(heap, 0);
+    }
+}
+
+typedef struct
+{
+    const FuzzyPattern *pattern;
+    const TaskManager *tasks;
+    const int *candidates;
+    int count;
+    HitHeap heap;
+    FuzzyCancel cancel;
+    void *ctx;
+    int cancelled;
+} RankSlice;
+
+static void *rank_slice(void *arg)
+{
+    RankSlice *slice = arg;
+
+    for (int i = 0; i < slice->count; i++) {
+        if ((i & 4095) == 4095 && slice->cancel && slice->cancel(slice->ctx)) {
+            slice->cancelled = 1;
+            break;
+        }
+        FuzzyHit hit;
+        hit.index = slice->candidates[i];
+        hit.score = fuzzy_score(slice->pattern, slice->tasks->descriptions[hit.index],
+                                (size_t)slice->tasks->lengths[hit.index], NULL);
+        if (hit.score >= 0) {
+            heap_offer(&slice->heap, hit);
+        }
+    }
+    return NULL;
+}
+
+static int cmp_hits(const void *a, const void *b)
+{
+    const FuzzyHit *x = a, *y = b;
+    return hit_worse(x, y) ? 1 : hit_worse(y, x) ? -1 : 0;
+}
+
+static int rank_threads(int count)
+{
+    if (count < FUZZY_PARALLEL_MIN) {
+        return 1;
+    }
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    int threads = cpus > 0 ? (int)cpus : 1;
+    if (threads > FUZZY_MAX_THREADS) {
+        threads = FUZZY_MAX_THREADS;
+    }
+    if (threads > count / (FUZZY_PARALLEL_MIN / 2)) {
+        threads = count / (FUZZY_PARALLEL_MIN / 2);
+    }
+    return threads > 0 ? threads : 1;
+}
+
+// Score the candidate tasks and store the k best in best, highest score
+// first. Large candidate sets are split across one thread per core, each
+// keeping its own top k; only those are merged. Returns the number of
+// hits stored, or -1 when cancelled or out of memory.
+int fuzzy_rank(const FuzzyPattern *pattern, const TaskManager *tasks, const int *candidates, int count,
+               FuzzyHit *best, int k, FuzzyCancel cancel, void *ctx)
+{
+    int threads = rank_threads(count);
+    RankSlice slices[FUZZY_MAX_THREADS];
+    pthread_t ids[FUZZY_MAX_THREADS];
+    FuzzyHit *pool = malloc((size_t)threads * (size_t)k * sizeof(FuzzyHit) + 1);
+    if (!pool) {
+        return -1;
+    }
+
+    int started = 0;
+    for (int t = 0; t < threads; t++) {
+        int from = (int)((long long)count * t / threads);
+        int to = (int)((long long)count * (t + 1) / threads);
+        RankSlice *slice = &slices[t];
+        slice->pattern = pattern;
+        slice->tasks = tasks;
+        slice->candidates = candidates + from;
+        slice->count = to - from;
+        slice->heap.hits = pool + (size_t)t * (size_t)k;
+        slice->heap.count = 0;
+        slice->heap.cap = k;
+        slice->cancel = cancel;
+        slice->ctx = ctx;
+        slice->cancelled = 0;
+
+        // The first slice runs on this thread, as do slices no thread
+        // could be started for
+        if (t == 0 || pthread_create(&ids[t], NULL, rank_slice, slice) != 0) {
+            continue;
+        }
+        started |= 1 << t;
+    }
+    for (int t = 0; t < threads; t++) {
+        if (!(started & (1 << t))) {
+            rank_slice(&slices[t]);
+        }
+    }
+
+    int cancelled = 0;
+    HitHeap merged = {best, 0, k};
+    for (int t = 0; t < threads; t++) {
+        if (started & (1 << t)) {
+            pthread_join(ids[t], NULL);
+        }
+        cancelled |= slices[t].cancelled;
+        for (int i = 0; i < slices[t].heap.count; i++) {
+            heap_offer(&merged, slices[t].heap.hits[i]);
+        }
+    }
+    free(pool);
+
+    if (cancelled) {
+        return -1;
+    }
+    qsort(best, (size_t)merged.count, sizeof(FuzzyHit), cmp_hits);
+    return merged.count;
+}
@@ -0,0 +1,40 @@
+#ifndef FUZZY_H
+#define FUZZY_H
+
+#include "database.h"
+#include "match.h"
+#include <stdint.h>
+
+// Best matches kept by a fuzzy ranking
+#define FUZZY_TOP_K 1000
+
+// Below this many candidates ranking stays on the calling thread
+#define FUZZY_PARALLEL_MIN 50000
+#define FUZZY_MAX_THREADS 8
+
+// Characters of a fuzzy term (spaces dropped, lower-cased) that have to
+// appear in order, not necessarily next to each other
+typedef struct
+{
+    unsigned char chars[MATCH_MAX_TERM];
+    int len;
+    uint64_t mask;
+} FuzzyPattern;
+
+typedef struct
+{
+    int index; // into the task pool
+    int score;
+} FuzzyHit;
+
+// Returns non-zero to abandon a ranking in progress
+typedef int (*FuzzyCancel)(void *ctx);
+
+void fuzzy_pattern_init(FuzzyPattern *pattern, const char *term);
+uint64_t fuzzy_mask(const char *text, size_t len);
+int fuzzy_is_match(const FuzzyPattern *pattern, const char *text, size_t len);
+int fuzzy_score(const FuzzyPattern *pattern, const char *text, size_t len, int *positions);
+int fuzzy_rank(const FuzzyPattern *pattern, const TaskManager *tasks, const int *candidates, int count,
+               FuzzyHit *best, int k, FuzzyCancel cancel, void *ctx);
+
+#endif // FUZZY_H
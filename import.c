@@ -0,0 +1,452 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "import.h"
+#include "database.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <ctype.h>
+
+int import_parse_format(const char *name, ImportFormat *format)
+{
+    if (strcmp(name, "auto") == 0) {
+        *format = IMPORT_AUTO;
+    } else if (strcmp(name, "lines") == 0 || strcmp(name, "text") == 0) {
+        *format = IMPORT_LINES;
+    } else if (strcmp(name, "tsv") == 0) {
+        *format = IMPORT_TSV;
+    } else if (strcmp(name, "json") == 0 || strcmp(name, "ndjson") == 0) {
+        *format = IMPORT_JSON;
+    } else {
+        return -1;
+    }
+    return 0;
+}
+
+static double elapsed_seconds(const struct timespec *start)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double)(now.tv_sec - start->tv_sec) +
+           (double)(now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+// Every record's description is copied here and the task points at it.
+// Grown to the longest description seen, and freed when the import ends.
+static char *description_buf = NULL;
+static size_t description_cap = 0;
+
+// Room for a description of len bytes and its NUL, or NULL when out of memory
+static char *description_room(size_t len)
+{
+    if (len + 1 > description_cap) {
+        size_t cap = description_cap ? description_cap : 256;
+        while (cap < len + 1) {
+            cap *= 2;
+        }
+        char *buf = realloc(description_buf, cap);
+        if (!buf) {
+            return NULL;
+        }
+        description_buf = buf;
+        description_cap = cap;
+    }
+    return description_buf;
+}
+
+static int set_description(Task *task, const char *text, size_t len)
+{
+    char *room = description_room(len);
+    if (!room) {
+        return -1;
+    }
+    memcpy(room, text, len);
+    room[len] = '\0';
+    task->description = room;
+    return 0;
+}
+
+static int parse_status(const char *text, size_t len, Status *status)
+{
+    if ((len == 1 && text[0] == '1') ||
+        (len == 4 && strncasecmp(text, "done", 4) == 0) ||
+        (len == 6 && strncasecmp(text, "[done]", 6) == 0)) {
+        *status = DONE;
+    } else if (len == 0 || (len == 1 && text[0] == '0') ||
+               (len == 4 && strncasecmp(text, "todo", 4) == 0) ||
+               (len == 6 && strncasecmp(text, "[todo]", 6) == 0)) {
+        *status = TODO;
+    } else {
+        return -1;
+    }
+    return 0;
+}
+
+static int parse_created(const char *text, size_t len, time_t *created)
+{
+    if (len == 0) {
+        return 0; // keep the default
+    }
+
+    char buf[32];
+    if (len >= sizeof(buf)) {
+        return -1;
+    }
+    memcpy(buf, text, len);
+    buf[len] = '\0';
+
+    char *end;
+    long long value = strtoll(buf, &end, 10);
+    if (*end != '\0' || value < 0) {
+        return -1;
+    }
+    *created = (time_t)value;
+    return 0;
+}
+
+// description[<TAB>status[<TAB>created]]
+static int parse_tsv(const char *line, size_t len, Task *task)
+{
+    const char *end = line + len;
+    const char *tab = memchr(line, '\t', len);
+    if (set_description(task, line, (size_t)((tab ? tab : end) - line)) != 0) {
+        return -1;
+    }
+    if (!tab) {
+        return 0;
+    }
+
+    const char *field = tab + 1;
+    tab = memchr(field, '\t', (size_t)(end - field));
+    if (parse_status(field, (size_t)((tab ? tab : end) - field), &task->completed) != 0) {
+        return -1;
+    }
+    if (!tab) {
+        return 0;
+    }
+
+    field = tab + 1;
+    return parse_created(field, (size_t)(end - field), &task->created);
+}
+
+static const char *skip_ws(const char *p, const char *end)
+{
+    while (p < end && isspace((unsigned char)*p)) {
+        p++;
+    }
+    return p;
+}
+
+static void put_utf8(char *out, size_t *n, size_t cap, unsigned cp)
+{
+    char buf[4];
+    size_t len;
+    if (cp < 0x80) {
+        buf[0] = (char)cp;
+        len = 1;
+    } else if (cp < 0x800) {
+        buf[0] = (char)(0xC0 | (cp >> 6));
+        buf[1] = (char)(0x80 | (cp & 0x3F));
+        len = 2;
+    } else if (cp < 0x10000) {
+        buf[0] = (char)(0xE0 | (cp >> 12));
+        buf[1] = (char)(0x80 | ((cp >> 6) & 0x3F));
+        buf[2] = (char)(0x80 | (cp & 0x3F));
+        len = 3;
+    } else {
+        buf[0] = (char)(0xF0 | (cp >> 18));
+        buf[1] = (char)(0x80 | ((cp >> 12) & 0x3F));
+        buf[2] = (char)(0x80 | ((cp >> 6) & 0x3F));
+        buf[3] = (char)(0x80 | (cp & 0x3F));
+        len = 4;
+    }
+    if (*n + len < cap) {
+        memcpy(out + *n, buf, len);
+        *n += len;
+    }
+}
+
+static int parse_hex4(const char *p, const char *end, unsigned *value)
+{
+    if (end - p < 4) {
+        return -1;
+    }
+    *value = 0;
+    for (int i = 0; i < 4; i++) {
+        int c = (unsigned char)p[i];
+        *value <<= 4;
+        if (c >= '0' && c <= '9') {
+            *value |= (unsigned)(c - '0');
+        } else if (c >= 'a' && c <= 'f') {
+            *value |= (unsigned)(c - 'a' + 10);
+        } else if (c >= 'A' && c <= 'F') {
+            *value |= (unsigned)(c - 'A' + 10);
+        } else {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// Decode a JSON string starting at the opening quote. The decoded text is
+// written to out (truncated to cap - 1 bytes); returns the position after
+// the closing quote, or NULL on malformed input.
+static const char *parse_json_string(const char *p, const char *end, char *out, size_t cap, size_t *out_len)
+{
+    size_t n = 0;
+    p++; // opening quote
+    while (p < end && *p != '"') {
+        if (*p != '\\') {
+            if (n + 1 < cap) {
+                out[n++] = *p;
+            }
+            p++;
+            continue;
+        }
+
+        if (++p >= end) {
+            return NULL;
+        }
+        char c = *p++;
+        switch (c) {
+            case '"': case '\\': case '/':
+                if (n + 1 < cap) out[n++] = c;
+                break;
+            case 'b': if (n + 1 < cap) out[n++] = '\b'; break;
+            case 'f': if (n + 1 < cap) out[n++] = '\f'; break;
+            case 'n': if (n + 1 < cap) out[n++] = '\n'; break;
+            case 'r': if (n + 1 < cap) out[n++] = '\r'; break;
+            case 't': if (n + 1 < cap) out[n++] = '\t'; break;
+            case 'u': {
+                unsigned cp;
+                if (parse_hex4(p, end, &cp) != 0) {
+                    return NULL;
+                }
+                p += 4;
+                // Combine UTF-16 surrogate pairs
+                if (cp >= 0xD800 && cp <= 0xDBFF && end - p >= 6 && p[0] == '\\' && p[1] == 'u') {
+                    unsigned low;
+                    if (parse_hex4(p + 2, end, &low) == 0 && low >= 0xDC00 && low <= 0xDFFF) {
+                        cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+                        p += 6;
+                    }
+                }
+                put_utf8(out, &n, cap, cp);
+                break;
+            }
+            default:
+                return NULL;
+        }
+    }
+    if (p >= end) {
+        return NULL;
+    }
+
+    if (cap > 0) {
+        out[n] = '\0';
+    }
+    if (out_len) {
+        *out_len = n;
+    }
+    return p + 1;
+}
+
+// One flat object per line, e.g.
+// {"description": "Write docs", "completed": true, "created": 1721900000}
+static int parse_json(const char *line, size_t len, Task *task)
+{
+    const char *end = line + len;
+    const char *p = skip_ws(line, end);
+    int have_description = 0;
+
+    if (p >= end || *p != '{') {
+        return -1;
+    }
+    p = skip_ws(p + 1, end);
+
+    while (p < end && *p != '}') {
+        char key[32];
+        if (*p != '"' || !(p = parse_json_string(p, end, key, sizeof(key), NULL))) {
+            return -1;
+        }
+        p = skip_ws(p, end);
+        if (p >= end || *p != ':') {
+            return -1;
+        }
+        p = skip_ws(p + 1, end);
+        if (p >= end) {
+            return -1;
+        }
+
+        if (*p == '"') {
+            // A decoded string is never longer than the line, so the
+            // description is decoded straight into its buffer
+            char small[64];
+            int is_description = strcmp(key, "description") == 0;
+            char *value = is_description ? description_room(len) : small;
+            size_t value_len;
+            if (!value) {
+                return -1;
+            }
+            p = parse_json_string(p, end, value, is_description ? len + 1 : sizeof(small), &value_len);
+            if (!p) {
+                return -1;
+            }
+            if (is_description) {
+                task->description = value;
+                have_description = 1;
+            } else if (strcmp(key, "status") == 0 || strcmp(key, "completed") == 0) {
+                if (parse_status(value, value_len, &task->completed) != 0) {
+                    return -1;
+                }
+            } else if (strcmp(key, "created") == 0) {
+                if (parse_created(value, value_len, &task->created) != 0) {
+                    return -1;
+                }
+            }
+        } else {
+            // Bare literal: number, true, false or null
+            const char *start = p;
+            while (p < end && *p != ',' && *p != '}' && !isspace((unsigned char)*p)) {
+                p++;
+            }
+            size_t value_len = (size_t)(p - start);
+            if (strcmp(key, "completed") == 0 || strcmp(key, "status") == 0) {
+                if (value_len == 4 && strncmp(start, "true", 4) == 0) {
+                    task->completed = DONE;
+                } else if (value_len == 5 && strncmp(start, "false", 5) == 0) {
+                    task->completed = TODO;
+                } else if (parse_status(start, value_len, &task->completed) != 0) {
+                    return -1;
+                }
+            } else if (strcmp(key, "created") == 0) {
+                if (parse_created(start, value_len, &task->created) != 0) {
+                    return -1;
+                }
+            }
+        }
+
+        p = skip_ws(p, end);
+        if (p < end && *p == ',') {
+            p = skip_ws(p + 1, end);
+        }
+    }
+
+    return have_description ? 0 : -1;
+}
+
+static int parse_record(const char *line, size_t len, ImportFormat format, Task *task)
+{
+    if (format == IMPORT_AUTO) {
+        const char *p = skip_ws(line, line + len);
+        if (p < line + len && *p == '{') {
+            format = IMPORT_JSON;
+        } else if (memchr(line, '\t', len)) {
+            format = IMPORT_TSV;
+        } else {
+            format = IMPORT_LINES;
+        }
+    }
+
+    switch (format) {
+        case IMPORT_JSON:
+            return parse_json(line, len, task);
+        case IMPORT_TSV:
+            return parse_tsv(line, len, task);
+        default:
+            return set_description(task, line, len);
+    }
+}
+
+static int is_blank(const char *text)
+{
+    return text[strspn(text, " \t\r\n")] == '\0';
+}
+
+// Insert records in IMPORT_BATCH_SIZE transactions. IDs are allocated once
+// per batch inside the write transaction and then handed out locally; rows
+// are staged and moved into tasks with one statement per batch.
+int import_tasks(FILE *in, ImportFormat format, ImportStats *stats)
+{
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    ImportStats result = {0};
+    time_t now = time(NULL);
+    char *line = NULL;
+    size_t line_cap = 0;
+    ssize_t len;
+    long line_no = 0;
+    int in_batch = 0;
+    int batch_rows = 0;
+    int next_id = 0;
+    int rc = 0;
+
+    while ((len = getline(&line, &line_cap, in)) != -1) {
+        line_no++;
+        while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r')) {
+            line[--len] = '\0';
+        }
+        if (len == 0) {
+            continue;
+        }
+
+        Task task;
+        task.description = NULL;
+        task.completed = TODO;
+        task.created = now;
+        if (parse_record(line, (size_t)len, format, &task) != 0 || is_blank(task.description)) {
+            fprintf(stderr, "Warning: Skipping malformed record on line %ld\n", line_no);
+            result.skipped++;
+            continue;
+        }
+
+        if (!in_batch) {
+            if (db_begin() != 0) {
+                rc = -1;
+                break;
+            }
+            in_batch = 1;
+            batch_rows = 0;
+            next_id = db_get_next_id();
+        }
+
+        task.id = next_id++;
+        if (db_stage_task(&task) != 0) {
+            rc = -1;
+            break;
+        }
+        result.imported++;
+
+        if (++batch_rows == IMPORT_BATCH_SIZE) {
+            if (db_flush_staged_tasks() != 0 || db_commit() != 0) {
+                rc = -1;
+                break;
+            }
+            in_batch = 0;
+        }
+    }
+    free(line);
+    free(description_buf);
+    description_buf = NULL;
+    description_cap = 0;
+
+    if (in_batch) {
+        if (rc == 0 && (db_flush_staged_tasks() != 0 || db_commit() != 0)) {
+            rc = -1;
+        }
+        if (rc != 0) {
+            // Drop the uncommitted part of the current batch
+            result.imported -= batch_rows;
+            db_rollback();
+        }
+    }
+
+    result.seconds = elapsed_seconds(&start);
+    if (stats) {
+        *stats = result;
+    }
+    return rc;
+}
@@ -0,0 +1,27 @@
+#ifndef IMPORT_H
+#define IMPORT_H
+
+#include <stdio.h>
+
+#define IMPORT_BATCH_SIZE 50000
+
+// Input record formats accepted by taskman import
+typedef enum
+{
+    IMPORT_AUTO = 0, // detect per line: '{' => JSON, tab => TSV, else plain
+    IMPORT_LINES,    // one description per line
+    IMPORT_TSV,      // description[<TAB>status[<TAB>created]]
+    IMPORT_JSON      // one flat JSON object per line
+} ImportFormat;
+
+typedef struct
+{
+    long imported;
+    long skipped;
+    double seconds;
+} ImportStats;
+
+int import_parse_format(const char *name, ImportFormat *format);
+int import_tasks(FILE *in, ImportFormat format, ImportStats *stats);
+
+#endif // IMPORT_H
@@ -0,0 +1,266 @@
+#include "match.h"
+#include <string.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define MATCH_X86 1
+#include <immintrin.h>
+#endif
+
+typedef const char *(*FindFn)(const char *text, size_t len, const unsigned char *needle, size_t n);
+
+// ASCII lower-casing; bytes of multi-byte UTF-8 sequences are left alone
+static unsigned char fold(unsigned char c)
+{
+    return c >= 'A' && c <= 'Z' ? (unsigned char)(c | 0x20) : c;
+}
+
+static int same_folded(const char *text, const unsigned char *needle, size_t n)
+{
+    for (size_t i = 0; i < n; i++) {
+        if (fold((unsigned char)text[i]) != needle[i]) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// Plain C scan from offset start; also finishes the tail of the vector scans
+static const char *find_scalar_from(const char *text, size_t len, const unsigned char *needle,
+                                    size_t n, size_t start)
+{
+    for (size_t i = start; i + n <= len; i++) {
+        if (fold((unsigned char)text[i]) == needle[0] && same_folded(text + i + 1, needle + 1, n - 1)) {
+            return text + i;
+        }
+    }
+    return NULL;
+}
+
+static const char *find_scalar(const char *text, size_t len, const unsigned char *needle, size_t n)
+{
+    return find_scalar_from(text, len, needle, n, 0);
+}
+
+#ifdef MATCH_X86
+// Setting bit 0x20 lower-cases letters. Other bytes may collide after it
+// (e.g. '@' and '`'), which only adds candidates for the full compare.
+
+// Scan 16 offsets per step from *at. Stops at a match or when a block no
+// longer fits, leaving *at at the first offset not yet checked. Inlined
+// into both vector versions so the AVX2 one never mixes in non-VEX code.
+__attribute__((target("sse2"), always_inline))
+static inline const char *scan_16(const char *text, size_t len, const unsigned char *needle,
+                                  size_t n, size_t *at)
+{
+    const __m128i case_bit = _mm_set1_epi8(0x20);
+    const __m128i first = _mm_set1_epi8((char)(needle[0] | 0x20));
+    const __m128i last = _mm_set1_epi8((char)(needle[n - 1] | 0x20));
+    size_t i = *at;
+
+    for (; i + n - 1 + 16 <= len; i += 16) {
+        __m128i head = _mm_or_si128(_mm_loadu_si128((const __m128i *)(text + i)), case_bit);
+        __m128i tail = _mm_or_si128(_mm_loadu_si128((const __m128i *)(text + i + n - 1)), case_bit);
+        unsigned mask = (unsigned)_mm_movemask_epi8(
+            _mm_and_si128(_mm_cmpeq_epi8(head, first), _mm_cmpeq_epi8(tail, last)));
+        while (mask) {
+            size_t hit = i + (size_t)__builtin_ctz(mask);
+            if (same_folded(text + hit, needle, n)) {
+                return text + hit;
+            }
+            mask &= mask - 1;
+        }
+    }
+    *at = i;
+    return NULL;
+}
+
+__attribute__((target("sse2")))
+static const char *find_sse2(const char *text, size_t len, const unsigned char *needle, size_t n)
+{
+    size_t i = 0;
+    const char *hit = scan_16(text, len, needle, n, &i);
+    return hit ? hit : find_scalar_from(text, len, needle, n, i);
+}
+
+__attribute__((target("avx2")))
+static const char *find_avx2(const char *text, size_t len, const unsigned char *needle, size_t n)
+{
+    const __m256i case_bit = _mm256_set1_epi8(0x20);
+    const __m256i first = _mm256_set1_epi8((char)(needle[0] | 0x20));
+    const __m256i last = _mm256_set1_epi8((char)(needle[n - 1] | 0x20));
+    size_t i = 0;
+
+    for (; i + n - 1 + 32 <= len; i += 32) {
+        __m256i head = _mm256_or_si256(_mm256_loadu_si256((const __m256i *)(text + i)), case_bit);
+        __m256i tail = _mm256_or_si256(_mm256_loadu_si256((const __m256i *)(text + i + n - 1)), case_bit);
+        unsigned mask = (unsigned)_mm256_movemask_epi8(
+            _mm256_and_si256(_mm256_cmpeq_epi8(head, first), _mm256_cmpeq_epi8(tail, last)));
+        while (mask) {
+            size_t hit = i + (size_t)__builtin_ctz(mask);
+            if (same_folded(text + hit, needle, n)) {
+                return text + hit;
+            }
+            mask &= mask - 1;
+        }
+    }
+
+    // Task descriptions are short, so the rest often still fits a 16-byte step
+    const char *hit = scan_16(text, len, needle, n, &i);
+    return hit ? hit : find_scalar_from(text, len, needle, n, i);
+}
+#endif
+
+static FindFn find_impl = find_scalar;
+static MatchImpl current_impl = MATCH_IMPL_SCALAR;
+
+#ifdef MATCH_X86
+// Pick the widest implementation once, before main() starts any threads
+__attribute__((constructor))
+static void match_detect(void)
+{
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        match_set_impl(MATCH_IMPL_AVX2);
+    } else if (__builtin_cpu_supports("sse2")) {
+        match_set_impl(MATCH_IMPL_SSE2);
+    }
+}
+#endif
+
+MatchImpl match_impl(void)
+{
+    return current_impl;
+}
+
+// Force an implementation, e.g. for benchmarks. Returns -1 when the CPU or
+// the build does not support it.
+int match_set_impl(MatchImpl impl)
+{
+    switch (impl) {
+        case MATCH_IMPL_SCALAR:
+            find_impl = find_scalar;
+            break;
+#ifdef MATCH_X86
+        case MATCH_IMPL_SSE2:
+            if (!__builtin_cpu_supports("sse2")) {
+                return -1;
+            }
+            find_impl = find_sse2;
+            break;
+        case MATCH_IMPL_AVX2:
+            if (!__builtin_cpu_supports("avx2")) {
+                return -1;
+            }
+            find_impl = find_avx2;
+            break;
+#endif
+        default:
+            return -1;
+    }
+    current_impl = impl;
+    return 0;
+}
+
+const char *match_impl_name(MatchImpl impl)
+{
+    switch (impl) {
+        case MATCH_IMPL_SCALAR: return "scalar";
+        case MATCH_IMPL_SSE2: return "sse2";
+        case MATCH_IMPL_AVX2: return "avx2";
+        default: return "unknown";
+    }
+}
+
+// First occurrence of needle (already lower-cased) in text, or NULL
+const char *match_find(const char *text, size_t len, const unsigned char *needle, size_t needle_len)
+{
+    if (needle_len == 0) {
+        return text;
+    }
+    if (needle_len > len) {
+        return NULL;
+    }
+    return find_impl(text, len, needle, needle_len);
+}
+
+// Split term into lower-cased words at spaces
+void match_query_init(MatchQuery *query, const char *term)
+{
+    size_t len = strlen(term);
+    if (len >= MATCH_MAX_TERM) {
+        len = MATCH_MAX_TERM - 1;
+    }
+
+    query->count = 0;
+    size_t i = 0;
+    while (i < len) {
+        while (i < len && term[i] == ' ') {
+            i++;
+        }
+        size_t start = i;
+        while (i < len && term[i] != ' ') {
+            query->term[i] = fold((unsigned char)term[i]);
+            i++;
+        }
+        if (i > start) {
+            query->words[query->count].start = (unsigned char)start;
+            query->words[query->count].len = (unsigned char)(i - start);
+            query->count++;
+        }
+    }
+}
+
+// Every word of the query must occur in the text. Extending the term can
+// therefore only shrink the set of matches.
+int match_query_test(const MatchQuery *query, const char *text, size_t len)
+{
+    for (int w = 0; w < query->count; w++) {
+        const unsigned char *word = query->term + query->words[w].start;
+        if (!match_find(text, len, word, query->words[w].len)) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// Fill spans with every occurrence of every word, sorted by position with
+// overlapping hits merged. Returns the number of spans stored.
+int match_query_spans(const MatchQuery *query, const char *text, size_t len,
+                      MatchSpan *spans, int max_spans)
+{
+    int count = 0;
+
+    for (int w = 0; w < query->count; w++) {
+        const unsigned char *word = query->term + query->words[w].start;
+        size_t n = query->words[w].len;
+        const char *from = text;
+        const char *hit;
+
+        while (count < max_spans &&
+               (hit = match_find(from, len - (size_t)(from - text), word, n)) != NULL) {
+            // Insert in order of position
+            int at = count++;
+            while (at > 0 && spans[at - 1].start > hit - text) {
+                spans[at] = spans[at - 1];
+                at--;
+            }
+            spans[at].start = (int)(hit - text);
+            spans[at].len = (int)n;
+            from = hit + n;
+        }
+    }
+
+    int merged = 0;
+    for (int i = 0; i < count; i++) {
+        if (merged > 0 && spans[i].start <= spans[merged - 1].start + spans[merged - 1].len) {
+            int end = spans[i].start + spans[i].len;
+            int prev_end = spans[merged - 1].start + spans[merged - 1].len;
+            if (end > prev_end) {
+                spans[merged - 1].len = end - spans[merged - 1].start;
+            }
+        } else {
+            spans[merged++] = spans[i];
+        }
+    }
+    return merged;
+}
@@ -0,0 +1,45 @@
+#ifndef MATCH_H
+#define MATCH_H
+
+#include <stddef.h>
+
+// Longest search term, including its terminator
+#define MATCH_MAX_TERM 256
+
+// Case-insensitive (ASCII) substring matching. The scan uses AVX2 or SSE2
+// when the CPU has them and plain C otherwise: a vector compare of the
+// needle's first and last byte at every offset finds candidates, and only
+// those are compared in full.
+typedef enum { MATCH_IMPL_SCALAR, MATCH_IMPL_SSE2, MATCH_IMPL_AVX2 } MatchImpl;
+
+// A search term split into words. Words are stored lower-cased in term.
+typedef struct
+{
+    unsigned char term[MATCH_MAX_TERM];
+    struct
+    {
+        unsigned char start;
+        unsigned char len;
+    } words[MATCH_MAX_TERM / 2];
+    int count;
+} MatchQuery;
+
+// One occurrence of a word in the text, as a byte range
+typedef struct
+{
+    int start;
+    int len;
+} MatchSpan;
+
+const char *match_find(const char *text, size_t len, const unsigned char *needle, size_t needle_len);
+
+void match_query_init(MatchQuery *query, const char *term);
+int match_query_test(const MatchQuery *query, const char *text, size_t len);
+int match_query_spans(const MatchQuery *query, const char *text, size_t len,
+                      MatchSpan *spans, int max_spans);
+
+MatchImpl match_impl(void);
+int match_set_impl(MatchImpl impl);
+const char *match_impl_name(MatchImpl impl);
+
+#endif // MATCH_H
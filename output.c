@@ -0,0 +1,281 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "output.h"
+#include "trace.h"
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+int output_parse_format(const char *name, OutputFormat *format)
+{
+    if (strcmp(name, "table") == 0) {
+        *format = FORMAT_TABLE;
+    } else if (strcmp(name, "ndjson") == 0 || strcmp(name, "json") == 0) {
+        *format = FORMAT_NDJSON;
+    } else if (strcmp(name, "tsv") == 0) {
+        *format = FORMAT_TSV;
+    } else if (strcmp(name, "csv") == 0) {
+        *format = FORMAT_CSV;
+    } else {
+        return -1;
+    }
+    return 0;
+}
+
+void out_init(OutBuf *out, int fd)
+{
+    out->fd = fd;
+    out->len = 0;
+    out->failed = 0;
+}
+
+static void write_all(OutBuf *out, const char *data, size_t len)
+{
+    TraceSpan span = trace_begin("output.write");
+    while (len > 0 && !out->failed) {
+        ssize_t n = write(out->fd, data, len);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            out->failed = 1; // e.g. EPIPE once a pager has quit
+            break;
+        }
+        data += n;
+        len -= (size_t)n;
+    }
+    trace_end(span);
+}
+
+int out_flush(OutBuf *out)
+{
+    write_all(out, out->data, out->len);
+    out->len = 0;
+    return out->failed ? -1 : 0;
+}
+
+void out_write(OutBuf *out, const char *data, size_t len)
+{
+    if (out->len + len > sizeof(out->data)) {
+        out_flush(out);
+        if (len > sizeof(out->data)) {
+            write_all(out, data, len);
+            return;
+        }
+    }
+    memcpy(out->data + out->len, data, len);
+    out->len += len;
+}
+
+void out_puts(OutBuf *out, const char *text)
+{
+    out_write(out, text, strlen(text));
+}
+
+void out_putc(OutBuf *out, char c)
+{
+    if (out->len == sizeof(out->data)) {
+        out_flush(out);
+    }
+    out->data[out->len++] = c;
+}
+
+// Decimal digits of value written backwards into the end of buf
+static size_t format_int(char *buf, size_t size, long long value)
+{
+    unsigned long long v = value < 0 ? 0ULL - (unsigned long long)value : (unsigned long long)value;
+    size_t pos = size;
+    do {
+        buf[--pos] = (char)('0' + v % 10);
+        v /= 10;
+    } while (v);
+    if (value < 0) {
+        buf[--pos] = '-';
+    }
+    return pos;
+}
+
+void out_int(OutBuf *out, long long value)
+{
+    char buf[24];
+    size_t pos = format_int(buf, sizeof(buf), value);
+    out_write(out, buf + pos, sizeof(buf) - pos);
+}
+
+// Left-aligned text padded with spaces to width, like printf("%-*s")
+void out_pad(OutBuf *out, const char *text, int width)
+{
+    size_t len = strlen(text);
+    out_write(out, text, len);
+    for (int i = (int)len; i < width; i++) {
+        out_putc(out, ' ');
+    }
+}
+
+void out_int_pad(OutBuf *out, long long value, int width)
+{
+    char buf[24];
+    size_t pos = format_int(buf, sizeof(buf), value);
+    out_write(out, buf + pos, sizeof(buf) - pos);
+    for (int i = (int)(sizeof(buf) - pos); i < width; i++) {
+        out_putc(out, ' ');
+    }
+}
+
+void out_date(OutBuf *out, DateCache *cache, time_t when)
+{
+    if (when < cache->hour_start || when >= cache->hour_end) {
+        struct tm *tm_info = localtime(&when);
+        if (!tm_info) {
+            out_puts(out, "0000-00-00 00:00");
+            return;
+        }
+        strftime(cache->prefix, sizeof(cache->prefix), "%Y-%m-%d %H:", tm_info);
+        cache->hour_start = when - tm_info->tm_min * 60 - tm_info->tm_sec;
+        cache->hour_end = cache->hour_start + 3600;
+    }
+
+    int minute = (int)((when - cache->hour_start) / 60);
+    out_write(out, cache->prefix, strlen(cache->prefix));
+    out_putc(out, (char)('0' + minute / 10));
+    out_putc(out, (char)('0' + minute % 10));
+}
+
+static void put_2digits(char *p, int value)
+{
+    p[0] = (char)('0' + value / 10);
+    p[1] = (char)('0' + value % 10);
+}
+
+// UTC "YYYY-MM-DDTHH:MM:SSZ", computed directly from the epoch seconds
+// (days to civil date as in Howard Hinnant's date algorithms) rather than
+// through gmtime() and strftime() for every row
+void out_iso_time(OutBuf *out, time_t when)
+{
+    long long days = (long long)when / 86400;
+    long long secs = (long long)when % 86400;
+    if (secs < 0) {
+        secs += 86400;
+        days--;
+    }
+
+    days += 719468;
+    long long era = (days >= 0 ? days : days - 146096) / 146097;
+    long long doe = days - era * 146097;
+    long long yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    long long doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    long long mp = (5 * doy + 2) / 153;
+    int day = (int)(doy - (153 * mp + 2) / 5 + 1);
+    int month = (int)(mp < 10 ? mp + 3 : mp - 9);
+    long long year = yoe + era * 400 + (month <= 2);
+
+    if (year < 0 || year > 9999) {
+        out_puts(out, "0000-00-00T00:00:00Z");
+        return;
+    }
+    char buf[20] = "0000-00-00T00:00:00Z";
+    put_2digits(buf, (int)(year / 100));
+    put_2digits(buf + 2, (int)(year % 100));
+    put_2digits(buf + 5, month);
+    put_2digits(buf + 8, day);
+    put_2digits(buf + 11, (int)(secs / 3600));
+    put_2digits(buf + 14, (int)(secs / 60 % 60));
+    put_2digits(buf + 17, (int)(secs % 60));
+    out_write(out, buf, sizeof(buf));
+}
+
+// Text as a quoted JSON string. Runs of bytes that need no escaping are
+// copied in one go; UTF-8 passes through unchanged.
+void out_json_string(OutBuf *out, const char *text, size_t len)
+{
+    static const char hex[] = "0123456789abcdef";
+    out_putc(out, '"');
+    size_t start = 0;
+    for (size_t i = 0; i < len; i++) {
+        unsigned char c = (unsigned char)text[i];
+        if (c >= 0x20 && c != '"' && c != '\\') {
+            continue;
+        }
+        out_write(out, text + start, i - start);
+        start = i + 1;
+        char esc[6] = {'\\', 0};
+        switch (c) {
+            case '"': esc[1] = '"'; break;
+            case '\\': esc[1] = '\\'; break;
+            case '\n': esc[1] = 'n'; break;
+            case '\r': esc[1] = 'r'; break;
+            case '\t': esc[1] = 't'; break;
+            default:
+                memcpy(esc + 1, "u00", 3);
+                esc[4] = hex[c >> 4];
+                esc[5] = hex[c & 0xF];
+                out_write(out, esc, 6);
+                continue;
+        }
+        out_write(out, esc, 2);
+    }
+    out_write(out, text + start, len - start);
+    out_putc(out, '"');
+}
+
+// A TSV field: tabs, line breaks and backslashes become \\t, \\n, \\r and
+// \\\\, so every record stays on one line
+void out_tsv_field(OutBuf *out, const char *text, size_t len)
+{
+    static const char escapes[256] = {['\t'] = 't', ['\n'] = 'n', ['\r'] = 'r', ['\\'] = '\\'};
+    size_t start = 0;
+    for (size_t i = 0; i < len; i++) {
+        char escape = escapes[(unsigned char)text[i]];
+        if (!escape) {
+            continue;
+        }
+        out_write(out, text + start, i - start);
+        start = i + 1;
+        char esc[2] = {'\\', escape};
+        out_write(out, esc, 2);
+    }
+    out_write(out, text + start, len - start);
+}
+
+// A CSV field as in RFC 4180: quoted, with quotes doubled, when it holds
+// a comma, a quote or a line break
+void out_csv_field(OutBuf *out, const char *text, size_t len)
+{
+    static const unsigned char special[256] = {[','] = 1, ['"'] = 1, ['\n'] = 1, ['\r'] = 1};
+    size_t i = 0;
+    while (i < len && !special[(unsigned char)text[i]]) {
+        i++;
+    }
+    if (i == len) {
+        out_write(out, text, len);
+        return;
+    }
+
+    out_putc(out, '"');
+    size_t start = 0;
+    const char *quote;
+    while ((quote = memchr(text + start, '"', len - start)) != NULL) {
+        size_t end = (size_t)(quote - text) + 1;
+        out_write(out, text + start, end - start);
+        out_putc(out, '"'); // the quote again
+        start = end;
+    }
+    out_write(out, text + start, len - start);
+    out_putc(out, '"');
+}
+
+int output_is_terminal(int fd)
+{
+    return isatty(fd);
+}
+
+// Colors only go to terminals; pipes and pagers get plain text
+int output_use_color(int fd)
+{
+    const char *no_color = getenv("NO_COLOR");
+    if (no_color && *no_color) {
+        return 0;
+    }
+    return isatty(fd);
+}
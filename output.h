@@ -0,0 +1,56 @@
+#ifndef OUTPUT_H
+#define OUTPUT_H
+
+#include <stddef.h>
+#include <time.h>
+
+#define OUTPUT_BUFFER_SIZE (256 * 1024)
+
+// Buffered writer that emits output with as few write() calls as possible
+typedef struct
+{
+    int fd;
+    size_t len;
+    int failed; // set once a write fails; later output is dropped
+    char data[OUTPUT_BUFFER_SIZE];
+} OutBuf;
+
+// Formats "%Y-%m-%d %H:%M" and calls localtime() at most once per hour
+// of timestamps seen, since consecutive rows are usually close in time.
+typedef struct
+{
+    time_t hour_start;
+    time_t hour_end;
+    char prefix[16]; // "YYYY-MM-DD HH:"
+} DateCache;
+
+// How commands print tasks: the aligned table for people, or one record
+// per line for programs (NDJSON objects, or TSV/CSV rows after a header)
+typedef enum
+{
+    FORMAT_TABLE = 0,
+    FORMAT_NDJSON,
+    FORMAT_TSV,
+    FORMAT_CSV
+} OutputFormat;
+
+int output_parse_format(const char *name, OutputFormat *format);
+
+void out_init(OutBuf *out, int fd);
+int out_flush(OutBuf *out);
+void out_write(OutBuf *out, const char *data, size_t len);
+void out_puts(OutBuf *out, const char *text);
+void out_putc(OutBuf *out, char c);
+void out_int(OutBuf *out, long long value);
+void out_pad(OutBuf *out, const char *text, int width);
+void out_int_pad(OutBuf *out, long long value, int width);
+void out_date(OutBuf *out, DateCache *cache, time_t when);
+void out_iso_time(OutBuf *out, time_t when);
+void out_json_string(OutBuf *out, const char *text, size_t len);
+void out_tsv_field(OutBuf *out, const char *text, size_t len);
+void out_csv_field(OutBuf *out, const char *text, size_t len);
+
+int output_is_terminal(int fd);
+int output_use_color(int fd);
+
+#endif // OUTPUT_H
@@ -0,0 +1,211 @@
+#include "protocol.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+void proto_buf_free(ProtoBuf *buf)
+{
+    free(buf->data);
+    memset(buf, 0, sizeof(*buf));
+}
+
+// Drop bytes from the front, e.g. frames that were handled or sent
+void proto_buf_consume(ProtoBuf *buf, size_t bytes)
+{
+    if (bytes >= buf->len) {
+        buf->len = 0;
+        return;
+    }
+    memmove(buf->data, buf->data + bytes, buf->len - bytes);
+    buf->len -= bytes;
+}
+
+// Append extra uninitialized bytes and return where they start
+unsigned char *proto_reserve(ProtoBuf *buf, size_t extra)
+{
+    if (buf->failed) {
+        return NULL;
+    }
+    if (buf->len + extra > buf->cap) {
+        size_t cap = buf->cap ? buf->cap : 4096;
+        while (cap < buf->len + extra) {
+            cap *= 2;
+        }
+        unsigned char *data = realloc(buf->data, cap);
+        if (!data) {
+            buf->failed = 1;
+            return NULL;
+        }
+        buf->data = data;
+        buf->cap = cap;
+    }
+    unsigned char *at = buf->data + buf->len;
+    buf->len += extra;
+    return at;
+}
+
+static void put_be32(unsigned char *p, uint32_t value)
+{
+    p[0] = (unsigned char)(value >> 24);
+    p[1] = (unsigned char)(value >> 16);
+    p[2] = (unsigned char)(value >> 8);
+    p[3] = (unsigned char)value;
+}
+
+uint32_t proto_get_u32(const unsigned char *p)
+{
+    return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+}
+
+int64_t proto_get_i64(const unsigned char *p)
+{
+    return (int64_t)((uint64_t)proto_get_u32(p) << 32 | proto_get_u32(p + 4));
+}
+
+// Start a frame; returns its offset for proto_end()
+size_t proto_begin(ProtoBuf *buf, ProtoOp op, uint32_t id)
+{
+    size_t start = buf->len;
+    unsigned char *header = proto_reserve(buf, PROTO_HEADER_SIZE);
+    if (header) {
+        memset(header, 0, PROTO_HEADER_SIZE);
+        header[4] = (unsigned char)op;
+        put_be32(header + 8, id);
+    }
+    return start;
+}
+
+void proto_put_u8(ProtoBuf *buf, uint8_t value)
+{
+    unsigned char *p = proto_reserve(buf, 1);
+    if (p) {
+        *p = value;
+    }
+}
+
+void proto_put_u32(ProtoBuf *buf, uint32_t value)
+{
+    unsigned char *p = proto_reserve(buf, 4);
+    if (p) {
+        put_be32(p, value);
+    }
+}
+
+void proto_put_i64(ProtoBuf *buf, int64_t value)
+{
+    proto_put_u32(buf, (uint32_t)((uint64_t)value >> 32));
+    proto_put_u32(buf, (uint32_t)value);
+}
+
+void proto_put_bytes(ProtoBuf *buf, const void *data, size_t len)
+{
+    unsigned char *p = proto_reserve(buf, len);
+    if (p && len > 0) {
+        memcpy(p, data, len);
+    }
+}
+
+// Fill in the payload length of the frame started at start
+int proto_end(ProtoBuf *buf, size_t start)
+{
+    if (buf->failed) {
+        return -1;
+    }
+    size_t payload = buf->len - start - PROTO_HEADER_SIZE;
+    if (payload > PROTO_MAX_PAYLOAD) {
+        buf->len = start;
+        return -1;
+    }
+    put_be32(buf->data + start, (uint32_t)payload);
+    return 0;
+}
+
+void proto_put_row(ProtoBuf *buf, uint32_t id, const TaskRow *row)
+{
+    size_t start = proto_begin(buf, PROTO_ROW, id);
+    proto_put_u32(buf, (uint32_t)row->id);
+    proto_put_u8(buf, (uint8_t)row->completed);
+    proto_put_i64(buf, (int64_t)row->created);
+    proto_put_bytes(buf, row->description, (size_t)row->description_len);
+    proto_end(buf, start);
+}
+
+// A whole task as one field of a larger payload
+void proto_put_task(ProtoBuf *buf, const Task *task)
+{
+    size_t len = task->description ? strlen(task->description) : 0;
+    proto_put_u32(buf, (uint32_t)task->id);
+    proto_put_u8(buf, (uint8_t)task->completed);
+    proto_put_i64(buf, (int64_t)task->created);
+    proto_put_u32(buf, (uint32_t)len);
+    proto_put_bytes(buf, task->description, len);
+}
+
+// Decode the frame at the start of data. Returns its total size, 0 when
+// more bytes are needed, or -1 when the stream is corrupt.
+long proto_parse(const unsigned char *data, size_t len, ProtoFrame *frame)
+{
+    if (len < PROTO_HEADER_SIZE) {
+        return 0;
+    }
+    uint32_t payload = proto_get_u32(data);
+    if (payload > PROTO_MAX_PAYLOAD) {
+        return -1;
+    }
+    if (len < PROTO_HEADER_SIZE + (size_t)payload) {
+        return 0;
+    }
+    frame->op = (ProtoOp)data[4];
+    frame->id = proto_get_u32(data + 8);
+    frame->payload = data + PROTO_HEADER_SIZE;
+    frame->len = payload;
+    return (long)(PROTO_HEADER_SIZE + payload);
+}
+
+// The description points into the frame and lives as long as it does
+int proto_get_row(const ProtoFrame *frame, TaskRow *row)
+{
+    if (frame->op != PROTO_ROW || frame->len < 13) {
+        return -1;
+    }
+    row->id = (int)proto_get_u32(frame->payload);
+    row->completed = frame->payload[4] ? DONE : TODO;
+    row->created = (time_t)proto_get_i64(frame->payload + 5);
+    row->description = (const char *)frame->payload + 13;
+    row->description_len = (int)(frame->len - 13);
+    return 0;
+}
+
+// Read a task written by proto_put_task, with the description malloc'd
+// (see task_clear()). Returns the bytes it took up, or -1 when data is too
+// short or out of memory.
+long proto_get_task(const unsigned char *data, size_t len, Task *task)
+{
+    if (len < 17) {
+        return -1;
+    }
+    uint32_t description_len = proto_get_u32(data + 13);
+    if (len - 17 < description_len) {
+        return -1;
+    }
+    task->description = malloc((size_t)description_len + 1);
+    if (!task->description) {
+        return -1;
+    }
+    task->id = (int)proto_get_u32(data);
+    task->completed = data[4] ? DONE : TODO;
+    task->created = (time_t)proto_get_i64(data + 5);
+    memcpy(task->description, data + 17, description_len);
+    task->description[description_len] = '\0';
+    return 17 + (long)description_len;
+}
+
+// The daemon listens next to the database: ~/.taskman/taskmand.sock
+int proto_socket_path(char *path, size_t size)
+{
+    const char *db_path = db_get_path();
+    const char *slash = strrchr(db_path, '/');
+    int dir_len = slash ? (int)(slash - db_path) : 1;
+    int len = snprintf(path, size, "%.*s/taskmand.sock", dir_len, slash ? db_path : ".");
+    return len > 0 && (size_t)len < size ? 0 : -1;
+}
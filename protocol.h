@@ -0,0 +1,79 @@
+#ifndef PROTOCOL_H
+#define PROTOCOL_H
+
+#include "database.h"
+#include <stddef.h>
+#include <stdint.h>
+
+// Wire format spoken between taskman and taskmand over a Unix socket.
+//
+// Every message is a frame: a 12-byte header (payload length, opcode,
+// three bytes of padding, request id; integers big-endian) followed by
+// the payload. Clients may send any number of requests without waiting;
+// the daemon answers them in order, tagging each response frame with the
+// id of the request it belongs to.
+#define PROTO_HEADER_SIZE 12
+#define PROTO_MAX_PAYLOAD (1024 * 1024)
+
+typedef enum
+{
+    // Requests
+    PROTO_PING = 1,
+    PROTO_ADD,    // description                      -> OK(id)
+    PROTO_GET,    // u32 id                            -> ROW? END
+    PROTO_LIST,   // u8 pending_only, u32 after, limit -> ROW* END, or ERROR
+                  //                                      when no task has ID after
+    PROTO_DONE,   // u32 id                            -> OK(affected)
+    PROTO_DELETE, // u32 id                            -> OK(affected)
+    PROTO_EDIT,   // u32 id, description               -> OK(affected)
+    PROTO_SEARCH, // term                              -> ROW* END
+    PROTO_STATUS, //                                   -> OK(total, completed, prepared, reused,
+                  //                                         oldest pending task, newest task)
+
+    // Responses
+    PROTO_OK = 0x80,
+    PROTO_ROW,   // u32 id, u8 completed, i64 created, description
+                 // (inside a payload: the same with a u32 length before the description)
+    PROTO_END,
+    PROTO_ERROR, // message
+} ProtoOp;
+
+// Growable byte buffer that frames are built in and read from
+typedef struct
+{
+    unsigned char *data;
+    size_t len;
+    size_t cap;
+    int failed; // set when memory ran out; the buffer is then unusable
+} ProtoBuf;
+
+// A frame decoded in place; payload points into the receive buffer
+typedef struct
+{
+    ProtoOp op;
+    uint32_t id;
+    const unsigned char *payload;
+    uint32_t len;
+} ProtoFrame;
+
+void proto_buf_free(ProtoBuf *buf);
+void proto_buf_consume(ProtoBuf *buf, size_t bytes);
+unsigned char *proto_reserve(ProtoBuf *buf, size_t extra);
+size_t proto_begin(ProtoBuf *buf, ProtoOp op, uint32_t id);
+void proto_put_u8(ProtoBuf *buf, uint8_t value);
+void proto_put_u32(ProtoBuf *buf, uint32_t value);
+void proto_put_i64(ProtoBuf *buf, int64_t value);
+void proto_put_bytes(ProtoBuf *buf, const void *data, size_t len);
+int proto_end(ProtoBuf *buf, size_t start);
+void proto_put_row(ProtoBuf *buf, uint32_t id, const TaskRow *row);
+void proto_put_task(ProtoBuf *buf, const Task *task);
+
+long proto_parse(const unsigned char *data, size_t len, ProtoFrame *frame);
+uint32_t proto_get_u32(const unsigned char *p);
+int64_t proto_get_i64(const unsigned char *p);
+int proto_get_row(const ProtoFrame *frame, TaskRow *row);
+long proto_get_task(const unsigned char *data, size_t len, Task *task);
+
+int proto_socket_path(char *path, size_t size);
+
+#endif // PROTOCOL_H
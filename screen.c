@@ -0,0 +1,230 @@
+#include "screen.h"
+#include <errno.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+static int grow(void **ptr, size_t *cap, size_t needed, size_t elem_size)
+{
+    if (needed <= *cap) {
+        return 0;
+    }
+    size_t new_cap = *cap ? *cap : 64;
+    while (new_cap < needed) {
+        new_cap *= 2;
+    }
+    void *grown = realloc(*ptr, new_cap * elem_size);
+    if (!grown) {
+        return -1;
+    }
+    *ptr = grown;
+    *cap = new_cap;
+    return 0;
+}
+
+static void frame_free(Frame *frame)
+{
+    free(frame->text);
+    free(frame->starts);
+    free(frame->lengths);
+    memset(frame, 0, sizeof(*frame));
+}
+
+static int frame_reserve_line(Frame *frame)
+{
+    size_t cap = (size_t)frame->cap;
+    size_t lengths_cap = cap;
+    if (grow((void **)&frame->starts, &cap, (size_t)frame->count + 1, sizeof(size_t)) != 0 ||
+        grow((void **)&frame->lengths, &lengths_cap, (size_t)frame->count + 1, sizeof(size_t)) != 0) {
+        return -1;
+    }
+    frame->cap = (int)(cap < lengths_cap ? cap : lengths_cap);
+    return 0;
+}
+
+void screen_init(Screen *screen, int fd)
+{
+    memset(screen, 0, sizeof(*screen));
+    screen->fd = fd;
+    screen->full_redraw = 1;
+}
+
+void screen_free(Screen *screen)
+{
+    frame_free(&screen->frames[0]);
+    frame_free(&screen->frames[1]);
+    free(screen->out);
+    screen->out = NULL;
+    screen->out_len = screen->out_cap = 0;
+}
+
+static Frame *back_frame(Screen *screen)
+{
+    return &screen->frames[!screen->front];
+}
+
+void screen_begin(Screen *screen)
+{
+    Frame *frame = back_frame(screen);
+    frame->text_len = 0;
+    frame->count = 0;
+}
+
+// Append raw bytes to the last line of the frame being built
+static void frame_append(Frame *frame, const char *text, size_t len)
+{
+    if (grow((void **)&frame->text, &frame->text_cap, frame->text_len + len, 1) != 0) {
+        return;
+    }
+    memcpy(frame->text + frame->text_len, text, len);
+    frame->text_len += len;
+    frame->lengths[frame->count - 1] += len;
+}
+
+void screen_line(Screen *screen, const char *text, size_t len)
+{
+    Frame *frame = back_frame(screen);
+    if (frame_reserve_line(frame) != 0) {
+        return;
+    }
+    frame->starts[frame->count] = frame->text_len;
+    frame->lengths[frame->count] = 0;
+    frame->count++;
+    frame_append(frame, text, len);
+}
+
+static void frame_vappend(Frame *frame, const char *fmt, va_list args)
+{
+    char small[512];
+    va_list copy;
+    va_copy(copy, args);
+    int len = vsnprintf(small, sizeof(small), fmt, copy);
+    va_end(copy);
+    if (len < 0) {
+        return;
+    }
+
+    if ((size_t)len < sizeof(small)) {
+        frame_append(frame, small, (size_t)len);
+        return;
+    }
+
+    char *big = malloc((size_t)len + 1);
+    if (!big) {
+        return;
+    }
+    vsnprintf(big, (size_t)len + 1, fmt, args);
+    frame_append(frame, big, (size_t)len);
+    free(big);
+}
+
+// Start a new line formatted like printf (without the trailing newline)
+void screen_printf(Screen *screen, const char *fmt, ...)
+{
+    screen_line(screen, "", 0);
+    va_list args;
+    va_start(args, fmt);
+    frame_vappend(back_frame(screen), fmt, args);
+    va_end(args);
+}
+
+// Add formatted text to the end of the current line
+void screen_append(Screen *screen, const char *fmt, ...)
+{
+    Frame *frame = back_frame(screen);
+    if (frame->count == 0) {
+        screen_line(screen, "", 0);
+    }
+    va_list args;
+    va_start(args, fmt);
+    frame_vappend(frame, fmt, args);
+    va_end(args);
+}
+
+static void emit(Screen *screen, const char *data, size_t len)
+{
+    if (grow((void **)&screen->out, &screen->out_cap, screen->out_len + len, 1) != 0) {
+        return;
+    }
+    memcpy(screen->out + screen->out_len, data, len);
+    screen->out_len += len;
+}
+
+static void emit_goto(Screen *screen, int row)
+{
+    char seq[32];
+    int len = snprintf(seq, sizeof(seq), "\033[%d;1H", row + 1);
+    emit(screen, seq, (size_t)len);
+}
+
+static int line_equal(const Frame *a, int ia, const Frame *b, int ib)
+{
+    return a->lengths[ia] == b->lengths[ib] &&
+           memcmp(a->text + a->starts[ia], b->text + b->starts[ib], a->lengths[ia]) == 0;
+}
+
+// Diff the new frame against the one on screen and write the changes
+int screen_present(Screen *screen)
+{
+    Frame *next = back_frame(screen);
+    Frame *prev = &screen->frames[screen->front];
+    screen->out_len = 0;
+
+    if (screen->full_redraw) {
+        emit(screen, "\033[2J", 4);
+    }
+
+    for (int i = 0; i < next->count; i++) {
+        if (!screen->full_redraw && i < prev->count && line_equal(next, i, prev, i)) {
+            continue;
+        }
+        emit_goto(screen, i);
+        emit(screen, next->text + next->starts[i], next->lengths[i]);
+        emit(screen, "\033[0m\033[K", 7);
+    }
+
+    // Blank out rows left over from a longer previous frame
+    if (!screen->full_redraw) {
+        for (int i = next->count; i < prev->count; i++) {
+            emit_goto(screen, i);
+            emit(screen, "\033[K", 3);
+        }
+    }
+
+    // Park the cursor below the frame
+    if (screen->out_len > 0) {
+        emit_goto(screen, next->count);
+    }
+
+    // Anything still buffered by stdio has to reach the terminal first
+    fflush(stdout);
+
+    size_t done = 0;
+    int rc = 0;
+    while (done < screen->out_len) {
+        ssize_t n = write(screen->fd, screen->out + done, screen->out_len - done);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            rc = -1;
+            break;
+        }
+        done += (size_t)n;
+    }
+
+    screen->last_bytes = done;
+    screen->total_bytes += done;
+    screen->frames_drawn++;
+    screen->front = !screen->front;
+    screen->full_redraw = 0;
+    return rc;
+}
+
+// Forget what is on the terminal, e.g. after other output overwrote it
+void screen_invalidate(Screen *screen)
+{
+    screen->full_redraw = 1;
+}
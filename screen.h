@@ -0,0 +1,44 @@
+#ifndef SCREEN_H
+#define SCREEN_H
+
+#include <stddef.h>
+
+// One frame of terminal output, stored as lines in a single text buffer
+typedef struct
+{
+    char *text;
+    size_t text_len;
+    size_t text_cap;
+    size_t *starts;
+    size_t *lengths;
+    int count;
+    int cap;
+} Frame;
+
+// Double-buffered renderer: a frame is built in memory, compared with the
+// frame currently on the terminal, and only the lines that changed are
+// redrawn, all flushed with a single write().
+typedef struct
+{
+    Frame frames[2];
+    int front;       // index of the frame currently on the terminal
+    int full_redraw; // next present clears the screen and draws everything
+    int fd;
+    char *out;
+    size_t out_len;
+    size_t out_cap;
+    size_t last_bytes;  // bytes written by the most recent present
+    size_t total_bytes;
+    int frames_drawn;
+} Screen;
+
+void screen_init(Screen *screen, int fd);
+void screen_free(Screen *screen);
+void screen_begin(Screen *screen);
+void screen_line(Screen *screen, const char *text, size_t len);
+void screen_printf(Screen *screen, const char *fmt, ...);
+void screen_append(Screen *screen, const char *fmt, ...);
+int screen_present(Screen *screen);
+void screen_invalidate(Screen *screen);
+
+#endif // SCREEN_H
@@ -1,46 +1,43 @@
+#define _DEFAULT_SOURCE
+
 #include "search.h"
+#include "match.h"
+#include "fuzzy.h"
+#include "trace.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/ioctl.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <termios.h>
 #include <unistd.h>
 #include <time.h>
-#include <ctype.h>
 
 static struct termios orig_termios;
+static volatile sig_atomic_t window_resized = 0;
 
-// Case-insensitive string comparison (portable implementation)
-int strncasecmp(const char *s1, const char *s2, size_t n)
-{
-    while (n-- > 0) {
-        int c1 = tolower((unsigned char)*s1++);
-        int c2 = tolower((unsigned char)*s2++);
-        if (c1 != c2) return c1 - c2;
-        if (c1 == '\0') return 0;
-    }
-    return 0;
-}
+// Keys are read in chunks, so a paste or a burst of typing costs one
+// read() and is handled before the next frame is drawn
+static unsigned char input_buf[256];
+static int input_len = 0;
+static int input_pos = 0;
+static int input_closed = 0;
 
-// Case-insensitive string search (portable implementation)
-char *strcasestr(const char *haystack, const char *needle)
-{
-    if (!haystack || !needle) return NULL;
-    if (*needle == '\0') return (char *)haystack;
-    
-    size_t needle_len = strlen(needle);
-    for (const char *p = haystack; *p; p++) {
-        if (strncasecmp(p, needle, needle_len) == 0) {
-            return (char *)p;
-        }
-    }
-    return NULL;
-}
+// How long to wait for the rest of an escape sequence before treating
+// ESC as a key of its own
+#define ESC_TIMEOUT_MS 25
+// Highlighted matches shown per task; the rows are cut to the screen width
+#define SEARCH_MAX_SPANS 256
 
 void enable_raw_mode(void)
 {
     tcgetattr(STDIN_FILENO, &orig_termios);
     struct termios raw = orig_termios;
-    raw.c_lflag &= ~(ECHO | ICANON);
+    // Ctrl+C arrives as a key so search can restore the terminal itself
+    raw.c_lflag &= ~(ECHO | ICANON | ISIG);
     raw.c_cc[VMIN] = 1;
     raw.c_cc[VTIME] = 0;
     tcsetattr(STDIN_FILENO, TCSAFLUSH, &raw);
@@ -49,239 +46,993 @@ void enable_raw_mode(void)
 void disable_raw_mode(void)
 {
     tcsetattr(STDIN_FILENO, TCSAFLUSH, &orig_termios);
+    input_len = input_pos = 0;
+}
+
+static int input_pending(void)
+{
+    return input_pos < input_len;
+}
+
+// Whether stdin has been closed (getch() then keeps returning -1)
+int input_eof(void)
+{
+    return input_closed;
 }
 
 int getch(void)
 {
-    int ch;
-    if (read(STDIN_FILENO, &ch, 1) == 1) {
+    if (!input_pending()) {
+        ssize_t n = read(STDIN_FILENO, input_buf, sizeof(input_buf));
+        if (n <= 0) {
+            if (n == 0 || errno != EINTR) {
+                input_closed = 1;
+            }
+            return -1;
+        }
+        input_len = (int)n;
+        input_pos = 0;
+    }
+    return input_buf[input_pos++];
+}
+
+// Whether more input arrives within timeout_ms
+static int input_ready(int timeout_ms)
+{
+    if (input_pending()) {
+        return 1;
+    }
+    struct pollfd pfd = {STDIN_FILENO, POLLIN, 0};
+    return poll(&pfd, 1, timeout_ms) > 0;
+}
+
+// Read one key press, decoding the escape sequences for navigation keys.
+// A lone ESC is returned as KEY_ESC.
+int read_key(void)
+{
+    int ch = getch();
+    if (ch != KEY_ESC) {
         return ch;
     }
-    return -1;
+
+    if (!input_ready(ESC_TIMEOUT_MS)) {
+        return KEY_ESC;
+    }
+    int next = getch();
+    if (next != '[' && next != 'O') {
+        return KEY_ESC;
+    }
+
+    int code = getch();
+    switch (code) {
+        case 'A': return KEY_UP;
+        case 'B': return KEY_DOWN;
+        case 'H': return KEY_HOME;
+        case 'F': return KEY_END;
+    }
+
+    // Sequences of the form ESC [ <digit> ~
+    if (next == '[' && code >= '1' && code <= '8' && getch() == '~') {
+        switch (code) {
+            case '1': case '7': return KEY_HOME;
+            case '4': case '8': return KEY_END;
+            case '5': return KEY_PAGE_UP;
+            case '6': return KEY_PAGE_DOWN;
+        }
+    }
+    return KEY_NONE;
 }
 
-void display_search_results(const TaskManager *tm, const char *search_term, int highlight_index)
+static void handle_sigwinch(int sig)
 {
-    printf(CLEAR_SCREEN MOVE_CURSOR_HOME);
-    printf("TaskMan Interactive Search\n");
-    printf("==========================\n");
-    printf("Search: %s%s\n", search_term, strlen(search_term) > 0 ? "_" : "_");
-    printf("Press ESC to exit, Enter to select, Ctrl+C to cancel\n\n");
+    (void)sig;
+    window_resized = 1;
+}
+
+// Terminal size, falling back to 80x24 when stdout is not a terminal
+void viewport_measure(Viewport *view)
+{
+    struct winsize ws;
+    view->rows = 24;
+    view->cols = 80;
+    if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) == 0 && ws.ws_row > 0 && ws.ws_col > 0) {
+        view->rows = ws.ws_row;
+        view->cols = ws.ws_col;
+    }
+}
+
+// Number of result rows that fit between the header and the footer
+int viewport_height(const Viewport *view)
+{
+    int height = view->rows - SEARCH_HEADER_LINES - SEARCH_FOOTER_LINES;
+    return height > 1 ? height : 1;
+}
+
+// Scroll just enough to keep the highlighted row visible
+void viewport_follow(Viewport *view, int highlight_index, int count)
+{
+    int height = viewport_height(view);
+    if (highlight_index < view->top) {
+        view->top = highlight_index;
+    } else if (highlight_index >= view->top + height) {
+        view->top = highlight_index - height + 1;
+    }
+    if (view->top > count - height) {
+        view->top = count - height;
+    }
+    if (view->top < 0) {
+        view->top = 0;
+    }
+}
+
+// Longest prefix of text that fits in width columns, without splitting a
+// UTF-8 sequence (wide characters are counted as one column)
+int clip_to_width(const char *text, int width)
+{
+    int bytes = 0;
+    int cols = 0;
+    while (text[bytes] && cols < width) {
+        bytes++;
+        while ((text[bytes] & 0xC0) == 0x80) {
+            bytes++;
+        }
+        cols++;
+    }
+    return bytes;
+}
+
+// Append the first len bytes of text with the matched spans in bold yellow
+static void append_highlighted(Screen *screen, const char *text, int len,
+                               const MatchSpan *spans, int span_count)
+{
+    int at = 0;
+    for (int i = 0; i < span_count && spans[i].start < len; i++) {
+        int end = spans[i].start + spans[i].len;
+        if (end > len) {
+            end = len;
+        }
+        screen_append(screen, "%.*s\033[1;33m%.*s\033[0m", spans[i].start - at, text + at,
+                      end - spans[i].start, text + spans[i].start);
+        at = end;
+    }
+    screen_append(screen, "%.*s", len - at, text + at);
+}
+
+// Spans of the characters a fuzzy pattern matched, runs joined together
+static int fuzzy_spans(const FuzzyPattern *pattern, const char *text, int len, MatchSpan *spans)
+{
+    int positions[MATCH_MAX_TERM];
+    if (fuzzy_score(pattern, text, (size_t)len, positions) < 0) {
+        return 0;
+    }
+
+    int count = 0;
+    for (int i = 0; i < pattern->len; i++) {
+        if (count > 0 && spans[count - 1].start + spans[count - 1].len == positions[i]) {
+            spans[count - 1].len++;
+        } else {
+            spans[count].start = positions[i];
+            spans[count].len = 1;
+            count++;
+        }
+    }
+    return count;
+}
+
+void display_search_results(Screen *screen, const TaskManager *pool, const int *matches, int count,
+                            const char *search_term, int highlight_index, const Viewport *view,
+                            int fuzzy, const char *status)
+{
+    MatchQuery query;
+    FuzzyPattern pattern;
+    MatchSpan spans[SEARCH_MAX_SPANS];
+    match_query_init(&query, search_term);
+    fuzzy_pattern_init(&pattern, search_term);
+
+    screen_begin(screen);
+    screen_printf(screen, "TaskMan Interactive Search");
+    screen_printf(screen, "==========================");
+    screen_printf(screen, "%s: %s_", fuzzy ? "Fuzzy search" : "Search", search_term);
+    screen_printf(screen, "Press ESC to exit, Enter to select, Ctrl+F for %s matching, Ctrl+C to cancel",
+                  fuzzy ? "exact" : "fuzzy");
+    screen_printf(screen, "%s", status ? status : "");
     
-    if (tm->count == 0) {
+    if (count == 0) {
         if (strlen(search_term) == 0) {
-            printf("Start typing to search for tasks...\n");
+            screen_printf(screen, "Start typing to search for tasks...");
         } else {
-            printf("No tasks found matching '%s'\n", search_term);
+            screen_printf(screen, "No tasks found matching '%s'", search_term);
         }
+        screen_present(screen);
         return;
     }
     
-    printf("%-4s %-8s %-20s %s\n", "ID", "Status", "Created", "Description");
-    printf("------------------------------------------------------------\n");
+    screen_printf(screen, "%-4s %-8s %-20s %s", "ID", "Status", "Created", "Description");
+    screen_printf(screen, "------------------------------------------------------------");
     
-    for (int i = 0; i < tm->count; i++) {
-        const Task *task = &tm->tasks[i];
+    // Only the rows inside the viewport are formatted
+    int end = view->top + viewport_height(view);
+    if (end > count) {
+        end = count;
+    }
+    for (int i = view->top; i < end; i++) {
+        int task = matches[i];
+        const char *description = pool->descriptions[task];
         char time_str[20];
-        struct tm *tm_info = localtime(&task->created);
+        struct tm *tm_info = localtime(&pool->created[task]);
         strftime(time_str, sizeof(time_str), "%Y-%m-%d %H:%M", tm_info);
+
+        char id_str[16];
+        int id_width = snprintf(id_str, sizeof(id_str), "%-4d", pool->ids[task]);
+        int room = view->cols - id_width - 31; // status, date and separators
+        int desc_len = clip_to_width(description, room > 0 ? room : 0);
         
-        // Highlight the selected task
-        if (i == highlight_index) {
-            printf("\033[7m"); // Reverse video
+        // Highlight the selected task with reverse video
+        screen_printf(screen, "%s%s \033[0;%sm%-8s\033[0m %-20s ",
+                      i == highlight_index ? "\033[7m" : "",
+                      id_str,
+                      pool->status[task] == DONE ? "32" : "33",
+                      pool->status[task] == DONE ? "[DONE]" : "[TODO]",
+                      time_str);
+
+        // Mark every occurrence of the search words, or the characters
+        // a fuzzy match picked, in the description
+        int span_count = fuzzy ? fuzzy_spans(&pattern, description, pool->lengths[task], spans)
+                               : match_query_spans(&query, description, (size_t)pool->lengths[task], spans,
+                                                   SEARCH_MAX_SPANS);
+        append_highlighted(screen, description, desc_len, spans, span_count);
+    }
+    
+    screen_printf(screen, "");
+    if (end - view->top < count) {
+        screen_printf(screen, "Showing %d-%d of %d task(s). ↑/↓ PgUp/PgDn Home/End to navigate, Enter to select.",
+                      view->top + 1, end, count);
+    } else {
+        screen_printf(screen, "Found %d task(s). Use ↑/↓ arrows to navigate, Enter to select.", count);
+    }
+    screen_present(screen);
+}
+
+// Every whitespace-separated word of the term must occur in the text.
+// Extending the term can therefore only shrink the set of matches.
+int task_matches_term(const char *text, const char *search_term)
+{
+    MatchQuery query;
+    match_query_init(&query, search_term);
+    return match_query_test(&query, text, strlen(text));
+}
+
+static double now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+// Whether the UI has posted a newer term (or is quitting) since gen
+static int session_superseded(SearchSession *session, unsigned gen)
+{
+    pthread_mutex_lock(&session->lock);
+    int superseded = session->quit || session->want_gen != gen;
+    pthread_mutex_unlock(&session->lock);
+    return superseded;
+}
+
+// Narrow level base down to the tasks matching term. Runs without the
+// lock and gives up (returning -1) as soon as a newer term is posted.
+static int session_filter(SearchSession *session, int base, const char *term, unsigned gen,
+                          SearchLevel *to)
+{
+    const SearchLevel *from = &session->levels[base];
+    MatchQuery query;
+    FuzzyPattern pattern;
+    match_query_init(&query, term);
+    fuzzy_pattern_init(&pattern, term);
+
+    to->count = 0;
+    to->matches = from->count > 0 ? malloc((size_t)from->count * sizeof(int)) : NULL;
+    if (from->count > 0 && !to->matches) {
+        return -1;
+    }
+    for (int i = 0; i < from->count; i++) {
+        if ((i & 4095) == 4095 && session_superseded(session, gen)) {
+            free(to->matches);
+            to->matches = NULL;
+            return -1;
         }
-        
-        printf("%-4d \033[0;%sm%-8s\033[0m %-20s %s",
-               task->id,
-               task->completed == DONE ? "32" : "33",
-               task->completed == DONE ? "[DONE]" : "[TODO]",
-               time_str,
-               task->description);
-        
-        if (i == highlight_index) {
-            printf("\033[0m"); // Reset formatting
+        int index = from->matches[i];
+        const char *description = session->pool.descriptions[index];
+        size_t len = (size_t)session->pool.lengths[index];
+        int matched;
+        if (session->fuzzy) {
+            // The character set test rejects most tasks before the scan
+            matched = (session->masks[index] & pattern.mask) == pattern.mask &&
+                      fuzzy_is_match(&pattern, description, len);
+        } else {
+            matched = match_query_test(&query, description, len);
+        }
+        if (matched) {
+            to->matches[to->count++] = index;
         }
-        printf("\n");
     }
-    
-    printf("\nFound %d task(s). Use ↑/↓ arrows to navigate, Enter to select.\n", tm->count);
+    return 0;
 }
 
-void highlight_search_term(const char *text, const char *search_term)
+// Deepest computed level at or below depth
+static int session_base(const SearchSession *session, int depth)
 {
-    if (strlen(search_term) == 0) {
-        printf("%s", text);
-        return;
+    while (depth > 0 && session->levels[depth].count == SEARCH_LEVEL_SKIPPED) {
+        depth--;
     }
-    
-    char *found = strcasestr(text, search_term);
-    if (!found) {
-        printf("%s", text);
+    return depth;
+}
+
+static const SearchLevel *session_results(const SearchSession *session)
+{
+    if (session->fuzzy && session->depth > 0) {
+        return &session->ranked;
+    }
+    return &session->levels[session_base(session, session->depth)];
+}
+
+// Lets fuzzy_rank() threads check whether their work is still wanted
+typedef struct
+{
+    SearchSession *session;
+    unsigned gen;
+} RankJob;
+
+static int rank_superseded(void *ctx)
+{
+    RankJob *job = ctx;
+    return session_superseded(job->session, job->gen);
+}
+
+// Order the matches of the current level by fuzzy score, best first.
+// Runs without the lock; returns -1 when a newer term was posted.
+static int session_rank(SearchSession *session, const char *term, unsigned gen, SearchLevel *ranked)
+{
+    const SearchLevel *level = &session->levels[session->depth];
+    FuzzyPattern pattern;
+    fuzzy_pattern_init(&pattern, term);
+
+    FuzzyHit *hits = malloc(FUZZY_TOP_K * sizeof(FuzzyHit));
+    ranked->matches = malloc(FUZZY_TOP_K * sizeof(int));
+    ranked->count = 0;
+    RankJob job = {session, gen};
+    int count = hits && ranked->matches
+                    ? fuzzy_rank(&pattern, &session->pool, level->matches, level->count, hits,
+                                 FUZZY_TOP_K, rank_superseded, &job)
+                    : -1;
+    for (int i = 0; i < count; i++) {
+        ranked->matches[ranked->count++] = hits[i].index;
+    }
+    free(hits);
+    if (count < 0) {
+        free(ranked->matches);
+        ranked->matches = NULL;
+        return -1;
+    }
+    return 0;
+}
+
+// Switch the levels to the other matching mode. Called with the lock held.
+static int session_set_mode(SearchSession *session, int fuzzy)
+{
+    for (int level = 1; level <= session->depth; level++) {
+        free(session->levels[level].matches);
+        session->levels[level].matches = NULL;
+        session->levels[level].count = 0;
+    }
+    session->depth = 0;
+    session->term[0] = '\0';
+    free(session->ranked.matches);
+    session->ranked.matches = NULL;
+    session->ranked.count = 0;
+    session->fuzzy = fuzzy;
+
+    if (fuzzy && !session->masks && session->pool.count > 0) {
+        session->masks = malloc((size_t)session->pool.count * sizeof(uint64_t));
+        if (!session->masks) {
+            session->fuzzy = 0;
+            return -1;
+        }
+        for (int i = 0; i < session->pool.count; i++) {
+            session->masks[i] = fuzzy_mask(session->pool.descriptions[i], (size_t)session->pool.lengths[i]);
+        }
+    }
+    return 0;
+}
+
+// Pop the levels that do not lead to term. Called with the lock held;
+// returns the level to filter from.
+static int session_unwind(SearchSession *session, const char *term)
+{
+    int shared = 0;
+    while (shared < session->depth && term[shared] == session->term[shared]) {
+        shared++;
+    }
+    for (int level = shared + 1; level <= session->depth; level++) {
+        free(session->levels[level].matches);
+        session->levels[level].matches = NULL;
+        session->levels[level].count = 0;
+    }
+    session->depth = shared;
+    session->term[shared] = '\0';
+    return session_base(session, shared);
+}
+
+// Make the results for term visible to the UI. Called with the lock held.
+static void session_publish(SearchSession *session, const char *term, int base, SearchLevel *results)
+{
+    int len = (int)strlen(term);
+    if (base < len) {
+        for (int level = session->depth + 1; level < len; level++) {
+            session->levels[level].count = SEARCH_LEVEL_SKIPPED;
+        }
+        session->levels[len] = *results;
+    }
+    session->depth = len;
+    memcpy(session->term, term, (size_t)len + 1);
+}
+
+static void session_notify(SearchSession *session)
+{
+    char byte = 1;
+    // A full pipe already holds a wake-up, so a failed write is fine
+    if (write(session->notify[1], &byte, 1) < 0) {
         return;
     }
-    
-    // Print text before match
-    printf("%.*s", (int)(found - text), text);
-    // Print highlighted match
-    printf("\033[1;33m%.*s\033[0m", (int)strlen(search_term), found);
-    // Print text after match (recursively highlight remaining matches)
-    highlight_search_term(found + strlen(search_term), search_term);
 }
 
-void interactive_search(void)
+static int session_load(SearchSession *session)
 {
-    char search_term[MAX_TASK_LENGTH] = {0};
-    int search_len = 0;
-    int highlight_index = 0;
-    TaskManager search_results = {0};
-    
+    TaskManager pool = {0};
+    if (db_reader_load_tasks(session->reader, &pool) != 0) {
+        tm_free(&pool);
+        return -1;
+    }
+
+    SearchLevel all;
+    all.count = pool.count;
+    all.matches = all.count > 0 ? malloc((size_t)all.count * sizeof(int)) : NULL;
+    if (all.count > 0 && !all.matches) {
+        tm_free(&pool);
+        return -1;
+    }
+    for (int i = 0; i < all.count; i++) {
+        all.matches[i] = i;
+    }
+
+    pthread_mutex_lock(&session->lock);
+    session->pool = pool;
+    session->levels[0] = all;
+    pthread_mutex_unlock(&session->lock);
+    return 0;
+}
+
+// Load the tasks, then keep answering the latest posted term. Terms
+// posted while a filter runs cancel it, so a burst of keystrokes costs
+// one filter for the final term rather than one per character.
+static void *search_worker(void *arg)
+{
+    SearchSession *session = arg;
+    TraceSpan span = trace_begin("search.load");
+    int loaded = session_load(session) == 0;
+    trace_end(span);
+
+    pthread_mutex_lock(&session->lock);
+    session->state = loaded ? SEARCH_READY : SEARCH_FAILED;
+    pthread_cond_broadcast(&session->idle);
+    session_notify(session);
+
+    while (loaded && !session->quit) {
+        if (session->want_gen == session->done_gen) {
+            pthread_cond_wait(&session->wake, &session->lock);
+            continue;
+        }
+
+        unsigned gen = session->want_gen;
+        char term[SEARCH_MAX_TERM];
+        memcpy(term, session->want, sizeof(term));
+        if (session->want_fuzzy != session->fuzzy) {
+            session_set_mode(session, session->want_fuzzy);
+        }
+        int base = session_unwind(session, term);
+
+        SearchLevel results = {NULL, 0};
+        if (base < (int)strlen(term)) {
+            pthread_mutex_unlock(&session->lock);
+            span = trace_begin("search.filter");
+            int rc = session_filter(session, base, term, gen, &results);
+            trace_end(span);
+            pthread_mutex_lock(&session->lock);
+            if (rc != 0) {
+                continue;
+            }
+        }
+
+        session_publish(session, term, base, &results);
+
+        // Only the few best fuzzy matches are put in order
+        if (session->fuzzy && session->depth > 0) {
+            SearchLevel ranked;
+            pthread_mutex_unlock(&session->lock);
+            span = trace_begin("search.rank");
+            int rc = session_rank(session, term, gen, &ranked);
+            trace_end(span);
+            pthread_mutex_lock(&session->lock);
+            if (rc != 0) {
+                continue;
+            }
+            free(session->ranked.matches);
+            session->ranked = ranked;
+        }
+        session->done_gen = gen;
+        pthread_cond_broadcast(&session->idle);
+        session_notify(session);
+    }
+
+    pthread_mutex_unlock(&session->lock);
+    return NULL;
+}
+
+// Hand the latest term and matching mode to the worker
+static void session_post(SearchSession *session, const char *term)
+{
+    pthread_mutex_lock(&session->lock);
+    memcpy(session->want, term, strlen(term) + 1);
+    session->want_fuzzy = session->use_fuzzy;
+    session->want_gen++;
+    pthread_cond_signal(&session->wake);
+    pthread_mutex_unlock(&session->lock);
+}
+
+// Block until the worker has caught up with the last posted term.
+// Returns 0 once the session is ready, -1 if loading failed.
+static int session_wait(SearchSession *session)
+{
+    pthread_mutex_lock(&session->lock);
+    while (session->state == SEARCH_LOADING ||
+           (session->state == SEARCH_READY && session->want_gen != session->done_gen)) {
+        pthread_cond_wait(&session->idle, &session->lock);
+    }
+    int rc = session->state == SEARCH_READY ? 0 : -1;
+    pthread_mutex_unlock(&session->lock);
+    return rc;
+}
+
+static int session_open(SearchSession *session)
+{
+    memset(session, 0, sizeof(*session));
+    session->latency_ms = -1;
+    session->reader = db_reader_open();
+    if (!session->reader) {
+        return -1;
+    }
+    if (pipe(session->notify) != 0) {
+        db_reader_close(session->reader);
+        return -1;
+    }
+    fcntl(session->notify[0], F_SETFL, O_NONBLOCK);
+    fcntl(session->notify[1], F_SETFL, O_NONBLOCK);
+    pthread_mutex_init(&session->lock, NULL);
+    pthread_cond_init(&session->wake, NULL);
+    pthread_cond_init(&session->idle, NULL);
+    screen_init(&session->screen, STDOUT_FILENO);
+    viewport_measure(&session->view);
+
+    // Resizes must interrupt the UI's poll(), not land on the worker
+    sigset_t block, old;
+    sigemptyset(&block);
+    sigaddset(&block, SIGWINCH);
+    pthread_sigmask(SIG_BLOCK, &block, &old);
+    int rc = pthread_create(&session->worker, NULL, search_worker, session);
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+
+    if (rc != 0) {
+        close(session->notify[0]);
+        close(session->notify[1]);
+        db_reader_close(session->reader);
+        return -1;
+    }
+    return 0;
+}
+
+static void session_close(SearchSession *session)
+{
+    pthread_mutex_lock(&session->lock);
+    session->quit = 1;
+    pthread_cond_signal(&session->wake);
+    pthread_mutex_unlock(&session->lock);
+
+    // Leaving while the tasks are still loading aborts the query
+    db_reader_interrupt(session->reader);
+    pthread_join(session->worker, NULL);
+    db_reader_close(session->reader);
+
+    for (int i = 0; i <= session->depth; i++) {
+        free(session->levels[i].matches);
+    }
+    free(session->ranked.matches);
+    free(session->masks);
+    tm_free(&session->pool);
+    screen_free(&session->screen);
+    close(session->notify[0]);
+    close(session->notify[1]);
+    pthread_cond_destroy(&session->idle);
+    pthread_cond_destroy(&session->wake);
+    pthread_mutex_destroy(&session->lock);
+}
+
+// Drop a deleted task from every computed level, keeping the order of the
+// rest. Only called while the worker is idle.
+static void session_forget(SearchSession *session, int index)
+{
+    pthread_mutex_lock(&session->lock);
+    for (int level = -1; level <= session->depth; level++) {
+        SearchLevel *results = level < 0 ? &session->ranked : &session->levels[level];
+        int kept = 0;
+        for (int i = 0; i < results->count; i++) {
+            if (results->matches[i] != index) {
+                results->matches[kept++] = results->matches[i];
+            }
+        }
+        if (results->count != SEARCH_LEVEL_SKIPPED) {
+            results->count = kept;
+        }
+    }
+    pthread_mutex_unlock(&session->lock);
+}
+
+// Throw away the narrowed levels after the description of task index
+// changed and have the worker recompute the current one. Only called
+// while it is idle.
+static void session_refilter(SearchSession *session, int index)
+{
+    pthread_mutex_lock(&session->lock);
+    if (session->masks) {
+        session->masks[index] = fuzzy_mask(session->pool.descriptions[index], (size_t)session->pool.lengths[index]);
+    }
+    for (int level = 1; level <= session->depth; level++) {
+        free(session->levels[level].matches);
+        session->levels[level].matches = NULL;
+        session->levels[level].count = SEARCH_LEVEL_SKIPPED;
+    }
+    pthread_mutex_unlock(&session->lock);
+    session_post(session, session->typed);
+}
+
+// Number of results currently on offer to the UI
+static int session_count(SearchSession *session)
+{
+    pthread_mutex_lock(&session->lock);
+    int count = session_results(session)->count;
+    pthread_mutex_unlock(&session->lock);
+    return count;
+}
+
+static void show_session(SearchSession *session)
+{
+    char status[128] = "";
+    TraceSpan span = trace_begin("search.frame");
+
+    pthread_mutex_lock(&session->lock);
+    const SearchLevel *results = session_results(session);
+    int current = session->want_gen == session->done_gen;
+
+    if (session->state == SEARCH_LOADING) {
+        snprintf(status, sizeof(status), "Loading tasks...");
+    } else if (!current) {
+        snprintf(status, sizeof(status), "Searching...");
+    } else {
+        // The first frame showing the answer to a keystroke ends its latency
+        if (session->key_ms > 0) {
+            session->latency_ms = now_ms() - session->key_ms;
+            session->key_ms = 0;
+        }
+        if (session->latency_ms >= 0) {
+            snprintf(status, sizeof(status), "Keystroke to frame: %.1f ms", session->latency_ms);
+        }
+        int total = session->levels[session->depth].count;
+        if (session->fuzzy && session->depth > 0 && total > results->count) {
+            size_t used = strlen(status);
+            snprintf(status + used, sizeof(status) - used, "%s %d of %d matches",
+                     used ? ", best" : "Best", results->count, total);
+        }
+    }
+
+    if (session->highlight >= results->count) {
+        session->highlight = results->count > 0 ? results->count - 1 : 0;
+    }
+    viewport_follow(&session->view, session->highlight, results->count);
+    display_search_results(&session->screen, &session->pool, results->matches, results->count,
+                           session->typed, session->highlight, &session->view,
+                           session->use_fuzzy, status[0] ? status : NULL);
+    pthread_mutex_unlock(&session->lock);
+    trace_end(span);
+}
+
+// Wait for a key, a resize or new results from the worker. Returns 1 when
+// a key can be read, 0 when only the screen needs redrawing.
+static int wait_for_input(SearchSession *session)
+{
+    struct pollfd fds[2] = {
+        {STDIN_FILENO, POLLIN, 0},
+        {session->notify[0], POLLIN, 0},
+    };
+
+    if (poll(fds, 2, -1) < 0) {
+        return 0; // interrupted by SIGWINCH
+    }
+    if (fds[1].revents & POLLIN) {
+        char drain[64];
+        while (read(session->notify[0], drain, sizeof(drain)) > 0) {
+        }
+    }
+    return (fds[0].revents & (POLLIN | POLLHUP)) != 0;
+}
+
+// Show the selected task and run the chosen action.
+// Returns 1 to go back to the search screen, 0 to leave search.
+static int task_actions(SearchSession *session, int index)
+{
+    TaskManager *pool = &session->pool;
+    int id = pool->ids[index];
+    char time_str[20];
+    struct tm *tm_info = localtime(&pool->created[index]);
+    strftime(time_str, sizeof(time_str), "%Y-%m-%d %H:%M", tm_info);
+
+    printf("Selected Task:\n");
+    printf("==============\n");
+    printf("ID: %d\n", id);
+    printf("Status: %s\n", pool->status[index] == DONE ? "DONE" : "TODO");
+    printf("Created: %s\n", time_str);
+    printf("Description: %s\n\n", pool->descriptions[index]);
+
+    printf("What would you like to do?\n");
+    printf("1. Mark as %s\n", pool->status[index] == DONE ? "TODO" : "DONE");
+    printf("2. Edit description\n");
+    printf("3. Delete task\n");
+    printf("4. Return to search\n");
+    printf("5. Exit\n");
+    printf("Choice (1-5): ");
+
+    char choice = getchar();
+    getchar(); // consume newline
+
+    switch (choice) {
+        case '1': {
+            Status status = pool->status[index] == DONE ? TODO : DONE;
+            if (db_set_task_status(id, status) > 0) {
+                pool->status[index] = (unsigned char)status;
+                printf("Task status updated!\n");
+            }
+            break;
+        }
+        case '2': {
+            printf("Enter new description: ");
+            char *new_desc = NULL;
+            size_t cap = 0;
+            ssize_t len = getline(&new_desc, &cap, stdin);
+            if (len >= 0) {
+                // Remove newline
+                new_desc[strcspn(new_desc, "\n")] = 0;
+                if (db_set_task_description(id, new_desc) > 0 &&
+                    tm_set_description(pool, index, new_desc, strlen(new_desc)) == 0) {
+                    printf("Task description updated!\n");
+                    session_refilter(session, index);
+                }
+            }
+            free(new_desc);
+            break;
+        }
+        case '3':
+            printf("Are you sure you want to delete this task? (y/n): ");
+            char confirm = getchar();
+            getchar(); // consume newline
+            if (confirm == 'y' || confirm == 'Y') {
+                if (db_delete_task(id) > 0) {
+                    printf("Task deleted!\n");
+                    session_forget(session, index);
+                }
+            }
+            break;
+        case '4':
+            return 1;
+        case '5':
+            break;
+    }
+    return 0;
+}
+
+// Leave the search screen and put the terminal back the way it was
+static void leave_search(SearchSession *session, const struct sigaction *old_sa, const char *message)
+{
+    printf(SHOW_CURSOR);
+    disable_raw_mode();
+    if (message) {
+        printf(CLEAR_SCREEN MOVE_CURSOR_HOME);
+        printf("%s\n", message);
+    }
+    session_close(session);
+    sigaction(SIGWINCH, old_sa, NULL);
+}
+
+void interactive_search(int fuzzy)
+{
+    SearchSession session;
+
+    if (session_open(&session) != 0) {
+        fprintf(stderr, "Error: Could not start search\n");
+        return;
+    }
+    session.use_fuzzy = fuzzy;
+
+    // Without SA_RESTART a resize interrupts the blocking poll
+    struct sigaction sa, old_sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = handle_sigwinch;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGWINCH, &sa, &old_sa);
+
     printf(HIDE_CURSOR);
     enable_raw_mode();
-    
-    // Initial display
-    if (db_load_tasks(&search_results) == 0) {
-        display_search_results(&search_results, search_term, highlight_index);
-    }
-    
+
+    int redraw = 1;
+    int posted = 1;
+
     while (1) {
-        int ch = getch();
+        // Draw only once all buffered keys are handled, so a burst of
+        // input produces one posted term and one frame
+        if (!input_pending()) {
+            if (!posted) {
+                session_post(&session, session.typed);
+                posted = 1;
+            }
+            if (window_resized) {
+                window_resized = 0;
+                viewport_measure(&session.view);
+                screen_invalidate(&session.screen);
+                redraw = 1;
+            }
+            if (redraw) {
+                show_session(&session);
+                redraw = 0;
+            }
+
+            pthread_mutex_lock(&session.lock);
+            int failed = session.state == SEARCH_FAILED;
+            pthread_mutex_unlock(&session.lock);
+            if (failed) {
+                leave_search(&session, &old_sa, "Error: Could not load tasks for search");
+                return;
+            }
+
+            if (!wait_for_input(&session)) {
+                redraw = 1;
+                continue;
+            }
+        }
+
+        int ch = read_key();
+        int count = session_count(&session);
+        int page = viewport_height(&session.view);
+        int last = count > 0 ? count - 1 : 0;
+
+        if (ch < 0 && input_closed) {
+            break;
+        }
         
         switch (ch) {
             case KEY_ESC:
-                // Check if this is an arrow key sequence
+                goto cleanup;
+
+            case KEY_UP:
+            case KEY_DOWN:
+            case KEY_PAGE_UP:
+            case KEY_PAGE_DOWN:
+            case KEY_HOME:
+            case KEY_END:
                 {
-                    int next_ch = getch();
-                    if (next_ch == 91) { // [
-                        int arrow = getch();
-                        switch (arrow) {
-                            case 65: // Up arrow
-                                if (highlight_index > 0) {
-                                    highlight_index--;
-                                    display_search_results(&search_results, search_term, highlight_index);
-                                }
-                                break;
-                            case 66: // Down arrow
-                                if (highlight_index < search_results.count - 1) {
-                                    highlight_index++;
-                                    display_search_results(&search_results, search_term, highlight_index);
-                                }
-                                break;
-                        }
-                    } else {
-                        // True ESC key, exit
-                        goto cleanup;
+                    int target = session.highlight;
+                    switch (ch) {
+                        case KEY_UP: target--; break;
+                        case KEY_DOWN: target++; break;
+                        case KEY_PAGE_UP: target -= page; break;
+                        case KEY_PAGE_DOWN: target += page; break;
+                        case KEY_HOME: target = 0; break;
+                        case KEY_END: target = last; break;
+                    }
+                    if (target > last) {
+                        target = last;
+                    }
+                    if (target < 0) {
+                        target = 0;
+                    }
+                    if (target != session.highlight) {
+                        session.highlight = target;
+                        redraw = 1;
                     }
                 }
                 break;
                 
             case KEY_CTRL_C:
-                printf(SHOW_CURSOR);
-                disable_raw_mode();
+                leave_search(&session, &old_sa, NULL);
                 printf("\nSearch cancelled.\n");
                 return;
                 
             case KEY_ENTER:
-                if (search_results.count > 0 && highlight_index < search_results.count) {
+                // Act on the results for everything typed so far
+                if (!posted) {
+                    session_post(&session, session.typed);
+                    posted = 1;
+                }
+                if (session_wait(&session) != 0) {
+                    break;
+                }
+                {
+                    const SearchLevel *results = session_results(&session);
+                    if (results->count == 0 || session.highlight >= results->count) {
+                        redraw = 1;
+                        break;
+                    }
+
                     printf(SHOW_CURSOR);
                     disable_raw_mode();
                     printf(CLEAR_SCREEN MOVE_CURSOR_HOME);
                     
-                    // Display selected task details
-                    Task *selected = &search_results.tasks[highlight_index];
-                    char time_str[20];
-                    struct tm *tm_info = localtime(&selected->created);
-                    strftime(time_str, sizeof(time_str), "%Y-%m-%d %H:%M", tm_info);
-                    
-                    printf("Selected Task:\n");
-                    printf("==============\n");
-                    printf("ID: %d\n", selected->id);
-                    printf("Status: %s\n", selected->completed == DONE ? "DONE" : "TODO");
-                    printf("Created: %s\n", time_str);
-                    printf("Description: %s\n\n", selected->description);
-                    
-                    printf("What would you like to do?\n");
-                    printf("1. Mark as %s\n", selected->completed == DONE ? "TODO" : "DONE");
-                    printf("2. Edit description\n");
-                    printf("3. Delete task\n");
-                    printf("4. Return to search\n");
-                    printf("5. Exit\n");
-                    printf("Choice (1-5): ");
-                    
-                    char choice = getchar();
-                    getchar(); // consume newline
-                    
-                    switch (choice) {
-                        case '1':
-                            selected->completed = (selected->completed == DONE) ? TODO : DONE;
-                            if (db_update_task(selected) == 0) {
-                                printf("Task status updated!\n");
-                            }
-                            break;
-                        case '2':
-                            printf("Enter new description: ");
-                            char new_desc[MAX_TASK_LENGTH];
-                            if (fgets(new_desc, sizeof(new_desc), stdin)) {
-                                // Remove newline
-                                new_desc[strcspn(new_desc, "\n")] = 0;
-                                strncpy(selected->description, new_desc, MAX_TASK_LENGTH - 1);
-                                selected->description[MAX_TASK_LENGTH - 1] = '\0';
-                                if (db_update_task(selected) == 0) {
-                                    printf("Task description updated!\n");
-                                }
-                            }
-                            break;
-                        case '3':
-                            printf("Are you sure you want to delete this task? (y/n): ");
-                            char confirm = getchar();
-                            getchar(); // consume newline
-                            if (confirm == 'y' || confirm == 'Y') {
-                                if (db_delete_task(selected->id) == 0) {
-                                    printf("Task deleted!\n");
-                                }
-                            }
-                            break;
-                        case '4':
-                            interactive_search();
-                            return;
-                        case '5':
-                            return;
+                    if (task_actions(&session, results->matches[session.highlight])) {
+                        // Return to search with the session still loaded
+                        session.highlight = 0;
+                        screen_invalidate(&session.screen);
+                        printf(HIDE_CURSOR);
+                        enable_raw_mode();
+                        redraw = 1;
+                        break;
                     }
+                    session_close(&session);
+                    sigaction(SIGWINCH, &old_sa, NULL);
                     return;
                 }
-                break;
                 
+            case KEY_CTRL_F:
+                session.use_fuzzy = !session.use_fuzzy;
+                session.highlight = 0;
+                if (session.key_ms == 0) {
+                    session.key_ms = now_ms();
+                }
+                posted = 0;
+                redraw = 1;
+                break;
+
             case KEY_BACKSPACE:
-                if (search_len > 0) {
-                    search_len--;
-                    search_term[search_len] = '\0';
-                    highlight_index = 0;
-                    
-                    if (strlen(search_term) == 0) {
-                        db_load_tasks(&search_results);
-                    } else {
-                        db_search_tasks(&search_results, search_term);
+                if (session.typed_len > 0) {
+                    session.typed[--session.typed_len] = '\0';
+                    session.highlight = 0;
+                    if (session.key_ms == 0) {
+                        session.key_ms = now_ms();
                     }
-                    display_search_results(&search_results, search_term, highlight_index);
+                    posted = 0;
+                    redraw = 1;
                 }
                 break;
                 
             default:
-                if (ch >= 32 && ch <= 126 && search_len < MAX_TASK_LENGTH - 1) {
-                    search_term[search_len] = ch;
-                    search_len++;
-                    search_term[search_len] = '\0';
-                    highlight_index = 0;
-                    
-                    db_search_tasks(&search_results, search_term);
-                    display_search_results(&search_results, search_term, highlight_index);
+                if (ch >= 32 && ch <= 126 && session.typed_len < SEARCH_MAX_TERM - 1) {
+                    session.typed[session.typed_len++] = (char)ch;
+                    session.typed[session.typed_len] = '\0';
+                    session.highlight = 0;
+                    if (session.key_ms == 0) {
+                        session.key_ms = now_ms();
+                    }
+                    posted = 0;
+                    redraw = 1;
                 }
                 break;
         }
     }
     
 cleanup:
-    printf(SHOW_CURSOR);
-    disable_raw_mode();
-    printf(CLEAR_SCREEN MOVE_CURSOR_HOME);
-    printf("Search exited.\n");
+    leave_search(&session, &old_sa, "Search exited.");
 }
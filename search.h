@@ -2,6 +2,9 @@
 #define SEARCH_H
 
 #include "database.h"
+#include "screen.h"
+#include <pthread.h>
+#include <stdint.h>
 
 // Terminal control sequences
 #define CLEAR_SCREEN "\033[2J"
@@ -17,10 +20,102 @@
 #define KEY_ESC 27
 #define KEY_BACKSPACE 127
 #define KEY_CTRL_C 3
+#define KEY_CTRL_F 6
+
+// Decoded navigation keys returned by read_key()
+#define KEY_NONE -2
+#define KEY_UP 1001
+#define KEY_DOWN 1002
+#define KEY_PAGE_UP 1003
+#define KEY_PAGE_DOWN 1004
+#define KEY_HOME 1005
+#define KEY_END 1006
+
+// Fixed lines around the result rows in the search screen
+#define SEARCH_HEADER_LINES 7
+#define SEARCH_FOOTER_LINES 3
+
+// Visible window of the result list
+typedef struct
+{
+    int rows;
+    int cols;
+    int top; // index of the first result shown
+} Viewport;
+
+// One step of an interactive search: indices into the session's task
+// pool that match the first N characters of the search term. A count of
+// SEARCH_LEVEL_SKIPPED marks a level that was passed over while typing
+// fast; it is computed if backspace ever lands on it.
+typedef struct
+{
+    int *matches;
+    int count;
+} SearchLevel;
+
+#define SEARCH_LEVEL_SKIPPED -1
+
+// Bytes of search term the UI accepts
+#define SEARCH_MAX_TERM 256
+
+typedef enum { SEARCH_LOADING, SEARCH_READY, SEARCH_FAILED } SearchState;
+
+// State of an interactive search. Tasks are loaded once by a worker
+// thread on its own connection; each new term narrows the deepest level
+// it extends in memory and backspace pops back to a level below.
+//
+// In fuzzy mode the levels hold every task containing the term's
+// characters in order, and the best FUZZY_TOP_K of the current level are
+// ranked into ranked, which is what the UI shows.
+//
+// The worker owns the pool and the levels while it is busy. The UI reads
+// them under lock and only changes them once the worker is idle.
+typedef struct
+{
+    TaskManager pool;
+    SearchLevel levels[SEARCH_MAX_TERM];
+    int depth;
+    char term[SEARCH_MAX_TERM]; // term the levels were computed for
+    SearchState state;
+    int fuzzy;                  // mode the levels were computed in
+    SearchLevel ranked;
+    uint64_t *masks;            // fuzzy_mask() of every pool task, built on first use
+
+    pthread_t worker;
+    pthread_mutex_t lock;
+    pthread_cond_t wake; // new term posted or quitting
+    pthread_cond_t idle; // worker published results
+    DbReader *reader;
+    int notify[2];       // pipe the worker writes to after publishing
+    int quit;
+    char want[SEARCH_MAX_TERM]; // latest term posted by the UI
+    int want_fuzzy;
+    unsigned want_gen;
+    unsigned done_gen;
+
+    // UI thread only
+    Screen screen;
+    Viewport view;
+    char typed[SEARCH_MAX_TERM];
+    int typed_len;
+    int use_fuzzy;
+    int highlight;
+    double key_ms;     // first keystroke not yet answered on screen
+    double latency_ms; // keystroke-to-frame time of the last search
+} SearchSession;
 
 // Search function
-void interactive_search(void);
-void display_search_results(const TaskManager *tm, const char *search_term, int highlight_index);
+void interactive_search(int fuzzy);
+void display_search_results(Screen *screen, const TaskManager *pool, const int *matches, int count,
+                            const char *search_term, int highlight_index, const Viewport *view,
+                            int fuzzy, const char *status);
+int read_key(void);
+int input_eof(void);
+int clip_to_width(const char *text, int width);
+void viewport_measure(Viewport *view);
+int viewport_height(const Viewport *view);
+void viewport_follow(Viewport *view, int highlight_index, int count);
+int task_matches_term(const char *text, const char *search_term);
 int getch(void);
 void enable_raw_mode(void);
 void disable_raw_mode(void);
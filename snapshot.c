@@ -0,0 +1,554 @@
+#define _POSIX_C_SOURCE 200809L
+#define _DARWIN_C_SOURCE
+
+#include "snapshot.h"
+#include "trace.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifdef __APPLE__
+#define st_mtim st_mtimespec
+#endif
+
+#define SNAPSHOT_MAGIC "TMSNAP02"
+// File mtimes come from a coarse clock, so a change made within this long
+// of building the snapshot may not show in the stamp; such snapshots are
+// checked against the database before they are trusted
+#define SNAPSHOT_RACY_NS 50000000LL
+// Syncing prunes the change log once it may hold this many tasks (one per
+// generation since the last prune). A prune that is skipped is retried by
+// the next sync.
+#define SNAPSHOT_PRUNE_AT 1024
+
+// Columns being assembled for a new snapshot file
+typedef struct
+{
+    int64_t *created;
+    int32_t *ids;
+    uint32_t *offsets;
+    uint8_t *status;
+    char *text;
+    int count;
+    int capacity;
+    size_t text_len;
+    size_t text_capacity;
+    int failed;
+} Builder;
+
+typedef struct
+{
+    int64_t created;
+    int id;
+    int index;
+} RowKey;
+
+static void snapshot_path(char *path, size_t size)
+{
+    const char *db_path = db_get_path();
+    size_t len = strlen(db_path);
+    if (len > 3 && strcmp(db_path + len - 3, ".db") == 0) {
+        len -= 3;
+    }
+    snprintf(path, size, "%.*s.snap", (int)len, db_path);
+}
+
+static void stamp_file(const char *path, SnapshotStamp *stamp)
+{
+    struct stat st;
+    memset(stamp, 0, sizeof(*stamp));
+    if (stat(path, &st) == 0) {
+        stamp->dev = (int64_t)st.st_dev;
+        stamp->ino = (int64_t)st.st_ino;
+        stamp->size = (int64_t)st.st_size;
+        stamp->mtime_ns = (int64_t)st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+    }
+}
+
+// tasks.db and its WAL; every commit changes one of them
+static void stamp_database(SnapshotStamp *db, SnapshotStamp *wal)
+{
+    char path[600];
+    snprintf(path, sizeof(path), "%s-wal", db_get_path());
+    stamp_file(db_get_path(), db);
+    stamp_file(path, wal);
+}
+
+static int64_t wall_clock_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static size_t snapshot_size(size_t count, size_t text_size)
+{
+    return SNAPSHOT_HEADER_SIZE + count * (sizeof(int64_t) + sizeof(int32_t) + 2 * sizeof(uint32_t) + 1) +
+           sizeof(uint32_t) + text_size;
+}
+
+void snapshot_close(Snapshot *snap)
+{
+    if (snap->map) {
+        munmap(snap->map, snap->size);
+    }
+    memset(snap, 0, sizeof(*snap));
+}
+
+// Map a snapshot file and point the columns into it. Only the header and
+// the sizes are checked; the file is only ever written whole and renamed
+// into place.
+static int snapshot_map(Snapshot *snap, const char *path)
+{
+    memset(snap, 0, sizeof(*snap));
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return -1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < SNAPSHOT_HEADER_SIZE) {
+        close(fd);
+        return -1;
+    }
+    void *map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        return -1;
+    }
+
+    snap->map = map;
+    snap->size = (size_t)st.st_size;
+    const SnapshotHeader *header = map;
+    size_t count = header->count;
+    if (memcmp(header->magic, SNAPSHOT_MAGIC, sizeof(header->magic)) != 0 || count > INT32_MAX ||
+        snapshot_size(count, header->text_size) != snap->size) {
+        snapshot_close(snap);
+        return -1;
+    }
+
+    snap->header = header;
+    snap->count = (int)count;
+    snap->created = (const int64_t *)(snap->map + SNAPSHOT_HEADER_SIZE);
+    snap->ids = (const int32_t *)(snap->created + count);
+    snap->offsets = (const uint32_t *)(snap->ids + count);
+    snap->by_id = snap->offsets + count + 1;
+    snap->status = (const uint8_t *)(snap->by_id + count);
+    snap->text = (const char *)(snap->status + count);
+    if (snap->offsets[count] != header->text_size) {
+        snapshot_close(snap);
+        return -1;
+    }
+    return 0;
+}
+
+// Map the snapshot without touching the database. Returns 0 when it is
+// known to be current, 1 when it is mapped but may be stale (to be
+// settled by snapshot_sync()), -1 when there is no usable snapshot.
+int snapshot_open(Snapshot *snap)
+{
+    TraceSpan span = trace_begin("snapshot.open");
+    char path[600];
+    snapshot_path(path, sizeof(path));
+    if (snapshot_map(snap, path) != 0) {
+        trace_end(span);
+        return -1;
+    }
+
+    SnapshotStamp db, wal;
+    stamp_database(&db, &wal);
+    const SnapshotHeader *header = snap->header;
+    int current = memcmp(&db, &header->db, sizeof(db)) == 0 && memcmp(&wal, &header->wal, sizeof(wal)) == 0 &&
+                  db.mtime_ns + SNAPSHOT_RACY_NS < header->built_ns &&
+                  wal.mtime_ns + SNAPSHOT_RACY_NS < header->built_ns;
+    trace_end(span);
+    return current ? 0 : 1;
+}
+
+static void builder_free(Builder *b)
+{
+    free(b->created);
+    free(b->ids);
+    free(b->offsets);
+    free(b->status);
+    free(b->text);
+    memset(b, 0, sizeof(*b));
+}
+
+static void builder_add(Builder *b, int id, int completed, int64_t created, const char *text, size_t len)
+{
+    if (b->failed) {
+        return;
+    }
+    if (b->count == b->capacity) {
+        int capacity = b->capacity ? b->capacity * 2 : 1024;
+        int64_t *c = realloc(b->created, (size_t)capacity * sizeof(*c));
+        if (c) {
+            b->created = c;
+        }
+        int32_t *i = realloc(b->ids, (size_t)capacity * sizeof(*i));
+        if (i) {
+            b->ids = i;
+        }
+        uint32_t *o = realloc(b->offsets, ((size_t)capacity + 1) * sizeof(*o));
+        if (o) {
+            b->offsets = o;
+        }
+        uint8_t *s = realloc(b->status, (size_t)capacity);
+        if (s) {
+            b->status = s;
+        }
+        if (!c || !i || !o || !s) {
+            b->failed = 1;
+            return;
+        }
+        b->capacity = capacity;
+    }
+    if (b->text_len + len + 1 > b->text_capacity) {
+        size_t capacity = b->text_capacity ? b->text_capacity * 2 : 64 * 1024;
+        while (capacity < b->text_len + len + 1) {
+            capacity *= 2;
+        }
+        // Offsets into the text are 32-bit
+        char *text = capacity <= UINT32_MAX ? realloc(b->text, capacity) : NULL;
+        if (!text) {
+            b->failed = 1;
+            return;
+        }
+        b->text = text;
+        b->text_capacity = capacity;
+    }
+
+    b->created[b->count] = created;
+    b->ids[b->count] = id;
+    b->status[b->count] = (uint8_t)completed;
+    b->offsets[b->count] = (uint32_t)b->text_len;
+    memcpy(b->text + b->text_len, text, len);
+    b->text[b->text_len + len] = '\0';
+    b->text_len += len + 1;
+    b->count++;
+    b->offsets[b->count] = (uint32_t)b->text_len;
+}
+
+static int builder_add_row(const TaskRow *row, void *ctx)
+{
+    builder_add(ctx, row->id, row->completed, row->created, row->description, (size_t)row->description_len);
+    return 0;
+}
+
+static void builder_copy(Builder *b, const Snapshot *snap, int i)
+{
+    builder_add(b, snap->ids[i], snap->status[i], snap->created[i], snap->text + snap->offsets[i],
+                snap->offsets[i + 1] - snap->offsets[i] - 1);
+}
+
+static int compare_keys(const void *a, const void *b)
+{
+    const RowKey *x = a, *y = b;
+    if (x->created != y->created) {
+        return x->created < y->created ? -1 : 1;
+    }
+    return (x->id > y->id) - (x->id < y->id);
+}
+
+static int compare_ids(const void *a, const void *b)
+{
+    int x = *(const int *)a, y = *(const int *)b;
+    return (x > y) - (x < y);
+}
+
+static int compare_id_rows(const void *a, const void *b)
+{
+    const RowKey *x = a, *y = b;
+    return (x->id > y->id) - (x->id < y->id);
+}
+
+// The by_id column: row numbers sorted by task ID. IDs mostly grow with
+// creation time, so this is usually the identity and needs no sort.
+static uint32_t *index_by_id(const Builder *b)
+{
+    uint32_t *by_id = malloc(((size_t)b->count + 1) * sizeof(*by_id));
+    if (!by_id) {
+        return NULL;
+    }
+    int sorted = 1;
+    for (int i = 0; i < b->count; i++) {
+        by_id[i] = (uint32_t)i;
+        sorted = sorted && (i == 0 || b->ids[i - 1] < b->ids[i]);
+    }
+    if (sorted) {
+        return by_id;
+    }
+
+    RowKey *keys = malloc((size_t)b->count * sizeof(RowKey));
+    if (!keys) {
+        free(by_id);
+        return NULL;
+    }
+    for (int i = 0; i < b->count; i++) {
+        keys[i].id = b->ids[i];
+        keys[i].index = i;
+    }
+    qsort(keys, (size_t)b->count, sizeof(RowKey), compare_id_rows);
+    for (int i = 0; i < b->count; i++) {
+        by_id[i] = (uint32_t)keys[i].index;
+    }
+    free(keys);
+    return by_id;
+}
+
+// The old snapshot without the changed tasks, merged in listing order with
+// their current versions (fresh)
+static int merge_changes(Builder *out, const Snapshot *old, const int *changed, int changed_count,
+                         const Builder *fresh)
+{
+    RowKey *keys = malloc(((size_t)fresh->count + 1) * sizeof(RowKey));
+    if (!keys) {
+        return -1;
+    }
+    for (int j = 0; j < fresh->count; j++) {
+        keys[j].created = fresh->created[j];
+        keys[j].id = fresh->ids[j];
+        keys[j].index = j;
+    }
+    qsort(keys, (size_t)fresh->count, sizeof(RowKey), compare_keys);
+
+    int i = 0, j = 0;
+    while (i < old->count || j < fresh->count) {
+        if (i < old->count &&
+            bsearch(&old->ids[i], changed, (size_t)changed_count, sizeof(int), compare_ids)) {
+            i++;
+            continue;
+        }
+        RowKey at = {i < old->count ? old->created[i] : 0, i < old->count ? old->ids[i] : 0, 0};
+        if (j < fresh->count && (i == old->count || compare_keys(&keys[j], &at) < 0)) {
+            int k = keys[j++].index;
+            builder_add(out, fresh->ids[k], fresh->status[k], fresh->created[k], fresh->text + fresh->offsets[k],
+                        fresh->offsets[k + 1] - fresh->offsets[k] - 1);
+        } else {
+            builder_copy(out, old, i++);
+        }
+    }
+    free(keys);
+    return out->failed ? -1 : 0;
+}
+
+static int write_all(int fd, const void *data, size_t len)
+{
+    const char *p = data;
+    while (len > 0) {
+        ssize_t n = write(fd, p, len);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        p += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+// Write the columns to a temporary file and rename it over the snapshot,
+// so readers see either the old file or the new one, never a mix
+static int builder_write(Builder *b, const char *path, const SnapshotHeader *stamp)
+{
+    if (b->failed) {
+        return -1;
+    }
+    if (!b->offsets) {
+        uint32_t *offsets = calloc(1, sizeof(*offsets));
+        if (!offsets) {
+            return -1;
+        }
+        b->offsets = offsets;
+    }
+
+    unsigned char header[SNAPSHOT_HEADER_SIZE] = {0};
+    SnapshotHeader *h = (SnapshotHeader *)header;
+    *h = *stamp;
+    memcpy(h->magic, SNAPSHOT_MAGIC, sizeof(h->magic));
+    h->count = (uint32_t)b->count;
+    h->text_size = b->text_len;
+    h->max_id = 0;
+    for (int i = 0; i < b->count; i++) {
+        if (b->ids[i] > h->max_id) {
+            h->max_id = b->ids[i];
+        }
+    }
+
+    uint32_t *by_id = index_by_id(b);
+    if (!by_id) {
+        return -1;
+    }
+
+    char tmp[640];
+    snprintf(tmp, sizeof(tmp), "%s.%ld", path, (long)getpid());
+    int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        free(by_id);
+        return -1;
+    }
+    size_t n = (size_t)b->count;
+    int rc = write_all(fd, header, sizeof(header)) || write_all(fd, b->created, n * sizeof(int64_t)) ||
+             write_all(fd, b->ids, n * sizeof(int32_t)) || write_all(fd, b->offsets, (n + 1) * sizeof(uint32_t)) ||
+             write_all(fd, by_id, n * sizeof(uint32_t)) || write_all(fd, b->status, n) ||
+             write_all(fd, b->text, b->text_len);
+    free(by_id);
+    if (close(fd) != 0 || rc != 0 || rename(tmp, path) != 0) {
+        unlink(tmp);
+        return -1;
+    }
+    return 0;
+}
+
+// Record that a snapshot still matches the database as of the stamps
+static int restamp(const char *path, const SnapshotStamp *db, const SnapshotStamp *wal)
+{
+    SnapshotHeader h;
+    h.built_ns = wall_clock_ns();
+    h.db = *db;
+    h.wal = *wal;
+    int fd = open(path, O_WRONLY);
+    if (fd < 0) {
+        return -1;
+    }
+    size_t start = offsetof(SnapshotHeader, built_ns);
+    size_t len = offsetof(SnapshotHeader, text_size) - start;
+    ssize_t n = pwrite(fd, (const char *)&h + start, len, (off_t)start);
+    close(fd);
+    return n == (ssize_t)len ? 0 : -1;
+}
+
+// Bring the snapshot up to date with the open database and map it. snap
+// may hold the previous snapshot from snapshot_open(), which is then only
+// patched with the tasks changed since. Returns 0 with snap current, or
+// -1 when there can be no snapshot (e.g. an old schema or a read-only
+// directory), with snap closed.
+int snapshot_sync(Snapshot *snap)
+{
+    TraceSpan span = trace_begin("snapshot.sync");
+    char path[600];
+    snapshot_path(path, sizeof(path));
+
+    // Stamp before reading: a commit that lands after this is then
+    // caught by the next reader even if we already see it
+    SnapshotHeader stamp;
+    memset(&stamp, 0, sizeof(stamp));
+    stamp_database(&stamp.db, &stamp.wal);
+
+    long long generation, changes_from;
+    if (db_begin_read() != 0) {
+        snapshot_close(snap);
+        trace_end(span);
+        return -1;
+    }
+    if (db_generation(&generation, &changes_from) != 0) {
+        db_commit();
+        snapshot_close(snap);
+        trace_end(span);
+        return -1;
+    }
+
+    if (snap->map && snap->header->generation == generation) {
+        db_commit();
+        int rc = restamp(path, &stamp.db, &stamp.wal);
+        trace_end(span);
+        return rc;
+    }
+
+    Builder out = {0};
+    int rc;
+    if (snap->map && snap->header->generation >= changes_from && snap->header->generation < generation) {
+        TraceSpan merge = trace_begin("snapshot.merge");
+        int *changed = NULL;
+        Builder fresh = {0};
+        int changed_count = db_changed_ids(snap->header->generation, &changed);
+        rc = changed_count >= 0 &&
+                     db_each_changed_task(snap->header->generation, snap->header->max_id, builder_add_row, &fresh) >= 0 &&
+                     !fresh.failed
+                 ? 0
+                 : -1;
+        db_commit();
+        if (rc == 0) {
+            rc = merge_changes(&out, snap, changed, changed_count, &fresh);
+        }
+        free(changed);
+        builder_free(&fresh);
+        trace_end(merge);
+    } else {
+        TraceSpan rebuild = trace_begin("snapshot.rebuild");
+        TaskQuery all = {0};
+        rc = db_each_task(&all, builder_add_row, &out) >= 0 ? 0 : -1;
+        db_commit();
+        trace_end(rebuild);
+    }
+
+    stamp.generation = generation;
+    stamp.built_ns = wall_clock_ns();
+    if (rc == 0) {
+        rc = builder_write(&out, path, &stamp);
+    }
+    builder_free(&out);
+    snapshot_close(snap);
+    if (rc == 0) {
+        rc = snapshot_map(snap, path);
+    }
+    // Everything up to this generation is in the snapshot now. Readers
+    // land here too, so this never waits for another writer.
+    if (rc == 0 && generation - changes_from >= SNAPSHOT_PRUNE_AT) {
+        db_prune_changes(generation, 0);
+    }
+    trace_end(span);
+    return rc;
+}
+
+// Stream tasks like db_each_task(). Rows point into the mapping and stay
+// valid until snapshot_close().
+int snapshot_each(const Snapshot *snap, const TaskQuery *query, TaskRowCallback callback, void *ctx)
+{
+    TraceSpan span = trace_begin("snapshot.each_task");
+    int i = 0;
+    if (query->after_id) {
+        // Binary search of the ID order for the row to continue after
+        int lo = 0, hi = snap->count;
+        while (lo < hi) {
+            int mid = lo + (hi - lo) / 2;
+            if (snap->ids[snap->by_id[mid]] < query->after_id) {
+                lo = mid + 1;
+            } else {
+                hi = mid;
+            }
+        }
+        if (lo == snap->count || snap->ids[snap->by_id[lo]] != query->after_id) {
+            trace_end(span);
+            return TASKS_AFTER_NOT_FOUND;
+        }
+        i = (int)snap->by_id[lo] + 1;
+    }
+
+    int rows = 0;
+    TaskRow row;
+    for (; i < snap->count && (query->limit <= 0 || rows < query->limit); i++) {
+        if (query->pending_only && snap->status[i] == DONE) {
+            continue;
+        }
+        row.id = snap->ids[i];
+        row.completed = snap->status[i] == DONE ? DONE : TODO;
+        row.created = (time_t)snap->created[i];
+        row.description = snap->text + snap->offsets[i];
+        row.description_len = (int)(snap->offsets[i + 1] - snap->offsets[i] - 1);
+        rows++;
+        if (callback(&row, ctx) != 0) {
+            break;
+        }
+    }
+    trace_end(span);
+    return rows;
+}
@@ -0,0 +1,70 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "database.h"
+
+// Read-only columnar copy of the tasks in tasks.snap next to tasks.db,
+// for commands that only list or search. It is mapped with mmap and
+// rows are handed out straight from the mapping, so reading it involves
+// no SQLite, no parsing and no copying.
+//
+// File layout (native byte order; the file is a cache, never moved
+// between machines), tasks in listing order:
+//
+//   header   SNAPSHOT_HEADER_SIZE bytes (SnapshotHeader)
+//   created  int64_t[count]
+//   ids      int32_t[count]
+//   offsets  uint32_t[count + 1]   start of each description in text
+//   by_id    uint32_t[count]       row numbers in ID order, for --after
+//   status   uint8_t[count]
+//   text     descriptions, each followed by a NUL
+//
+// The header records the database generation the snapshot matches (see
+// db_generation()) and the size and mtime of tasks.db and its WAL when it
+// was built. While those are unchanged the snapshot is current without
+// asking SQLite; otherwise the generation decides, and a stale snapshot
+// catches up by merging in only the tasks changed since its generation.
+#define SNAPSHOT_HEADER_SIZE 128
+
+typedef struct
+{
+    int64_t dev;
+    int64_t ino;
+    int64_t size;
+    int64_t mtime_ns;
+} SnapshotStamp;
+
+typedef struct
+{
+    char magic[8];
+    uint32_t count;
+    int32_t max_id;
+    int64_t generation;
+    int64_t built_ns; // wall clock, to tell apart changes in the same mtime tick
+    SnapshotStamp db;
+    SnapshotStamp wal;
+    uint64_t text_size;
+} SnapshotHeader;
+
+typedef struct
+{
+    unsigned char *map;
+    size_t size;
+    const SnapshotHeader *header;
+    const int64_t *created;
+    const int32_t *ids;
+    const uint32_t *offsets;
+    const uint32_t *by_id;
+    const uint8_t *status;
+    const char *text;
+    int count;
+} Snapshot;
+
+int snapshot_open(Snapshot *snap);
+int snapshot_sync(Snapshot *snap);
+int snapshot_each(const Snapshot *snap, const TaskQuery *query, TaskRowCallback callback, void *ctx);
+void snapshot_close(Snapshot *snap);
+
+#endif // SNAPSHOT_H
@@ -1,27 +1,70 @@
 #!/bin/bash
 # Bash completion for taskman
 
+# Pending task IDs starting with $cur. "taskman __complete" prints one
+# "ID<tab>description" line per task; a single match completes to its ID,
+# several are listed as "ID  description" so the task can be recognized.
+_taskman_complete_ids() {
+    local lines=()
+    mapfile -t lines < <(taskman __complete "$cur" 2>/dev/null)
+    if [ ${#lines[@]} -eq 1 ]; then
+        COMPREPLY=("${lines[0]%%$'\t'*}")
+    elif [ ${#lines[@]} -gt 1 ]; then
+        COMPREPLY=("${lines[@]/$'\t'/  }")
+    fi
+}
+
 _taskman_completion() {
     local cur prev words cword
     _init_completion || return
 
-    local commands="add list list-all search done delete edit status help"
+    local commands="add import list list-all search done delete edit archive watch status help"
+    local command=${words[1]}
+    if [[ $command == --profile* ]]; then
+        command=${words[2]}
+    fi
 
     case $prev in
         taskman)
-            COMPREPLY=($(compgen -W "$commands" -- "$cur"))
+            COMPREPLY=($(compgen -W "$commands --profile --profile=json" -- "$cur"))
             return 0
             ;;
-        done|delete|edit)
-            # For done, delete, and edit commands, we could potentially
-            # complete with task IDs, but that would require calling taskman
-            # which might be slow. For now, just return empty.
+        --profile|--profile=json)
+            COMPREPLY=($(compgen -W "$commands" -- "$cur"))
             return 0
             ;;
-        *)
+        --format)
+            COMPREPLY=($(compgen -W "table ndjson tsv csv" -- "$cur"))
             return 0
             ;;
     esac
+
+    case $command in
+        search)
+            # Anything else is a term to print matches for
+            COMPREPLY=($(compgen -W "--fuzzy --archive --format" -- "$cur"))
+            ;;
+        list|list-all|status)
+            COMPREPLY=($(compgen -W "--format" -- "$cur"))
+            ;;
+        watch)
+            COMPREPLY=($(compgen -W "--all" -- "$cur"))
+            ;;
+        done|delete)
+            if [[ $cur == -* ]]; then
+                COMPREPLY=($(compgen -W "--match --yes" -- "$cur"))
+            elif [ "$prev" != --match ]; then
+                _taskman_complete_ids
+            fi
+            ;;
+        edit)
+            # Only the task, not the new description
+            if [ "$prev" = edit ]; then
+                _taskman_complete_ids
+            fi
+            ;;
+    esac
+    return 0
 }
 
 complete -F _taskman_completion taskman
@@ -3,169 +3,838 @@
 #include <string.h>
 #include <time.h>
 #include <ctype.h>
+#include <limits.h>
+#include <unistd.h>
 #include "database.h"
+#include "client.h"
+#include "match.h"
+#include "output.h"
 #include "search.h"
+#include "import.h"
+#include "trace.h"
+#include "snapshot.h"
+#include "watch.h"
 
-TaskManager tm = {0};
+// Commands go to a running taskmand when there is one and straight to
+// the database otherwise. Commands that only read the listing use the
+// mmap'd snapshot (see snapshot.h) instead of the database when it is
+// current. The store_* helpers hide which one it is.
+static Client daemon;
+static int use_daemon = 0;
+static Snapshot snapshot;
+static int use_snapshot = 0;
+static int use_database = 0;
+// A direct write, after which an existing snapshot is brought up to date
+static int wrote = 0;
+// --archive: list-all and search also read the archived tasks, which only
+// the database has
+static int include_archive = 0;
+// --format: how list, list-all, search and status print
+static OutputFormat format = FORMAT_TABLE;
+// Everything between opening and closing the store is the command itself
+static TraceSpan command_span;
 
-void load_tasks()
+// What "taskman __complete" offers the shell per Tab press
+#define COMPLETE_MAX_IDS 50
+#define COMPLETE_DESCRIPTION_CHARS 40
+
+int store_open(int allow_daemon, int allow_snapshot)
 {
-    if (db_load_tasks(&tm) != 0) {
-        fprintf(stderr, "Warning: Could not load tasks from database\n");
+    TraceSpan span = trace_begin("store.open");
+    int rc = 0;
+    allow_snapshot = allow_snapshot && !getenv("TASKMAN_NO_SNAPSHOT");
+    if (allow_daemon && !getenv("TASKMAN_NO_DAEMON") && client_connect(&daemon) == 0)
+    {
+        use_daemon = 1;
+    }
+    else if (allow_snapshot && snapshot_open(&snapshot) == 0)
+    {
+        use_snapshot = 1;
     }
+    else
+    {
+        rc = db_init();
+        use_database = rc == 0;
+        if (rc == 0 && allow_snapshot)
+        {
+            use_snapshot = snapshot_sync(&snapshot) == 0;
+        }
+    }
+    trace_end(span);
+    command_span = trace_begin("command");
+    return rc;
 }
 
-void save_task(Task *task)
+void store_close()
 {
-    if (db_save_task(task) != 0) {
-        fprintf(stderr, "Error: Cannot save task to database\n");
+    trace_end(command_span);
+    if (use_daemon)
+    {
+        client_close(&daemon);
+        return;
+    }
+    snapshot_close(&snapshot);
+    if (!use_database)
+    {
+        return;
     }
+    // Catch up while the database is open anyway, so the next reader finds
+    // a current snapshot. Nothing is written for users who never list.
+    if (wrote && snapshot_open(&snapshot) >= 0)
+    {
+        snapshot_sync(&snapshot);
+        snapshot_close(&snapshot);
+    }
+    db_close();
 }
 
-void update_task(Task *task)
+int store_add_task(Task *task)
 {
-    if (db_update_task(task) != 0) {
-        fprintf(stderr, "Error: Cannot update task in database\n");
+    if (use_daemon)
+    {
+        return client_add_task(&daemon, task->description, &task->id);
     }
+    int rc = db_add_task(task);
+    wrote |= rc == 0;
+    return rc;
 }
 
-int get_next_id()
+int store_get_task(int id, Task *task)
 {
-    return db_get_next_id();
+    return use_daemon ? client_get_task(&daemon, id, task) : db_get_task(id, task);
 }
 
-void add_task(const char *description)
+int store_set_task_status(int id, Status status)
 {
-    if (tm.count >= MAX_TASKS)
+    if (use_daemon)
     {
-        printf("Error: Maximum tasks reached\n");
-        return;
+        return client_set_task_status(&daemon, id, status);
+    }
+    int changed = db_set_task_status(id, status);
+    wrote |= changed > 0;
+    return changed;
+}
+
+int store_delete_task(int id)
+{
+    if (use_daemon)
+    {
+        return client_delete_task(&daemon, id);
+    }
+    int deleted = db_delete_task(id);
+    wrote |= deleted > 0;
+    return deleted;
+}
+
+int store_set_task_description(int id, const char *description)
+{
+    if (use_daemon)
+    {
+        return client_set_task_description(&daemon, id, description);
     }
+    int changed = db_set_task_description(id, description);
+    wrote |= changed > 0;
+    return changed;
+}
+
+int store_each_task(const TaskQuery *query, TaskRowCallback callback, void *ctx)
+{
+    if (use_daemon)
+    {
+        return client_each_task(&daemon, query, callback, ctx);
+    }
+    if (use_snapshot)
+    {
+        return snapshot_each(&snapshot, query, callback, ctx);
+    }
+    return db_each_task(query, callback, ctx);
+}
+
+typedef struct
+{
+    MatchQuery query;
+    TaskRowCallback callback;
+    void *ctx;
+} SearchFilter;
+
+int search_filter_row(const TaskRow *row, void *ctx)
+{
+    SearchFilter *filter = ctx;
+    if (!match_query_test(&filter->query, row->description, (size_t)row->description_len))
+    {
+        return 0;
+    }
+    return filter->callback(row, filter->ctx);
+}
 
+// Tasks containing every word of term, in creation order. The daemon
+// scans its cache and the database filters with task_matches(); the
+// snapshot and listings with the archive go through the same matcher here.
+int store_search_tasks(const char *term, TaskRowCallback callback, void *ctx)
+{
+    if (use_daemon)
+    {
+        return client_search_tasks(&daemon, term, callback, ctx);
+    }
+    if (!include_archive && !use_snapshot)
+    {
+        return db_search_tasks(term, callback, ctx);
+    }
+    static SearchFilter filter;
+    match_query_init(&filter.query, term);
+    filter.callback = callback;
+    filter.ctx = ctx;
+    TaskQuery query = {0};
+    query.archive = include_archive;
+    return store_each_task(&query, search_filter_row, &filter);
+}
+
+int store_task_stats(TaskStats *tasks, DbStatementStats *stats)
+{
+    if (use_daemon)
+    {
+        return client_task_stats(&daemon, tasks, stats);
+    }
+    int rc = db_task_stats(tasks);
+    db_get_statement_stats(stats);
+    return rc;
+}
+
+int add_task(const char *description)
+{
     if (strlen(description) == 0 || strspn(description, " \t\n") == strlen(description))
     {
         printf("Error: Task description cannot be empty.\n");
-        return;
+        return 1;
     }
 
     Task task;
-    task.id = get_next_id();
-    strncpy(task.description, description, MAX_TASK_LENGTH - 1);
-    task.description[MAX_TASK_LENGTH - 1] = '\0';
+    task.description = (char *)description; // only read
     task.completed = TODO;
     task.created = time(NULL);
 
-    save_task(&task);
-    
-    // Add to local cache
-    tm.tasks[tm.count] = task;
-    tm.count++;
+    if (store_add_task(&task) != 0)
+    {
+        fprintf(stderr, "Error: Cannot save task to database\n");
+        return 1;
+    }
     
     printf("Task added: #%d - %s\n", task.id, task.description);
+    return 0;
 }
 
-int cmp_created(const void *a, const void *b)
+typedef struct
+{
+    OutBuf out;
+    DateCache dates;
+    int color;
+    int limit;
+    int displayed;
+    int last_id;
+    int has_more;
+} ListContext;
+
+int list_row(const TaskRow *row, void *ctx)
 {
-    return ((Task *)a)->created - ((Task *)b)->created;
+    ListContext *list = ctx;
+    OutBuf *out = &list->out;
+
+    // One extra row is fetched only to learn whether another page exists
+    if (list->limit > 0 && list->displayed == list->limit)
+    {
+        list->has_more = 1;
+        return 1;
+    }
+
+    if (list->displayed == 0)
+    {
+        out_puts(out, "\nID   Status   Created              Description\n");
+        out_puts(out, "------------------------------------------------------------\n");
+    }
+
+    out_int_pad(out, row->id, 4);
+    out_putc(out, ' ');
+    if (list->color)
+    {
+        out_puts(out, row->completed == DONE ? "\033[0;32m" : "\033[0;33m");
+    }
+    out_pad(out, row->completed == DONE ? "[DONE]" : "[TODO]", 8);
+    if (list->color)
+    {
+        out_puts(out, "\033[0m");
+    }
+    out_putc(out, ' ');
+    out_date(out, &list->dates, row->created);
+    out_puts(out, "     ");
+    out_write(out, row->description, (size_t)row->description_len);
+    out_putc(out, '\n');
+
+    list->displayed++;
+    list->last_id = row->id;
+
+    // Stop producing rows once the reader (e.g. head or a pager) has gone
+    return out->failed;
 }
 
-void list_tasks(int show_completed)
+// The columns of the TSV and CSV formats
+void write_header(OutBuf *out)
 {
-    if (tm.count == 0)
+    const char *header = format == FORMAT_TSV ? "id\tstatus\tcreated\tcreated_at\tdescription\n"
+                                              : "id,status,created,created_at,description\n";
+    if (format == FORMAT_TSV || format == FORMAT_CSV)
     {
-        printf("No tasks found.\n");
-        return;
+        out_puts(out, header);
     }
+}
 
-    qsort(tm.tasks, tm.count, sizeof(Task), cmp_created);
-    printf("\n%-4s %-8s %-20s %s\n", "ID", "Status", "Created", "Description");
-    printf("------------------------------------------------------------\n");
-    int displayed = 0;
+// A task as a JSON object: the keys import --format=json reads, plus id
+// and the creation time in ISO 8601 (UTC)
+void write_json_task(OutBuf *out, int id, Status completed, time_t created, const char *description, size_t len)
+{
+    out_puts(out, "{\"id\":");
+    out_int(out, id);
+    out_puts(out, completed == DONE ? ",\"completed\":true,\"created\":" : ",\"completed\":false,\"created\":");
+    out_int(out, (long long)created);
+    out_puts(out, ",\"created_at\":\"");
+    out_iso_time(out, created);
+    out_puts(out, "\",\"description\":");
+    out_json_string(out, description, len);
+    out_putc(out, '}');
+}
 
-    for (int i = 0; i < tm.count; i++)
+// A task as one NDJSON, TSV or CSV record, written from the row as it
+// streams by: the description goes from SQLite's (or the snapshot's)
+// buffer straight into the output buffer
+int record_row(const TaskRow *row, void *ctx)
+{
+    ListContext *list = ctx;
+    OutBuf *out = &list->out;
+    size_t len = (size_t)row->description_len;
+
+    if (list->limit > 0 && list->displayed == list->limit)
     {
-        Task *task = &tm.tasks[i];
-        if (!show_completed && task->completed == DONE)
-            continue;
+        list->has_more = 1;
+        return 1;
+    }
+
+    if (format == FORMAT_NDJSON)
+    {
+        write_json_task(out, row->id, row->completed, row->created, row->description, len);
+    }
+    else
+    {
+        char sep = format == FORMAT_TSV ? '\t' : ',';
+        out_int(out, row->id);
+        out_putc(out, sep);
+        out_puts(out, row->completed == DONE ? "DONE" : "TODO");
+        out_putc(out, sep);
+        out_int(out, (long long)row->created);
+        out_putc(out, sep);
+        out_iso_time(out, row->created);
+        out_putc(out, sep);
+        if (format == FORMAT_TSV)
+        {
+            out_tsv_field(out, row->description, len);
+        }
+        else
+        {
+            out_csv_field(out, row->description, len);
+        }
+    }
+    out_putc(out, '\n');
+
+    list->displayed++;
+    list->last_id = row->id;
+    return out->failed;
+}
+
+// Stream tasks from the database in creation order, optionally one page
+// (limit rows after the task after_id) at a time
+int list_tasks(int show_completed, int limit, int after_id)
+{
+    static ListContext list;
+    memset(&list, 0, sizeof(list));
+    out_init(&list.out, STDOUT_FILENO);
+    list.color = output_use_color(STDOUT_FILENO);
+    list.limit = limit;
 
-        char time_str[20];
-        struct tm *tm_info = localtime(&task->created);
-        strftime(time_str, sizeof(time_str), "%Y-%m-%d %H:%M", tm_info);
+    TaskQuery query = {0};
+    query.pending_only = !show_completed;
+    query.after_id = after_id;
+    query.limit = limit > 0 ? limit + 1 : 0;
+    query.archive = include_archive;
 
-        printf("%-4d \033[0;%sm%-8s\033[0m %-20s %s\n",
-               task->id,
-               task->completed == DONE ? "32" : "33",
-               task->completed == DONE ? "[DONE]" : "[TODO]",
-               time_str,
-               task->description);
-        displayed++;
+    fflush(stdout);
+    write_header(&list.out);
+    int rows = store_each_task(&query, format == FORMAT_TABLE ? list_row : record_row, &list);
+    if (rows == TASKS_AFTER_NOT_FOUND)
+    {
+        // Nothing but the header was buffered
+        printf("Task #%d not found.\n", after_id);
+        return 1;
+    }
+    if (rows < 0)
+    {
+        out_flush(&list.out);
+        return 1;
+    }
+    if (format != FORMAT_TABLE)
+    {
+        return out_flush(&list.out) == 0 ? 0 : 1;
+    }
+
+    if (list.displayed == 0)
+    {
+        out_puts(&list.out, "No tasks found.\n");
+    }
+    else
+    {
+        out_puts(&list.out, "\nTotal tasks displayed: ");
+        out_int(&list.out, list.displayed);
+        out_putc(&list.out, '\n');
+        if (list.has_more)
+        {
+            out_puts(&list.out, "More tasks: taskman ");
+            out_puts(&list.out, show_completed ? "list-all" : "list");
+            out_puts(&list.out, include_archive ? " --archive" : "");
+            out_puts(&list.out, " --limit ");
+            out_int(&list.out, limit);
+            out_puts(&list.out, " --after ");
+            out_int(&list.out, list.last_id);
+            out_putc(&list.out, '\n');
+        }
     }
-    printf("\nTotal tasks displayed: %d\n", displayed);
+    out_flush(&list.out);
+    return 0;
 }
 
-void complete_task(int id)
+// Parse "list [--limit N] [--after ID]" options (and --archive for list-all)
+int list_command(int argc, char *argv[], int show_completed)
 {
-    for (int i = 0; i < tm.count; i++)
+    int limit = 0;
+    int after_id = 0;
+
+    for (int i = 2; i < argc; i++)
     {
-        if (tm.tasks[i].id == id)
+        const char *value = NULL;
+        int *target = NULL;
+
+        if (show_completed && strcmp(argv[i], "--archive") == 0)
         {
-            tm.tasks[i].completed = DONE;
-            update_task(&tm.tasks[i]);
-            printf("Task #%d marked as completed!\n", id);
-            return;
+            include_archive = 1;
+            continue;
+        }
+        if (strncmp(argv[i], "--limit=", 8) == 0)
+        {
+            value = argv[i] + 8;
+            target = &limit;
+        }
+        else if (strncmp(argv[i], "--after=", 8) == 0)
+        {
+            value = argv[i] + 8;
+            target = &after_id;
+        }
+        else if ((strcmp(argv[i], "--limit") == 0 || strcmp(argv[i], "--after") == 0) && i + 1 < argc)
+        {
+            target = strcmp(argv[i], "--limit") == 0 ? &limit : &after_id;
+            value = argv[++i];
+        }
+
+        char *end = NULL;
+        long parsed = value ? strtol(value, &end, 10) : -1;
+        if (!target || !end || *end != '\0' || end == value || parsed < 0 || parsed > INT_MAX)
+        {
+            printf("Usage: taskman %s [--limit N] [--after ID]%s\n", argv[1], show_completed ? " [--archive]" : "");
+            return 1;
+        }
+        // list_tasks() asks for one row more than the limit
+        if (target == &limit && parsed > INT_MAX - 1)
+        {
+            parsed = INT_MAX - 1;
         }
+        *target = (int)parsed;
+    }
+
+    return list_tasks(show_completed, limit, after_id);
+}
+
+void complete_task(int id)
+{
+    int changed = store_set_task_status(id, DONE);
+    if (changed < 0)
+    {
+        printf("Error: Could not update task in database.\n");
+        return;
+    }
+    if (changed == 0)
+    {
+        printf("Task #%d not found.\n", id);
+        return;
+    }
+    printf("Task #%d marked as completed!\n", id);
+}
+
+// Read a y/n answer from stdin, once the question is out (stdout is fully
+// buffered when it is not a terminal)
+int confirmed()
+{
+    fflush(stdout);
+    int answer = getchar();
+    int c = answer;
+    while (c != '\n' && c != EOF)
+    {
+        c = getchar(); // rest of the line
+    }
+    return answer == 'y' || answer == 'Y';
+}
+
+void delete_task(int id, int yes)
+{
+    Task task;
+    int found = store_get_task(id, &task);
+    task_clear(&task);
+    if (found < 0)
+    {
+        printf("Error: Could not read task from database.\n");
+        return;
+    }
+    if (found == 0)
+    {
+        printf("Task #%d not found.\n", id);
+        return;
+    }
+
+    if (!yes)
+    {
+        printf("Are you sure you want to delete task #%d? (y/n): ", id);
+    }
+    if (!yes && !confirmed())
+    {
+        printf("Cancelled.\n");
+        return;
     }
-    printf("Task #%d not found.\n", id);
+
+    int deleted = store_delete_task(id);
+    if (deleted < 0)
+    {
+        printf("Error: Could not delete task from database.\n");
+        return;
+    }
+    if (deleted == 0)
+    {
+        printf("Task #%d not found.\n", id);
+        return;
+    }
+    printf("Task #%d deleted.\n", id);
 }
 
-void delete_task(int id)
+void edit_task(int id, const char *description)
 {
-    for (int i = 0; i < tm.count; i++)
+    int changed = store_set_task_description(id, description);
+    if (changed < 0)
+    {
+        printf("Error: Could not update task in database.\n");
+        return;
+    }
+    if (changed == 0)
     {
-        if (tm.tasks[i].id == id)
+        printf("Task #%d not found.\n", id);
+        return;
+    }
+    printf("Task #%d updated.\n", id);
+}
+
+// Parse the arguments of done, delete and edit from argv[2] on: task IDs
+// and ranges such as 12-40, --match <term> and --yes. For edit the last
+// argument is the new description. The caller's ranges array holds argc
+// entries. Returns -1 on a malformed argument.
+int parse_selector(int argc, char *argv[], IdRange *ranges, TaskSelector *selector, int *yes,
+                   const char **description)
+{
+    int last = description ? argc - 1 : argc;
+
+    if (last < 2)
+    {
+        return -1;
+    }
+    memset(selector, 0, sizeof(*selector));
+    selector->ranges = ranges;
+    *yes = 0;
+
+    for (int i = 2; i < last; i++)
+    {
+        if (strcmp(argv[i], "--yes") == 0 || strcmp(argv[i], "-y") == 0)
         {
-            printf("Are you sure you want to delete task #%d? (y/n): ", id);
-            char confirm = getchar();
-            getchar(); // consume newline
-            if (confirm != 'y' && confirm != 'Y')
-            {
-                printf("Cancelled.\n");
-                return;
-            }
-            
-            // Delete from database
-            if (db_delete_task(id) != 0) {
-                printf("Error: Could not delete task from database.\n");
-                return;
-            }
-            
-            // Remove from local cache
-            for (int j = i; j < tm.count - 1; j++)
+            *yes = 1;
+            continue;
+        }
+        if (strncmp(argv[i], "--match=", 8) == 0 || (strcmp(argv[i], "--match") == 0 && i + 1 < last))
+        {
+            selector->match = argv[i][7] == '=' ? argv[i] + 8 : argv[++i];
+            // A term with no words would match every task
+            MatchQuery query;
+            match_query_init(&query, selector->match);
+            if (query.count == 0)
             {
-                tm.tasks[j] = tm.tasks[j + 1];
+                return -1;
             }
-            tm.count--;
-            printf("Task #%d deleted.\n", id);
-            return;
+            continue;
+        }
+
+        char *end = NULL;
+        long first = strtol(argv[i], &end, 10);
+        long range_last = first;
+        if (end != argv[i] && *end == '-')
+        {
+            const char *start = end + 1;
+            range_last = strtol(start, &end, 10);
+            end = end == start ? NULL : end;
+        }
+        if (!end || end == argv[i] || *end != '\0' || first < 1 || range_last < first || range_last > INT_MAX)
+        {
+            return -1;
         }
+        ranges[selector->range_count].first = (int)first;
+        ranges[selector->range_count].last = (int)range_last;
+        selector->range_count++;
     }
-    printf("Task #%d not found.\n", id);
+
+    if (description)
+    {
+        *description = argv[last];
+    }
+    return selector->range_count > 0 || selector->match ? 0 : -1;
 }
 
-void edit_task(int id, const char *new_description)
+// A selector naming exactly one task goes through the per-task commands
+int single_task(const TaskSelector *selector)
 {
-    for (int i = 0; i < tm.count; i++)
+    return selector->range_count == 1 && !selector->match && selector->ranges[0].first == selector->ranges[0].last;
+}
+
+void complete_selected(const TaskSelector *selector)
+{
+    int selected = 0;
+    int changed = db_set_selected_status(selector, DONE, &selected);
+    if (changed < 0)
     {
-        if (tm.tasks[i].id == id)
+        printf("Error: Could not update tasks in database.\n");
+        return;
+    }
+    wrote |= changed > 0;
+    if (selected == 0)
+    {
+        printf("No matching tasks.\n");
+        return;
+    }
+    printf("%d task(s) marked as completed", changed);
+    if (selected > changed)
+    {
+        printf(" (%d already completed)", selected - changed);
+    }
+    printf(".\n");
+}
+
+// When asking first, exactly the tasks counted for the question are
+// deleted, even if others start to match before the answer
+void delete_selected(const TaskSelector *selector, int yes)
+{
+    if (!yes)
+    {
+        int count = db_count_selected(selector);
+        if (count < 0)
         {
-            strncpy(tm.tasks[i].description, new_description, MAX_TASK_LENGTH - 1);
-            tm.tasks[i].description[MAX_TASK_LENGTH - 1] = '\0';
-            update_task(&tm.tasks[i]);
-            printf("Task #%d updated.\n", id);
+            printf("Error: Could not read tasks from database.\n");
             return;
         }
+        if (count == 0)
+        {
+            printf("No matching tasks.\n");
+            return;
+        }
+        printf("Are you sure you want to delete %d task(s)? (y/n): ", count);
+        if (!confirmed())
+        {
+            printf("Cancelled.\n");
+            return;
+        }
+    }
+
+    int selected = 0;
+    int deleted = yes ? db_delete_selected(selector, &selected) : db_delete_counted(&selected);
+    if (deleted < 0)
+    {
+        printf("Error: Could not delete tasks from database.\n");
+        return;
+    }
+    wrote |= deleted > 0;
+    if (deleted == 0)
+    {
+        printf("No matching tasks.\n");
+        return;
     }
-    printf("Task #%d not found.\n", id);
+    printf("%d task(s) deleted.\n", deleted);
+}
+
+void edit_selected(const TaskSelector *selector, const char *description)
+{
+    int selected = 0;
+    int changed = db_set_selected_description(selector, description, &selected);
+    if (changed < 0)
+    {
+        printf("Error: Could not update tasks in database.\n");
+        return;
+    }
+    wrote |= changed > 0;
+    if (changed == 0)
+    {
+        printf("No matching tasks.\n");
+        return;
+    }
+    printf("%d task(s) updated.\n", changed);
+}
+
+// Non-interactive search: print the matching tasks as a listing
+int search_tasks(const char *term)
+{
+    static ListContext list;
+    memset(&list, 0, sizeof(list));
+    out_init(&list.out, STDOUT_FILENO);
+    list.color = output_use_color(STDOUT_FILENO);
+
+    fflush(stdout);
+    write_header(&list.out);
+    if (store_search_tasks(term, format == FORMAT_TABLE ? list_row : record_row, &list) < 0)
+    {
+        out_flush(&list.out);
+        return 1;
+    }
+    if (format != FORMAT_TABLE)
+    {
+        return out_flush(&list.out) == 0 ? 0 : 1;
+    }
+
+    if (list.displayed == 0)
+    {
+        out_puts(&list.out, "No matching tasks.\n");
+    }
+    else
+    {
+        out_puts(&list.out, "\nTotal tasks displayed: ");
+        out_int(&list.out, list.displayed);
+        out_putc(&list.out, '\n');
+    }
+    out_flush(&list.out);
+    return 0;
+}
+
+int import_command(int argc, char *argv[])
+{
+    ImportFormat format = IMPORT_AUTO;
+    const char *path = NULL;
+
+    for (int i = 2; i < argc; i++)
+    {
+        if (strncmp(argv[i], "--format=", 9) == 0)
+        {
+            if (import_parse_format(argv[i] + 9, &format) != 0)
+            {
+                printf("Error: Unknown import format '%s' (use auto, lines, tsv or json)\n", argv[i] + 9);
+                return 1;
+            }
+        }
+        else if (!path)
+        {
+            path = argv[i];
+        }
+        else
+        {
+            printf("Usage: taskman import [--format=auto|lines|tsv|json] [file]\n");
+            return 1;
+        }
+    }
+
+    FILE *in = stdin;
+    if (path && strcmp(path, "-") != 0)
+    {
+        in = fopen(path, "r");
+        if (!in)
+        {
+            printf("Error: Cannot open '%s'\n", path);
+            return 1;
+        }
+    }
+
+    ImportStats stats;
+    int rc = import_tasks(in, format, &stats);
+    if (in != stdin)
+    {
+        fclose(in);
+    }
+
+    double rate = stats.seconds > 0 ? stats.imported / stats.seconds : 0;
+    printf("Imported %ld task(s) in %.3fs (%.0f tasks/sec)", stats.imported, stats.seconds, rate);
+    if (stats.skipped > 0)
+    {
+        printf(", skipped %ld malformed record(s)", stats.skipped);
+    }
+    printf("\n");
+
+    return rc == 0 ? 0 : 1;
+}
+
+// Move completed tasks into archive.db: "archive [--older-than DAYS]",
+// where age is counted from when a task was created
+int archive_command(int argc, char *argv[])
+{
+    long days = 0;
+    const char *value = NULL;
+    if (argc == 3 && strncmp(argv[2], "--older-than=", 13) == 0)
+    {
+        value = argv[2] + 13;
+    }
+    else if (argc == 4 && strcmp(argv[2], "--older-than") == 0)
+    {
+        value = argv[3];
+    }
+    char *end = NULL;
+    if (value)
+    {
+        days = strtol(value, &end, 10);
+    }
+    if ((argc > 2 && !value) || (value && (end == value || *end != '\0' || days < 0 || days > 100000)))
+    {
+        printf("Usage: taskman archive [--older-than DAYS]\n");
+        return 1;
+    }
+
+    ArchiveStats stats;
+    int rc = db_archive_tasks(time(NULL) - (time_t)days * 24 * 60 * 60, &stats);
+    wrote |= stats.archived > 0;
+    if (stats.vacuumed)
+    {
+        printf("Switched the database to incremental vacuum (one-time full VACUUM).\n");
+    }
+    if (rc != 0)
+    {
+        printf("Error: Could not archive tasks (%d moved before the error).\n", stats.archived);
+        return 1;
+    }
+
+    if (stats.archived == 0)
+    {
+        printf("No completed tasks to archive.\n");
+    }
+    else
+    {
+        printf("Archived %d task(s) in %d batch(es) to %s\n", stats.archived, stats.batches, db_archive_path());
+    }
+    if (stats.pages_freed > 0)
+    {
+        printf("Reclaimed %ld page(s) (%.1f MiB)\n", stats.pages_freed,
+               stats.pages_freed * (double)stats.page_size / (1024 * 1024));
+    }
+    return 0;
 }
 
 void show_help()
@@ -174,51 +843,367 @@ void show_help()
     printf("==================\n");
     printf("Usage:\n");
     printf("  taskman add \"Task description\"    - Add a new task\n");
-    printf("  taskman list                       - List pending tasks\n");
-    printf("  taskman list-all                   - List all tasks\n");
-    printf("  taskman search                     - Interactive search\n");
-    printf("  taskman done <id>                  - Mark task as completed\n");
-    printf("  taskman delete <id>                - Delete a task\n");
-    printf("  taskman edit <id> \"new description\" - Edit a task\n");
+    printf("  taskman import [file]              - Bulk add tasks from a file or stdin\n");
+    printf("  taskman list [--limit N] [--after ID] - List pending tasks\n");
+    printf("  taskman list-all [--limit N] [--after ID] - List all tasks\n");
+    printf("  taskman list-all --archive         - List all tasks, archived ones too\n");
+    printf("  taskman search [--fuzzy]           - Interactive search\n");
+    printf("  taskman search <term>              - Print tasks containing every word of term\n");
+    printf("  taskman search --archive <term>    - The same, archived tasks too\n");
+    printf("  taskman done <tasks>               - Mark tasks as completed\n");
+    printf("  taskman delete [--yes] <tasks>     - Delete tasks\n");
+    printf("  taskman edit <tasks> \"new description\" - Edit tasks\n");
+    printf("  taskman archive [--older-than DAYS] - Move completed tasks to archive.db\n");
+    printf("  taskman watch [--all]              - Live list of pending (or all) tasks\n");
     printf("  taskman status                     - Show database location and stats\n");
+    printf("  taskman status --check             - Verify the task counters against the tasks\n");
     printf("  taskman help                       - Show this help\n\n");
+    printf("<tasks> is any mix of IDs and ranges (3 7 12-40) and --match <term>, which\n");
+    printf("picks the tasks \"taskman search <term>\" lists. Several tasks change in one\n");
+    printf("transaction.\n\n");
+    printf("list, list-all, search <term> and status take --format=ndjson|tsv|csv|table;\n");
+    printf("the first three print one record per line with raw and ISO 8601 times.\n\n");
+    printf("Add --profile (or --profile=json) before any command to print timings and\n");
+    printf("SQLite counters to stderr.\n\n");
+}
+
+void print_stats_task(const char *label, const Task *task)
+{
+    if (task->id == 0)
+    {
+        printf("%s: none\n", label);
+        return;
+    }
+    char time_str[20];
+    struct tm *tm_info = localtime(&task->created);
+    strftime(time_str, sizeof(time_str), "%Y-%m-%d %H:%M", tm_info);
+    printf("%s: #%d from %s - %s\n", label, task->id, time_str, task->description);
+}
+
+// Recount everything from scratch and compare with the stored counters
+int check_status()
+{
+    TaskStats stored, actual;
+    int rc = db_check_task_stats(&stored, &actual);
+    if (rc < 0)
+    {
+        return 1;
+    }
+    printf("Counters:  %d total, %d completed, oldest pending #%d, newest #%d\n", stored.total,
+           stored.completed, stored.oldest_pending.id, stored.newest.id);
+    printf("Recounted: %d total, %d completed, oldest pending #%d, newest #%d\n", actual.total,
+           actual.completed, actual.oldest_pending.id, actual.newest.id);
+    printf(rc == 0 ? "Task counters are consistent.\n" : "Task counters do NOT match the tasks!\n");
+    task_stats_clear(&stored);
+    task_stats_clear(&actual);
+    return rc;
+}
+
+// Status as one NDJSON object, or a header and one TSV/CSV row
+void write_status_record(const TaskStats *tasks, const DbStatementStats *stats)
+{
+    static OutBuf out;
+    out_init(&out, STDOUT_FILENO);
+    const char *served_by = use_daemon ? "taskmand" : "direct";
+    const Task *oldest = &tasks->oldest_pending;
+    const Task *newest = &tasks->newest;
+
+    if (format == FORMAT_NDJSON)
+    {
+        out_puts(&out, "{\"database\":");
+        out_json_string(&out, db_get_path(), strlen(db_get_path()));
+        out_puts(&out, ",\"served_by\":\"");
+        out_puts(&out, served_by);
+        out_puts(&out, "\",\"total\":");
+        out_int(&out, tasks->total);
+        out_puts(&out, ",\"completed\":");
+        out_int(&out, tasks->completed);
+        out_puts(&out, ",\"pending\":");
+        out_int(&out, tasks->total - tasks->completed);
+        const Task *picked[2] = {oldest, newest};
+        const char *keys[2] = {",\"oldest_pending\":", ",\"newest\":"};
+        for (int i = 0; i < 2; i++)
+        {
+            out_puts(&out, keys[i]);
+            if (picked[i]->id == 0 || !picked[i]->description)
+            {
+                out_puts(&out, "null");
+                continue;
+            }
+            write_json_task(&out, picked[i]->id, picked[i]->completed, picked[i]->created, picked[i]->description,
+                            strlen(picked[i]->description));
+        }
+        out_puts(&out, ",\"statements_prepared\":");
+        out_int(&out, stats->prepared);
+        out_puts(&out, ",\"statements_reused\":");
+        out_int(&out, stats->reused);
+        out_puts(&out, "}\n");
+        out_flush(&out);
+        return;
+    }
+
+    char sep = format == FORMAT_TSV ? '\t' : ',';
+    const char *columns[] = {"database", "served_by", "total", "completed", "pending",
+                             "oldest_pending_id", "oldest_pending_created", "newest_id", "newest_created"};
+    for (size_t i = 0; i < sizeof(columns) / sizeof(columns[0]); i++)
+    {
+        if (i > 0)
+        {
+            out_putc(&out, sep);
+        }
+        out_puts(&out, columns[i]);
+    }
+    out_putc(&out, '\n');
+    if (format == FORMAT_TSV)
+    {
+        out_tsv_field(&out, db_get_path(), strlen(db_get_path()));
+    }
+    else
+    {
+        out_csv_field(&out, db_get_path(), strlen(db_get_path()));
+    }
+    long long values[] = {tasks->total, tasks->completed, tasks->total - tasks->completed,
+                          oldest->id, (long long)oldest->created, newest->id, (long long)newest->created};
+    out_putc(&out, sep);
+    out_puts(&out, served_by);
+    for (size_t i = 0; i < sizeof(values) / sizeof(values[0]); i++)
+    {
+        out_putc(&out, sep);
+        // No oldest pending or newest task leaves its fields empty
+        if ((i < 3) || (i < 5 ? oldest->id : newest->id) != 0)
+        {
+            out_int(&out, values[i]);
+        }
+    }
+    out_putc(&out, '\n');
+    out_flush(&out);
 }
 
 void show_status()
 {
+    if (format != FORMAT_TABLE)
+    {
+        TaskStats tasks = {0};
+        DbStatementStats stats = {0};
+        if (store_task_stats(&tasks, &stats) != 0) {
+            fprintf(stderr, "Warning: Could not count tasks in database\n");
+        }
+        write_status_record(&tasks, &stats);
+        task_stats_clear(&tasks);
+        return;
+    }
+
     printf("\nTaskMan Status\n");
     printf("==============\n");
     printf("Database location: %s\n", db_get_path());
-    printf("Total tasks: %d\n", tm.count);
-    
-    int completed = 0, pending = 0;
-    for (int i = 0; i < tm.count; i++) {
-        if (tm.tasks[i].completed == DONE) {
-            completed++;
-        } else {
-            pending++;
-        }
+    printf("Served by: %s\n", use_daemon ? "taskmand" : "direct database access");
+
+    TaskStats tasks = {0};
+    DbStatementStats stats = {0};
+    if (store_task_stats(&tasks, &stats) != 0) {
+        fprintf(stderr, "Warning: Could not count tasks in database\n");
     }
-    
-    printf("Completed tasks: %d\n", completed);
-    printf("Pending tasks: %d\n", pending);
+
+    printf("Total tasks: %d\n", tasks.total);
+    printf("Completed tasks: %d\n", tasks.completed);
+    printf("Pending tasks: %d\n", tasks.total - tasks.completed);
+    print_stats_task("Oldest pending", &tasks.oldest_pending);
+    print_stats_task("Newest task", &tasks.newest);
+    task_stats_clear(&tasks);
+
+    printf("Statement cache: %d prepared, %d reused\n", stats.prepared, stats.reused);
     printf("\n");
 }
 
+// Remove count arguments from argv at i; argv[argc] is NULL and moves
+// down too
+void drop_args(int *argc, char *argv[], int i, int count)
+{
+    for (int j = i; j + count <= *argc; j++)
+    {
+        argv[j] = argv[j + count];
+    }
+    *argc -= count;
+}
+
+int is_db_command(const char *command)
+{
+    static const char *commands[] = {
+        "add", "import", "list", "list-all", "search", "done", "delete", "edit", "archive", "watch", "status",
+    };
+    for (size_t i = 0; i < sizeof(commands) / sizeof(commands[0]); i++)
+    {
+        if (strcmp(command, commands[i]) == 0)
+        {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// "ID<tab>description" on one line; line breaks and tabs in the
+// description become spaces
+int complete_row(const TaskRow *row, void *ctx)
+{
+    OutBuf *out = ctx;
+    out_int(out, row->id);
+    out_putc(out, '\t');
+    const char *text = row->description;
+    for (int i = 0; i < row->description_len; i++)
+    {
+        out_putc(out, text[i] == '\n' || text[i] == '\r' || text[i] == '\t' ? ' ' : text[i]);
+    }
+    out_putc(out, '\n');
+    return 0;
+}
+
+// taskman __complete <prefix>, called by the bash completion on every Tab
+// press: pending task IDs starting with prefix. It runs before any other
+// setup, on a read-only connection, without schema checks, the daemon or
+// the snapshot, and prints nothing when there is nothing to offer.
+int complete_ids(const char *prefix)
+{
+    static OutBuf out;
+    out_init(&out, STDOUT_FILENO);
+    DbReader *reader = db_reader_open();
+    if (!reader)
+    {
+        return 0; // no database yet
+    }
+    int rc = db_reader_complete_ids(reader, prefix, COMPLETE_MAX_IDS, COMPLETE_DESCRIPTION_CHARS, complete_row, &out);
+    db_reader_close(reader);
+    out_flush(&out);
+    return rc < 0;
+}
+
 int main(int argc, char *argv[])
 {
-    // Initialize database
-    if (db_init() != 0) {
-        fprintf(stderr, "Error: Failed to initialize database\n");
-        return 1;
+    if (argc > 1 && strcmp(argv[1], "__complete") == 0)
+    {
+        trace_setup(getenv("TASKMAN_TRACE"));
+        return complete_ids(argc > 2 ? argv[2] : "");
     }
 
-    load_tasks();
+    // "taskman --profile[=json] <command>" reports where the time went on
+    // stderr, as does setting TASKMAN_TRACE=text|json
+    const char *profile = getenv("TASKMAN_TRACE");
+    if (argc > 1 && strncmp(argv[1], "--profile", 9) == 0 && (argv[1][9] == '\0' || argv[1][9] == '='))
+    {
+        profile = argv[1][9] == '=' ? argv[1] + 10 : "text";
+        argv[1] = argv[0];
+        argv++;
+        argc--;
+    }
+    if (trace_setup(profile) != 0)
+    {
+        fprintf(stderr, "Error: Profile format must be text or json\n");
+        return 1;
+    }
 
     if (argc < 2)
     {
         show_help();
-        db_close();
+        return 1;
+    }
+
+    // Commands that never touch the database
+    if (strcmp(argv[1], "help") == 0)
+    {
+        show_help();
+        return 0;
+    }
+    if (!is_db_command(argv[1]))
+    {
+        printf("Unknown command: %s\n", argv[1]);
+        show_help();
+        return 1;
+    }
+
+    // --format=<name> (or --format <name>) anywhere after the command;
+    // import has a --format of its own
+    int formatted = strcmp(argv[1], "list") == 0 || strcmp(argv[1], "list-all") == 0 ||
+                    strcmp(argv[1], "search") == 0 || strcmp(argv[1], "status") == 0;
+    for (int i = 2; i < argc && formatted; i++)
+    {
+        int separate = strcmp(argv[i], "--format") == 0 && i + 1 < argc;
+        if (strncmp(argv[i], "--format=", 9) != 0 && !separate)
+        {
+            continue;
+        }
+        const char *name = separate ? argv[i + 1] : argv[i] + 9;
+        if (output_parse_format(name, &format) != 0)
+        {
+            printf("Error: Unknown output format '%s' (use ndjson, tsv, csv or table)\n", name);
+            return 1;
+        }
+        drop_args(&argc, argv, i, separate ? 2 : 1);
+        i--;
+    }
+
+    // search options may come before or after the term, like --format;
+    // --archive searches the archive too
+    int search = strcmp(argv[1], "search") == 0;
+    int fuzzy = 0;
+    for (int i = 2; i < argc && search; i++)
+    {
+        if (strcmp(argv[i], "--archive") == 0)
+        {
+            include_archive = 1;
+        }
+        else if (strcmp(argv[i], "--fuzzy") == 0)
+        {
+            fuzzy = 1;
+        }
+        else
+        {
+            continue;
+        }
+        drop_args(&argc, argv, i, 1);
+        i--;
+    }
+    // list-all --archive, checked here too so it skips daemon and snapshot
+    for (int i = 2; i < argc && strcmp(argv[1], "list-all") == 0; i++)
+    {
+        include_archive |= strcmp(argv[i], "--archive") == 0;
+    }
+
+    // Interactive search, watch, import, archive, the counter check and anything
+    // reading the archive work on the database file directly; everything
+    // else prefers a running daemon. Tasks are only loaded by commands
+    // that list them.
+    int interactive = search && argc == 2 && !include_archive;
+    int check = strcmp(argv[1], "status") == 0 && argc == 3 && strcmp(argv[2], "--check") == 0;
+    if (format != FORMAT_TABLE && (interactive || check))
+    {
+        printf("Error: --format needs a search term and does not apply to status --check\n");
+        return 1;
+    }
+    // Listing and plain search read the snapshot when there is no daemon
+    int reader = (strcmp(argv[1], "list") == 0 || strcmp(argv[1], "list-all") == 0 ||
+                  (search && !interactive)) && !include_archive;
+    // done, delete and edit take a selector; one naming several tasks runs
+    // as a single transaction on the database (a daemon picks it up from
+    // data_version)
+    IdRange ranges[argc];
+    TaskSelector selector = {0};
+    const char *description = NULL;
+    int yes = 0;
+    int bulk = 0;
+    int edit = strcmp(argv[1], "edit") == 0;
+    if (edit || strcmp(argv[1], "done") == 0 || strcmp(argv[1], "delete") == 0)
+    {
+        if (parse_selector(argc, argv, ranges, &selector, &yes, edit ? &description : NULL) != 0)
+        {
+            printf("Usage: taskman %s [--yes] <id|first-last|--match term>...%s\n", argv[1],
+                   edit ? " \"new description\"" : "");
+            return 1;
+        }
+        bulk = !single_task(&selector);
+    }
+    int direct = interactive || check || bulk || include_archive || strcmp(argv[1], "import") == 0 ||
+                 strcmp(argv[1], "archive") == 0 || strcmp(argv[1], "watch") == 0;
+    if (store_open(!direct, reader) != 0) {
+        fprintf(stderr, "Error: Failed to initialize database\n");
         return 1;
     }
 
@@ -227,69 +1212,117 @@ int main(int argc, char *argv[])
         if (argc < 3)
         {
             printf("Error: Please provide task description\n");
-            db_close();
+            store_close();
             return 1;
         }
-        add_task(argv[2]);
+        int rc = add_task(argv[2]);
+        store_close();
+        return rc;
+    }
+    else if (strcmp(argv[1], "import") == 0)
+    {
+        int rc = import_command(argc, argv);
+        wrote = 1;
+        store_close();
+        return rc;
+    }
+    else if (strcmp(argv[1], "archive") == 0)
+    {
+        int rc = archive_command(argc, argv);
+        store_close();
+        return rc;
+    }
+    else if (strcmp(argv[1], "watch") == 0)
+    {
+        int all = argc == 3 && strcmp(argv[2], "--all") == 0;
+        if (argc > 2 && !all)
+        {
+            printf("Usage: taskman watch [--all]\n");
+            store_close();
+            return 1;
+        }
+        int rc = watch_tasks(all);
+        store_close();
+        return rc;
     }
     else if (strcmp(argv[1], "list") == 0)
     {
-        list_tasks(0);
+        int rc = list_command(argc, argv, 0);
+        store_close();
+        return rc;
     }
     else if (strcmp(argv[1], "list-all") == 0)
     {
-        list_tasks(1);
+        int rc = list_command(argc, argv, 1);
+        store_close();
+        return rc;
     }
-    else if (strcmp(argv[1], "search") == 0)
+    else if (search)
     {
-        interactive_search();
+        if (!interactive && (argc != 3 || fuzzy))
+        {
+            printf("Usage: taskman search [--fuzzy] | taskman search [--archive] <term>\n");
+            store_close();
+            return 1;
+        }
+        if (!interactive)
+        {
+            int rc = search_tasks(argv[2]);
+            store_close();
+            return rc;
+        }
+        interactive_search(fuzzy);
     }
     else if (strcmp(argv[1], "done") == 0)
     {
-        if (argc < 3)
+        if (bulk)
         {
-            printf("Error: Please provide task ID\n");
-            db_close();
-            return 1;
+            complete_selected(&selector);
+        }
+        else
+        {
+            complete_task(selector.ranges[0].first);
         }
-        complete_task(atoi(argv[2]));
     }
     else if (strcmp(argv[1], "delete") == 0)
     {
-        if (argc < 3)
+        if (bulk)
         {
-            printf("Error: Please provide task ID\n");
-            db_close();
-            return 1;
+            delete_selected(&selector, yes);
         }
-        delete_task(atoi(argv[2]));
-    }
-    else if (strcmp(argv[1], "edit") == 0)
-    {
-        if (argc < 4)
+        else
         {
-            printf("Usage: ./taskman edit <id> \"new description\"\n");
-            db_close();
-            return 1;
+            delete_task(selector.ranges[0].first, yes);
         }
-        edit_task(atoi(argv[2]), argv[3]);
     }
-    else if (strcmp(argv[1], "help") == 0)
+    else if (edit)
     {
-        show_help();
+        if (bulk)
+        {
+            edit_selected(&selector, description);
+        }
+        else
+        {
+            edit_task(selector.ranges[0].first, description);
+        }
     }
     else if (strcmp(argv[1], "status") == 0)
     {
+        if (argc > 2 && !check)
+        {
+            printf("Usage: taskman status [--check]\n");
+            store_close();
+            return 1;
+        }
+        if (check)
+        {
+            int rc = check_status();
+            store_close();
+            return rc;
+        }
         show_status();
     }
-    else
-    {
-        printf("Unknown command: %s\n", argv[1]);
-        show_help();
-        db_close();
-        return 1;
-    }
 
-    db_close();
+    store_close();
     return 0;
 }
@@ -0,0 +1,679 @@
+#define _POSIX_C_SOURCE 200809L
+
+// taskmand: keeps the database connection, its prepared statements and
+// every task in memory, and answers taskman requests over a Unix socket.
+// Reads are served from the in-memory cache; writes go to the database
+// first and are then applied to the cache.
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+#include "database.h"
+#include "match.h"
+#include "protocol.h"
+#include "trace.h"
+
+#define MAX_CONNECTIONS 128
+#define READ_CHUNK (64 * 1024)
+// A connection that has this much unsent output is written to until it
+// drains, so a huge listing cannot pile up in memory
+#define OUT_HIGH_WATER (1024 * 1024)
+#define OUT_DRAIN_TIMEOUT_MS 5000
+
+// Every task in (created, id) order, as listing returns them, plus an
+// open-addressing hash from task ID to array index. Deleted tasks are left
+// as tombstones (id 0) so indexes stay valid; the array is compacted once
+// they make up a noticeable share of it.
+typedef struct
+{
+    TaskManager tm;
+    int *slots; // task index + 1, 0 = empty
+    unsigned mask;
+    int live;
+    int tombstones;
+    int version; // PRAGMA data_version the cache matches
+} TaskCache;
+
+typedef struct
+{
+    int fd;
+    ProtoBuf in;
+    ProtoBuf out;
+} Connection;
+
+static volatile sig_atomic_t stopping = 0;
+
+static unsigned hash_id(int id)
+{
+    return (unsigned)id * 2654435761u;
+}
+
+// Slot holding id, or the empty slot where it would go
+static unsigned cache_slot(const TaskCache *cache, int id)
+{
+    unsigned slot = hash_id(id) & cache->mask;
+    while (cache->slots[slot] && cache->tm.ids[cache->slots[slot] - 1] != id) {
+        slot = (slot + 1) & cache->mask;
+    }
+    return slot;
+}
+
+// Index of task id in the cache, or -1
+static int cache_find(const TaskCache *cache, int id)
+{
+    if (id <= 0 || !cache->slots) {
+        return -1;
+    }
+    return cache->slots[cache_slot(cache, id)] - 1;
+}
+
+// Size the hash for at least twice the live tasks and index all of them
+static int cache_reindex(TaskCache *cache)
+{
+    unsigned size = 1024;
+    while (size < (unsigned)cache->live * 2) {
+        size *= 2;
+    }
+    int *slots = calloc(size, sizeof(int));
+    if (!slots) {
+        fprintf(stderr, "taskmand: Out of memory indexing %d tasks\n", cache->live);
+        return -1;
+    }
+    free(cache->slots);
+    cache->slots = slots;
+    cache->mask = size - 1;
+    for (int i = 0; i < cache->tm.count; i++) {
+        if (cache->tm.ids[i]) {
+            cache->slots[cache_slot(cache, cache->tm.ids[i])] = i + 1;
+        }
+    }
+    return 0;
+}
+
+// Drop the tombstones, keeping the order of the remaining tasks
+static int cache_compact(TaskCache *cache)
+{
+    int kept = 0;
+    for (int i = 0; i < cache->tm.count; i++) {
+        if (cache->tm.ids[i]) {
+            tm_move(&cache->tm, kept++, i);
+        }
+    }
+    cache->tm.count = kept;
+    cache->tombstones = 0;
+    return cache_reindex(cache);
+}
+
+static int cache_load(TaskCache *cache)
+{
+    cache->tm.count = 0;
+    if (db_load_tasks(&cache->tm) != 0) {
+        return -1;
+    }
+    cache->live = cache->tm.count;
+    cache->tombstones = 0;
+    cache->version = db_data_version();
+    return cache_reindex(cache);
+}
+
+// Reload everything when another process wrote to the database since
+// the cache was filled, e.g. an import or a taskman run in direct mode
+static int cache_refresh(TaskCache *cache)
+{
+    int version = db_data_version();
+    if (version == cache->version && cache->slots) {
+        return 0;
+    }
+    return cache_load(cache);
+}
+
+static int cache_append(TaskCache *cache, const Task *task)
+{
+    const TaskManager *tm = &cache->tm;
+    if (tm->count > 0) {
+        int last = tm->count - 1;
+        if (tm->created[last] > task->created || (tm->created[last] == task->created && tm->ids[last] > task->id)) {
+            // The clock went backwards; let the database sort it out
+            return cache_load(cache);
+        }
+    }
+
+    if (tm_append(&cache->tm, task->id, task->description, strlen(task->description), task->completed,
+                  task->created) < 0) {
+        return cache_load(cache);
+    }
+    cache->live++;
+    if ((unsigned)cache->live * 2 > cache->mask + 1) {
+        return cache_reindex(cache);
+    }
+    cache->slots[cache_slot(cache, task->id)] = cache->tm.count;
+    return 0;
+}
+
+static void cache_remove(TaskCache *cache, int id)
+{
+    unsigned hole = cache_slot(cache, id);
+    if (!cache->slots[hole]) {
+        return;
+    }
+    cache->tm.ids[cache->slots[hole] - 1] = 0;
+    cache->live--;
+    cache->tombstones++;
+
+    // Backward-shift deletion: move later entries of the probe run into
+    // the hole unless that would put them before their home slot
+    unsigned next = hole;
+    while (1) {
+        next = (next + 1) & cache->mask;
+        int index = cache->slots[next];
+        if (!index) {
+            break;
+        }
+        unsigned home = hash_id(cache->tm.ids[index - 1]) & cache->mask;
+        int stays = hole <= next ? (hole < home && home <= next) : (hole < home || home <= next);
+        if (!stays) {
+            cache->slots[hole] = index;
+            hole = next;
+        }
+    }
+    cache->slots[hole] = 0;
+
+    if (cache->tombstones > 64 && cache->tombstones > cache->live / 4) {
+        cache_compact(cache);
+    }
+}
+
+static void cache_free(TaskCache *cache)
+{
+    tm_free(&cache->tm);
+    free(cache->slots);
+    cache->slots = NULL;
+}
+
+// Writes from one batch of pipelined requests share a transaction, so a
+// burst of adds costs one commit instead of one each
+static int in_batch = 0;
+
+static int batch_write(void)
+{
+    if (!in_batch) {
+        if (db_begin() != 0) {
+            return -1;
+        }
+        in_batch = 1;
+    }
+    return 0;
+}
+
+// Commit the batch before its answers are sent. When that fails the
+// cache is rebuilt and the caller drops the connection, so the client
+// sees an error instead of acknowledgements for lost writes.
+static int batch_commit(TaskCache *cache)
+{
+    if (!in_batch) {
+        return 0;
+    }
+    in_batch = 0;
+    if (db_commit() != 0) {
+        db_rollback();
+        cache_load(cache);
+        return -1;
+    }
+    return 0;
+}
+
+static void put_task(ProtoBuf *out, uint32_t request, const TaskManager *tm, int index)
+{
+    TaskRow row;
+    row.id = tm->ids[index];
+    row.description = tm->descriptions[index];
+    row.description_len = tm->lengths[index];
+    row.completed = (Status)tm->status[index];
+    row.created = tm->created[index];
+    proto_put_row(out, request, &row);
+}
+
+static void put_count(ProtoBuf *out, uint32_t request, int value)
+{
+    size_t start = proto_begin(out, PROTO_OK, request);
+    proto_put_u32(out, (uint32_t)value);
+    proto_end(out, start);
+}
+
+static void put_error(ProtoBuf *out, uint32_t request, const char *message)
+{
+    size_t start = proto_begin(out, PROTO_ERROR, request);
+    proto_put_bytes(out, message, strlen(message));
+    proto_end(out, start);
+}
+
+static void put_end(ProtoBuf *out, uint32_t request)
+{
+    proto_end(out, proto_begin(out, PROTO_END, request));
+}
+
+// Copy a description out of a payload into a NUL-terminated string.
+// The buffer is reused by the next request.
+static char *copy_description(const unsigned char *src, size_t len)
+{
+    static char *buf = NULL;
+    static size_t cap = 0;
+    if (len + 1 > cap) {
+        char *grown = realloc(buf, len + 1);
+        if (!grown) {
+            return NULL;
+        }
+        buf = grown;
+        cap = len + 1;
+    }
+    memcpy(buf, src, len);
+    buf[len] = '\0';
+    return buf;
+}
+
+static void handle_add(TaskCache *cache, const ProtoFrame *frame, ProtoBuf *out)
+{
+    Task task;
+    task.description = copy_description(frame->payload, frame->len);
+    task.completed = TODO;
+    task.created = time(NULL);
+    if (!task.description || batch_write() != 0 || db_add_task(&task) != 0) {
+        put_error(out, frame->id, "cannot save task");
+        return;
+    }
+    cache_append(cache, &task);
+    put_count(out, frame->id, task.id);
+}
+
+static void handle_list(const TaskCache *cache, const ProtoFrame *frame, ProtoBuf *out)
+{
+    int pending_only = frame->payload[0];
+    int after_id = (int)proto_get_u32(frame->payload + 1);
+    int limit = (int)proto_get_u32(frame->payload + 5);
+
+    // Continuing after a task that no longer exists is an error, as in
+    // direct mode
+    const TaskManager *tm = &cache->tm;
+    int from = 0;
+    if (after_id) {
+        int after = cache_find(cache, after_id);
+        if (after < 0) {
+            put_error(out, frame->id, "task not found");
+            return;
+        }
+        from = after + 1;
+    }
+
+    int rows = 0;
+    for (int i = from; i < tm->count && (limit <= 0 || rows < limit); i++) {
+        if (tm->ids[i] && (!pending_only || tm->status[i] != DONE)) {
+            put_task(out, frame->id, tm, i);
+            rows++;
+        }
+    }
+    put_end(out, frame->id);
+}
+
+static void handle_search(const TaskCache *cache, const ProtoFrame *frame, ProtoBuf *out)
+{
+    char term[MATCH_MAX_TERM];
+    size_t len = frame->len < sizeof(term) - 1 ? frame->len : sizeof(term) - 1;
+    memcpy(term, frame->payload, len);
+    term[len] = '\0';
+
+    MatchQuery query;
+    match_query_init(&query, term);
+    const TaskManager *tm = &cache->tm;
+    for (int i = 0; i < tm->count; i++) {
+        if (tm->ids[i] && match_query_test(&query, tm->descriptions[i], (size_t)tm->lengths[i])) {
+            put_task(out, frame->id, tm, i);
+        }
+    }
+    put_end(out, frame->id);
+}
+
+// Apply one write by ID to the database and then the cache
+static void handle_update(TaskCache *cache, const ProtoFrame *frame, ProtoBuf *out)
+{
+    int id = (int)proto_get_u32(frame->payload);
+    char *description = NULL;
+    int changed = -1;
+
+    if (batch_write() != 0) {
+        // reported below
+    } else if (frame->op == PROTO_DONE) {
+        changed = db_set_task_status(id, DONE);
+    } else if (frame->op == PROTO_DELETE) {
+        changed = db_delete_task(id);
+    } else if ((description = copy_description(frame->payload + 4, frame->len - 4))) {
+        changed = db_set_task_description(id, description);
+    }
+    if (changed < 0) {
+        put_error(out, frame->id, "cannot update task");
+        return;
+    }
+
+    int index = cache_find(cache, id);
+    if (changed > 0 && index < 0) {
+        cache_load(cache); // the row is newer than the cache
+    } else if (changed > 0 && frame->op == PROTO_DONE) {
+        cache->tm.status[index] = DONE;
+    } else if (changed > 0 && frame->op == PROTO_DELETE) {
+        cache_remove(cache, id);
+    } else if (changed > 0 && tm_set_description(&cache->tm, index, description, strlen(description)) != 0) {
+        cache_load(cache);
+    }
+    put_count(out, frame->id, changed);
+}
+
+static void handle_frame(TaskCache *cache, const ProtoFrame *frame, ProtoBuf *out)
+{
+    switch (frame->op) {
+        case PROTO_PING:
+            put_count(out, frame->id, 0);
+            return;
+        case PROTO_ADD:
+            handle_add(cache, frame, out);
+            return;
+        case PROTO_GET:
+            if (frame->len >= 4) {
+                int index = cache_find(cache, (int)proto_get_u32(frame->payload));
+                if (index >= 0) {
+                    put_task(out, frame->id, &cache->tm, index);
+                }
+                put_end(out, frame->id);
+                return;
+            }
+            break;
+        case PROTO_LIST:
+            if (frame->len >= 9) {
+                handle_list(cache, frame, out);
+                return;
+            }
+            break;
+        case PROTO_DONE:
+        case PROTO_DELETE:
+        case PROTO_EDIT:
+            if (frame->len >= 4) {
+                handle_update(cache, frame, out);
+                return;
+            }
+            break;
+        case PROTO_SEARCH:
+            handle_search(cache, frame, out);
+            return;
+        case PROTO_STATUS: {
+            // The counters and indexes answer this faster than the cache
+            TaskStats tasks;
+            if (db_task_stats(&tasks) != 0) {
+                put_error(out, frame->id, "cannot read task stats");
+                return;
+            }
+            DbStatementStats stats;
+            db_get_statement_stats(&stats);
+            size_t start = proto_begin(out, PROTO_OK, frame->id);
+            proto_put_u32(out, (uint32_t)tasks.total);
+            proto_put_u32(out, (uint32_t)tasks.completed);
+            proto_put_u32(out, (uint32_t)stats.prepared);
+            proto_put_u32(out, (uint32_t)stats.reused);
+            proto_put_task(out, &tasks.oldest_pending);
+            proto_put_task(out, &tasks.newest);
+            proto_end(out, start);
+            task_stats_clear(&tasks);
+            return;
+        }
+        default:
+            break;
+    }
+    put_error(out, frame->id, "malformed request");
+}
+
+// Write as much pending output as the socket takes without blocking.
+// Returns -1 when the peer is gone.
+static int flush_output(Connection *conn)
+{
+    size_t sent = 0;
+    while (sent < conn->out.len) {
+        ssize_t n = write(conn->fd, conn->out.data + sent, conn->out.len - sent);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                break;
+            }
+            return -1;
+        }
+        sent += (size_t)n;
+    }
+    proto_buf_consume(&conn->out, sent);
+    return 0;
+}
+
+// Wait for a slow reader until the output is back under the high water
+// mark. Other clients stall meanwhile, which is why this is bounded.
+static int drain_output(Connection *conn)
+{
+    while (conn->out.len > OUT_HIGH_WATER) {
+        struct pollfd pfd = {conn->fd, POLLOUT, 0};
+        if (poll(&pfd, 1, OUT_DRAIN_TIMEOUT_MS) <= 0 || flush_output(conn) != 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// Read what arrived and answer every complete request in order.
+// Returns -1 when the connection should be closed.
+static int serve_connection(TaskCache *cache, Connection *conn)
+{
+    size_t have = conn->in.len;
+    if (!proto_reserve(&conn->in, READ_CHUNK)) {
+        return -1;
+    }
+    ssize_t n = read(conn->fd, conn->in.data + have, READ_CHUNK);
+    if (n <= 0) {
+        conn->in.len = have;
+        return n < 0 && (errno == EAGAIN || errno == EINTR) ? 0 : -1;
+    }
+    conn->in.len = have + (size_t)n;
+
+    size_t used = 0;
+    ProtoFrame frame;
+    long size;
+    while ((size = proto_parse(conn->in.data + used, conn->in.len - used, &frame)) > 0) {
+        TraceSpan span = trace_begin("daemon.request");
+        handle_frame(cache, &frame, &conn->out);
+        trace_end(span);
+        used += (size_t)size;
+        if (conn->out.failed) {
+            batch_commit(cache);
+            return -1;
+        }
+        if (conn->out.len > OUT_HIGH_WATER && (batch_commit(cache) != 0 || drain_output(conn) != 0)) {
+            return -1;
+        }
+    }
+    if (batch_commit(cache) != 0 || size < 0) {
+        return -1;
+    }
+    proto_buf_consume(&conn->in, used);
+    return flush_output(conn);
+}
+
+static void close_connection(Connection *conn)
+{
+    close(conn->fd);
+    proto_buf_free(&conn->in);
+    proto_buf_free(&conn->out);
+}
+
+static int set_nonblocking(int fd)
+{
+    int flags = fcntl(fd, F_GETFL);
+    return flags < 0 ? -1 : fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+}
+
+// Bind the socket next to the database. A socket file left behind by a
+// daemon that died is replaced; one that still answers is not.
+static int listen_socket(struct sockaddr_un *addr)
+{
+    memset(addr, 0, sizeof(*addr));
+    addr->sun_family = AF_UNIX;
+    if (proto_socket_path(addr->sun_path, sizeof(addr->sun_path)) != 0) {
+        fprintf(stderr, "taskmand: Socket path is too long\n");
+        return -1;
+    }
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        perror("taskmand: socket");
+        return -1;
+    }
+    if (connect(fd, (struct sockaddr *)addr, sizeof(*addr)) == 0) {
+        fprintf(stderr, "taskmand: Already running on %s\n", addr->sun_path);
+        close(fd);
+        return -1;
+    }
+    if (errno == ECONNREFUSED) {
+        unlink(addr->sun_path);
+    }
+    close(fd);
+
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || bind(fd, (struct sockaddr *)addr, sizeof(*addr)) != 0 ||
+        listen(fd, 64) != 0 || set_nonblocking(fd) != 0) {
+        fprintf(stderr, "taskmand: Cannot listen on %s: %s\n", addr->sun_path, strerror(errno));
+        if (fd >= 0) {
+            close(fd);
+        }
+        return -1;
+    }
+    return fd;
+}
+
+static void on_signal(int sig)
+{
+    (void)sig;
+    stopping = 1;
+}
+
+static void accept_connections(int listener, Connection *conns, int *count)
+{
+    int fd;
+    while ((fd = accept(listener, NULL, NULL)) >= 0) {
+        if (*count == MAX_CONNECTIONS || set_nonblocking(fd) != 0) {
+            close(fd);
+            continue;
+        }
+        memset(&conns[*count], 0, sizeof(Connection));
+        conns[*count].fd = fd;
+        (*count)++;
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc > 1) {
+        printf("Usage: %s\n", argv[0]);
+        printf("Serves taskman requests from %s over a Unix socket until interrupted.\n", db_get_path());
+        return strcmp(argv[1], "--help") == 0 ? 0 : 1;
+    }
+
+    // The profile is written when the daemon is stopped
+    if (trace_setup(getenv("TASKMAN_TRACE")) != 0) {
+        fprintf(stderr, "taskmand: TASKMAN_TRACE must be text or json\n");
+        return 1;
+    }
+
+    if (db_init() != 0) {
+        fprintf(stderr, "taskmand: Failed to initialize database\n");
+        return 1;
+    }
+    static TaskCache cache;
+    TraceSpan span = trace_begin("daemon.cache_load");
+    int loaded = cache_load(&cache);
+    trace_end(span);
+    if (loaded != 0) {
+        db_close();
+        return 1;
+    }
+
+    struct sockaddr_un addr;
+    int listener = listen_socket(&addr);
+    if (listener < 0) {
+        cache_free(&cache);
+        db_close();
+        return 1;
+    }
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_signal;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    fprintf(stderr, "taskmand: Serving %d tasks on %s\n", cache.live, addr.sun_path);
+
+    static Connection conns[MAX_CONNECTIONS];
+    static struct pollfd fds[MAX_CONNECTIONS + 1];
+    int count = 0;
+    while (!stopping) {
+        fds[0].fd = listener;
+        fds[0].events = POLLIN;
+        for (int i = 0; i < count; i++) {
+            fds[i + 1].fd = conns[i].fd;
+            fds[i + 1].events = POLLIN | (conns[i].out.len ? POLLOUT : 0);
+            fds[i + 1].revents = 0;
+        }
+        if (poll(fds, (nfds_t)count + 1, -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("taskmand: poll");
+            break;
+        }
+
+        // One data_version check covers every request in this wakeup
+        if (cache_refresh(&cache) != 0) {
+            break;
+        }
+
+        int open = 0;
+        for (int i = 0; i < count; i++) {
+            int ok = 1;
+            if (fds[i + 1].revents & (POLLIN | POLLHUP | POLLERR)) {
+                ok = serve_connection(&cache, &conns[i]) == 0;
+            } else if (fds[i + 1].revents & POLLOUT) {
+                ok = flush_output(&conns[i]) == 0;
+            }
+            if (ok) {
+                conns[open++] = conns[i];
+            } else {
+                close_connection(&conns[i]);
+            }
+        }
+        count = open;
+
+        if (fds[0].revents & POLLIN) {
+            accept_connections(listener, conns, &count);
+        }
+    }
+
+    for (int i = 0; i < count; i++) {
+        close_connection(&conns[i]);
+    }
+    close(listener);
+    unlink(addr.sun_path);
+    cache_free(&cache);
+    db_close();
+    return 0;
+}
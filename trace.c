@@ -0,0 +1,207 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "trace.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define TRACE_MAX_SPANS 64
+#define TRACE_MAX_STATEMENTS 64
+
+typedef struct
+{
+    const char *name;
+    long count;
+    int64_t total_ns;
+    int64_t max_ns;
+} SpanTotal;
+
+typedef struct
+{
+    char *sql;
+    long runs;
+    long vm_steps;
+    long fullscan_steps;
+    long sorts;
+    long autoindexes;
+} StatementTotal;
+
+int trace_on = 0;
+
+static TraceFormat format = TRACE_OFF;
+static int64_t started_ns;
+// The search worker records spans too
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static SpanTotal spans[TRACE_MAX_SPANS];
+static int span_count;
+static StatementTotal statements[TRACE_MAX_STATEMENTS];
+static int statement_count;
+static long cache_hits, cache_misses, cache_writes;
+
+static void trace_report(void);
+
+int64_t trace_now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// Turn tracing on. option is "text" (or "1") or "json"; NULL, "" and "0"
+// leave it off. Returns -1 for anything else.
+int trace_setup(const char *option)
+{
+    if (!option || !*option || strcmp(option, "0") == 0) {
+        return 0;
+    }
+    if (strcmp(option, "json") == 0) {
+        format = TRACE_JSON;
+    } else if (strcmp(option, "text") == 0 || strcmp(option, "1") == 0) {
+        format = TRACE_TEXT;
+    } else {
+        return -1;
+    }
+    if (!trace_on) {
+        started_ns = trace_now_ns();
+        trace_on = 1;
+        atexit(trace_report);
+    }
+    return 0;
+}
+
+void trace_record(const char *name, int64_t start_ns)
+{
+    int64_t elapsed = trace_now_ns() - start_ns;
+
+    pthread_mutex_lock(&lock);
+    int i = 0;
+    while (i < span_count && strcmp(spans[i].name, name) != 0) {
+        i++;
+    }
+    if (i == span_count && span_count < TRACE_MAX_SPANS) {
+        spans[span_count++].name = name;
+    }
+    if (i < span_count) {
+        spans[i].count++;
+        spans[i].total_ns += elapsed;
+        if (elapsed > spans[i].max_ns) {
+            spans[i].max_ns = elapsed;
+        }
+    }
+    pthread_mutex_unlock(&lock);
+}
+
+// Counters of one statement, summed with earlier statements of the same SQL
+void trace_statement(const char *sql, int runs, int vm_steps, int fullscan_steps, int sorts, int autoindexes)
+{
+    if (!sql || runs == 0) {
+        return;
+    }
+
+    pthread_mutex_lock(&lock);
+    int i = 0;
+    while (i < statement_count && strcmp(statements[i].sql, sql) != 0) {
+        i++;
+    }
+    if (i == statement_count && statement_count < TRACE_MAX_STATEMENTS) {
+        statements[i].sql = strdup(sql);
+        if (statements[i].sql) {
+            statement_count++;
+        }
+    }
+    if (i < statement_count) {
+        statements[i].runs += runs;
+        statements[i].vm_steps += vm_steps;
+        statements[i].fullscan_steps += fullscan_steps;
+        statements[i].sorts += sorts;
+        statements[i].autoindexes += autoindexes;
+    }
+    pthread_mutex_unlock(&lock);
+}
+
+void trace_cache(int hits, int misses, int writes)
+{
+    pthread_mutex_lock(&lock);
+    cache_hits += hits;
+    cache_misses += misses;
+    cache_writes += writes;
+    pthread_mutex_unlock(&lock);
+}
+
+static void json_string(FILE *out, const char *text)
+{
+    fputc('"', out);
+    for (const unsigned char *p = (const unsigned char *)text; *p; p++) {
+        if (*p == '"' || *p == '\\') {
+            fprintf(out, "\\%c", *p);
+        } else if (*p < 0x20) {
+            fprintf(out, "\\u%04x", *p);
+        } else {
+            fputc(*p, out);
+        }
+    }
+    fputc('"', out);
+}
+
+static void report_json(FILE *out, double total_ms)
+{
+    fprintf(out, "{\"total_ms\":%.3f,\"spans\":[", total_ms);
+    for (int i = 0; i < span_count; i++) {
+        fprintf(out, "%s{\"name\":", i ? "," : "");
+        json_string(out, spans[i].name);
+        fprintf(out, ",\"count\":%ld,\"total_ms\":%.3f,\"max_ms\":%.3f}", spans[i].count,
+                spans[i].total_ns / 1e6, spans[i].max_ns / 1e6);
+    }
+    fprintf(out, "],\"statements\":[");
+    for (int i = 0; i < statement_count; i++) {
+        const StatementTotal *s = &statements[i];
+        fprintf(out, "%s{\"sql\":", i ? "," : "");
+        json_string(out, s->sql);
+        fprintf(out, ",\"runs\":%ld,\"vm_steps\":%ld,\"fullscan_steps\":%ld,\"sorts\":%ld,\"autoindexes\":%ld}",
+                s->runs, s->vm_steps, s->fullscan_steps, s->sorts, s->autoindexes);
+    }
+    fprintf(out, "],\"page_cache\":{\"hits\":%ld,\"misses\":%ld,\"writes\":%ld}}\n", cache_hits, cache_misses,
+            cache_writes);
+}
+
+static void report_text(FILE *out, double total_ms)
+{
+    fprintf(out, "\nProfile: %.3f ms total\n", total_ms);
+    fprintf(out, "  %-24s %8s %12s %12s\n", "span", "count", "total ms", "max ms");
+    for (int i = 0; i < span_count; i++) {
+        fprintf(out, "  %-24s %8ld %12.3f %12.3f\n", spans[i].name, spans[i].count, spans[i].total_ns / 1e6,
+                spans[i].max_ns / 1e6);
+    }
+
+    if (statement_count > 0) {
+        fprintf(out, "\nSQLite statements\n");
+        fprintf(out, "  %6s %10s %10s %6s %6s  %s\n", "runs", "vm steps", "full scan", "sorts", "autoix", "sql");
+        for (int i = 0; i < statement_count; i++) {
+            const StatementTotal *s = &statements[i];
+            fprintf(out, "  %6ld %10ld %10ld %6ld %6ld  %.70s%s\n", s->runs, s->vm_steps, s->fullscan_steps,
+                    s->sorts, s->autoindexes, s->sql, strlen(s->sql) > 70 ? "..." : "");
+        }
+    }
+
+    long lookups = cache_hits + cache_misses;
+    fprintf(out, "\nPage cache: %ld hits, %ld misses (%.1f%% hit rate), %ld writes\n", cache_hits, cache_misses,
+            lookups ? 100.0 * cache_hits / lookups : 0.0, cache_writes);
+}
+
+static void trace_report(void)
+{
+    double total_ms = (trace_now_ns() - started_ns) / 1e6;
+    pthread_mutex_lock(&lock);
+    if (format == TRACE_JSON) {
+        report_json(stderr, total_ms);
+    } else {
+        report_text(stderr, total_ms);
+    }
+    for (int i = 0; i < statement_count; i++) {
+        free(statements[i].sql);
+    }
+    statement_count = 0;
+    pthread_mutex_unlock(&lock);
+}
@@ -0,0 +1,42 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+
+// Phase-level profiling, switched on with `taskman --profile[=json]` or
+// TASKMAN_TRACE=text|json. Spans measure wall time on the monotonic
+// clock and are summed per name; SQLite statement and page cache counters
+// are collected as statements and connections are closed. The report goes
+// to stderr when the process exits.
+//
+// While tracing is off a span costs one branch and no clock read.
+typedef enum { TRACE_OFF, TRACE_TEXT, TRACE_JSON } TraceFormat;
+
+typedef struct
+{
+    const char *name;
+    int64_t start_ns;
+} TraceSpan;
+
+extern int trace_on;
+
+int trace_setup(const char *format);
+int64_t trace_now_ns(void);
+void trace_record(const char *name, int64_t start_ns);
+void trace_statement(const char *sql, int runs, int vm_steps, int fullscan_steps, int sorts, int autoindexes);
+void trace_cache(int hits, int misses, int writes);
+
+static inline TraceSpan trace_begin(const char *name)
+{
+    TraceSpan span = {name, trace_on ? trace_now_ns() : 0};
+    return span;
+}
+
+static inline void trace_end(TraceSpan span)
+{
+    if (trace_on) {
+        trace_record(span.name, span.start_ns);
+    }
+}
+
+#endif // TRACE_H
@@ -0,0 +1,448 @@
+#define _DEFAULT_SOURCE
+
+#include "watch.h"
+#include "output.h"
+#include "trace.h"
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/inotify.h>
+#endif
+
+static volatile sig_atomic_t window_resized = 0;
+
+static void handle_sigwinch(int sig)
+{
+    (void)sig;
+    window_resized = 1;
+}
+
+// Where rows read from the database go: the tasks the view lists
+typedef struct
+{
+    TaskManager *tm;
+    int show_completed;
+    int failed;
+} RowSink;
+
+static int keep_row(const TaskRow *row, void *ctx)
+{
+    RowSink *sink = ctx;
+    if (!sink->show_completed && row->completed == DONE) {
+        return 0;
+    }
+    if (tm_append(sink->tm, row->id, row->description, (size_t)row->description_len, row->completed,
+                  row->created) < 0) {
+        sink->failed = 1;
+        return 1;
+    }
+    return 0;
+}
+
+static int compare_ids(const void *a, const void *b)
+{
+    int x = *(const int *)a, y = *(const int *)b;
+    return (x > y) - (x < y);
+}
+
+// First index whose task comes after (created, id) in listing order
+static int listing_position(const TaskManager *tm, time_t created, int id)
+{
+    int low = 0, high = tm->count;
+    while (low < high) {
+        int mid = low + (high - low) / 2;
+        if (tm->created[mid] < created || (tm->created[mid] == created && tm->ids[mid] < id)) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+// Insert task index of from into tasks, keeping listing order. New tasks
+// normally sort last, so the move below is usually empty.
+static int insert_task(TaskManager *tasks, const TaskManager *from, int index)
+{
+    int at = listing_position(tasks, from->created[index], from->ids[index]);
+    if (tm_append(tasks, from->ids[index], from->descriptions[index], (size_t)from->lengths[index],
+                  (Status)from->status[index], from->created[index]) < 0) {
+        return -1;
+    }
+    int last = tasks->count - 1;
+    const char *description = tasks->descriptions[last];
+    int length = tasks->lengths[last];
+    for (int k = last; k > at; k--) {
+        tm_move(tasks, k, k - 1);
+    }
+    tasks->ids[at] = from->ids[index];
+    tasks->status[at] = from->status[index];
+    tasks->created[at] = from->created[index];
+    tasks->descriptions[at] = description;
+    tasks->lengths[at] = length;
+    return 0;
+}
+
+// Copy the listed tasks into a fresh store, leaving the text merges
+// dropped behind. Out of memory, the view simply keeps the old store.
+static void watch_compact(WatchView *watch)
+{
+    TraceSpan span = trace_begin("watch.compact");
+    const TaskManager *tasks = &watch->tasks;
+    TaskManager fresh = {0};
+    int rc = tm_reserve(&fresh, tasks->count);
+    for (int i = 0; i < tasks->count && rc == 0; i++) {
+        rc = tm_append(&fresh, tasks->ids[i], tasks->descriptions[i], (size_t)tasks->lengths[i],
+                       (Status)tasks->status[i], tasks->created[i]) < 0;
+    }
+    if (rc == 0) {
+        tm_free(&watch->tasks);
+        watch->tasks = fresh;
+        watch->text_dead = 0;
+    } else {
+        tm_free(&fresh);
+    }
+    trace_end(span);
+}
+
+// Bring the view up to date from the tasks changed after its generation:
+// every changed task is dropped and the ones that still belong in the view
+// are inserted again. The text of dropped tasks stays in the arena until
+// watch_compact() or a full reload. Returns the number of tasks read, or
+// -1 when the view has to be reloaded instead.
+static int watch_merge(WatchView *watch)
+{
+    int *changed = NULL;
+    int changed_count = db_changed_ids(watch->generation, &changed);
+    if (changed_count < 0 || changed_count > WATCH_MERGE_MAX) {
+        free(changed);
+        return -1;
+    }
+
+    TaskManager fresh = {0};
+    RowSink sink = {&fresh, watch->show_completed, 0};
+    int fetched = db_each_changed_task(watch->generation, watch->max_id, keep_row, &sink);
+    if (fetched < 0 || sink.failed) {
+        free(changed);
+        tm_free(&fresh);
+        return -1;
+    }
+
+    // Adds log nothing, so the common case skips this pass
+    TaskManager *tasks = &watch->tasks;
+    if (changed_count > 0) {
+        int kept = 0;
+        for (int i = 0; i < tasks->count; i++) {
+            if (!bsearch(&tasks->ids[i], changed, (size_t)changed_count, sizeof(int), compare_ids)) {
+                tm_move(tasks, kept++, i);
+            } else {
+                watch->text_live -= (size_t)tasks->lengths[i] + 1;
+                watch->text_dead += (size_t)tasks->lengths[i] + 1;
+            }
+        }
+        tasks->count = kept;
+    }
+
+    int rc = 0;
+    for (int j = 0; j < fresh.count && rc == 0; j++) {
+        rc = insert_task(tasks, &fresh, j);
+        watch->text_live += (size_t)fresh.lengths[j] + 1;
+    }
+    free(changed);
+    tm_free(&fresh);
+    if (rc == 0 && watch->text_dead >= WATCH_COMPACT_MIN && watch->text_dead >= watch->text_live / 4) {
+        watch_compact(watch);
+    }
+    return rc == 0 ? fetched : -1;
+}
+
+static int watch_load(WatchView *watch)
+{
+    tm_clear(&watch->tasks);
+    RowSink sink = {&watch->tasks, watch->show_completed, 0};
+    TaskQuery query = {0};
+    query.pending_only = !watch->show_completed;
+    if (db_each_task(&query, keep_row, &sink) < 0 || sink.failed) {
+        return -1;
+    }
+    watch->text_live = 0;
+    watch->text_dead = 0;
+    for (int i = 0; i < watch->tasks.count; i++) {
+        watch->text_live += (size_t)watch->tasks.lengths[i] + 1;
+    }
+    return 0;
+}
+
+// Read the changes since the view's generation in one read transaction,
+// or every task when full is set, the change log no longer reaches back
+// that far or too much changed. Returns 1 when the view changed, 0 when it
+// was already current and -1 on error.
+static int watch_read(WatchView *watch, int full)
+{
+    // Taken first, so a commit that lands while reading is seen again
+    watch->version = db_data_version();
+
+    long long generation, changes_from;
+    if (db_begin_read() != 0) {
+        return -1;
+    }
+    if (db_generation(&generation, &changes_from) != 0) {
+        db_commit();
+        return -1;
+    }
+    if (!full && generation == watch->generation) {
+        db_commit();
+        return 0;
+    }
+
+    TraceSpan span = trace_begin("watch.read");
+    int max_id = db_get_next_id() - 1;
+    int fetched = -1;
+    if (!full && watch->generation >= changes_from && max_id - watch->max_id <= WATCH_MERGE_MAX) {
+        fetched = watch_merge(watch);
+    }
+    int rc = fetched >= 0 ? 0 : watch_load(watch);
+    if (rc == 0) {
+        rc = db_count_tasks(&watch->total, &watch->completed);
+    }
+    db_commit();
+    trace_end(span);
+
+    if (rc != 0) {
+        return -1;
+    }
+    watch->generation = generation;
+    watch->max_id = max_id;
+    watch->fetched = fetched;
+    watch->updated = time(NULL);
+    return 1;
+}
+
+// Watch the directory rather than the files themselves: SQLite deletes
+// and recreates the WAL, and a watch on a deleted file goes quiet
+static void watch_files(WatchView *watch)
+{
+    watch->notify_fd = -1;
+#ifdef __linux__
+    const char *path = db_get_path();
+    const char *slash = strrchr(path, '/');
+    char dir[512];
+    snprintf(dir, sizeof(dir), "%.*s", slash ? (int)(slash - path) : 1, slash ? path : ".");
+    snprintf(watch->db_name, sizeof(watch->db_name), "%s", slash ? slash + 1 : path);
+    snprintf(watch->wal_name, sizeof(watch->wal_name), "%s-wal", watch->db_name);
+
+    watch->notify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (watch->notify_fd >= 0 &&
+        inotify_add_watch(watch->notify_fd, dir, IN_MODIFY | IN_CREATE | IN_MOVED_TO | IN_DELETE | IN_CLOSE_WRITE) < 0) {
+        close(watch->notify_fd);
+        watch->notify_fd = -1;
+    }
+#endif
+}
+
+// Drain the queued events. Returns whether any of them was about tasks.db
+// or its WAL (the snapshot next to them is written by readers).
+static int watch_files_changed(WatchView *watch)
+{
+    int changed = 0;
+#ifdef __linux__
+    union
+    {
+        struct inotify_event event;
+        char bytes[4096];
+    } buf;
+    ssize_t n;
+    while ((n = read(watch->notify_fd, buf.bytes, sizeof(buf.bytes))) > 0) {
+        for (ssize_t at = 0; at < n;) {
+            const struct inotify_event *event = (const struct inotify_event *)(buf.bytes + at);
+            changed |= (event->mask & IN_Q_OVERFLOW) ||
+                       (event->len && (strcmp(event->name, watch->db_name) == 0 ||
+                                       strcmp(event->name, watch->wal_name) == 0));
+            at += (ssize_t)(sizeof(struct inotify_event) + event->len);
+        }
+    }
+#else
+    (void)watch;
+#endif
+    return changed;
+}
+
+static void watch_draw(WatchView *watch)
+{
+    Screen *screen = &watch->screen;
+    const TaskManager *tasks = &watch->tasks;
+    Viewport *view = &watch->view;
+    int height = viewport_height(view);
+    if (view->top > tasks->count - height) {
+        view->top = tasks->count - height;
+    }
+    if (view->top < 0) {
+        view->top = 0;
+    }
+
+    char when[16];
+    strftime(when, sizeof(when), "%H:%M:%S", localtime(&watch->updated));
+    char summary[48];
+    if (watch->fetched < 0) {
+        snprintf(summary, sizeof(summary), "read all tasks");
+    } else {
+        snprintf(summary, sizeof(summary), "read %d changed task(s)", watch->fetched);
+    }
+
+    screen_begin(screen);
+    screen_printf(screen, "TaskMan Watch");
+    screen_printf(screen, "=============");
+    screen_printf(screen, "%d pending, %d completed. Last change at %s, %s.", watch->total - watch->completed,
+                  watch->completed, when, summary);
+    screen_printf(screen, "Press q to quit, ↑/↓ PgUp/PgDn Home/End to scroll");
+    screen_printf(screen, "");
+
+    if (tasks->count == 0) {
+        screen_printf(screen, watch->show_completed ? "No tasks." : "No pending tasks.");
+        screen_present(screen);
+        return;
+    }
+
+    screen_printf(screen, "%-4s %-8s %-20s %s", "ID", "Status", "Created", "Description");
+    screen_printf(screen, "------------------------------------------------------------");
+
+    int end = view->top + height;
+    if (end > tasks->count) {
+        end = tasks->count;
+    }
+    for (int i = view->top; i < end; i++) {
+        char time_str[20];
+        strftime(time_str, sizeof(time_str), "%Y-%m-%d %H:%M", localtime(&tasks->created[i]));
+        char id_str[16];
+        int id_width = snprintf(id_str, sizeof(id_str), "%-4d", tasks->ids[i]);
+        int room = view->cols - id_width - 31; // status, date and separators
+        int desc_len = clip_to_width(tasks->descriptions[i], room > 0 ? room : 0);
+        screen_printf(screen, "%s \033[0;%sm%-8s\033[0m %-20s %.*s", id_str, tasks->status[i] == DONE ? "32" : "33",
+                      tasks->status[i] == DONE ? "[DONE]" : "[TODO]", time_str, desc_len, tasks->descriptions[i]);
+    }
+
+    screen_printf(screen, "");
+    screen_printf(screen, "Showing %d-%d of %d task(s).", view->top + 1, end, tasks->count);
+    screen_present(screen);
+}
+
+// Scroll for a navigation key. Returns whether the key was one.
+static int watch_scroll(WatchView *watch, int key)
+{
+    int page = viewport_height(&watch->view);
+    switch (key) {
+        case KEY_UP: watch->view.top--; break;
+        case KEY_DOWN: watch->view.top++; break;
+        case KEY_PAGE_UP: watch->view.top -= page; break;
+        case KEY_PAGE_DOWN: watch->view.top += page; break;
+        case KEY_HOME: watch->view.top = 0; break;
+        case KEY_END: watch->view.top = watch->tasks.count; break;
+        default: return 0;
+    }
+    return 1;
+}
+
+// Live list of the pending (or all) tasks until q, ESC or Ctrl+C. Between
+// changes it sleeps in poll(); a change costs one PRAGMA, the changed rows
+// and a redraw of the lines that differ.
+int watch_tasks(int show_completed)
+{
+    if (!output_is_terminal(STDIN_FILENO) || !output_is_terminal(STDOUT_FILENO)) {
+        fprintf(stderr, "Error: watch needs a terminal\n");
+        return 1;
+    }
+
+    WatchView watch;
+    memset(&watch, 0, sizeof(watch));
+    watch.show_completed = show_completed;
+    if (watch_read(&watch, 1) < 0) {
+        fprintf(stderr, "Error: Could not load tasks\n");
+        tm_free(&watch.tasks);
+        return 1;
+    }
+    watch_files(&watch);
+    screen_init(&watch.screen, STDOUT_FILENO);
+    viewport_measure(&watch.view);
+
+    // Without SA_RESTART a resize interrupts the blocking poll
+    struct sigaction sa, old_sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = handle_sigwinch;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGWINCH, &sa, &old_sa);
+
+    printf(HIDE_CURSOR);
+    fflush(stdout);
+    enable_raw_mode();
+
+    int rc = 0;
+    int redraw = 1;
+    int running = 1;
+    while (running) {
+        if (window_resized) {
+            window_resized = 0;
+            viewport_measure(&watch.view);
+            screen_invalidate(&watch.screen);
+            redraw = 1;
+        }
+        if (redraw) {
+            watch_draw(&watch);
+            redraw = 0;
+        }
+
+        struct pollfd fds[2] = {
+            {STDIN_FILENO, POLLIN, 0},
+            {watch.notify_fd, POLLIN, 0}, // ignored by poll() when -1
+        };
+        if (poll(fds, 2, watch.notify_fd >= 0 ? -1 : WATCH_POLL_MS) < 0) {
+            continue; // interrupted by SIGWINCH
+        }
+
+        int notified = watch.notify_fd < 0 || ((fds[1].revents & POLLIN) && watch_files_changed(&watch));
+        if (notified && db_data_version() != watch.version) {
+            int changed = watch_read(&watch, 0);
+            if (changed < 0) {
+                rc = 1;
+                break;
+            }
+            redraw |= changed;
+        }
+
+        if (fds[0].revents & (POLLIN | POLLHUP)) {
+            int key = read_key();
+            if (key < 0 && input_eof()) {
+                break;
+            }
+            switch (key) {
+                case 'q':
+                case 'Q':
+                case KEY_ESC:
+                case KEY_CTRL_C:
+                    running = 0;
+                    break;
+                default:
+                    redraw |= watch_scroll(&watch, key);
+                    break;
+            }
+        }
+    }
+
+    printf(SHOW_CURSOR CLEAR_SCREEN MOVE_CURSOR_HOME);
+    fflush(stdout);
+    disable_raw_mode();
+    sigaction(SIGWINCH, &old_sa, NULL);
+    if (rc != 0) {
+        fprintf(stderr, "Error: Could not read the changed tasks\n");
+    }
+    if (watch.notify_fd >= 0) {
+        close(watch.notify_fd);
+    }
+    screen_free(&watch.screen);
+    tm_free(&watch.tasks);
+    return rc;
+}
@@ -0,0 +1,50 @@
+#ifndef WATCH_H
+#define WATCH_H
+
+#include "database.h"
+#include "screen.h"
+#include "search.h"
+
+// Changes merged into the view one by one; a larger batch (an import, a
+// bulk edit) reloads the view instead
+#define WATCH_MERGE_MAX 1024
+
+// Descriptions of tasks that merges replaced or dropped stay in the text
+// arena; the view is copied into a fresh store once they take up this
+// many bytes and a quarter of the live text
+#define WATCH_COMPACT_MIN (64 * 1024)
+
+// How often PRAGMA data_version is checked where inotify is not available
+#define WATCH_POLL_MS 1000
+
+// State of "taskman watch": the listed tasks in (created, id) order, kept
+// current by merging in only the tasks changed since the generation they
+// were read at (see db_generation()). The process sleeps in poll() until
+// inotify reports a write to tasks.db or its WAL, and a commit by another
+// connection (PRAGMA data_version) is what triggers reading the changes.
+typedef struct
+{
+    TaskManager tasks;
+    int show_completed;
+    long long generation; // db_generation() the tasks match
+    int max_id;           // tasks above it are new since then
+    int version;          // PRAGMA data_version at the last check
+    int total;
+    int completed;
+    size_t text_live;     // description bytes of the listed tasks
+    size_t text_dead;     // description bytes left in the arena by merges
+
+    int notify_fd;   // inotify descriptor, -1 where unavailable
+    char db_name[64];   // file names the events are filtered on
+    char wal_name[72];
+
+    time_t updated;  // last change seen
+    int fetched;     // changed tasks read for it, -1 after a full reload
+
+    Screen screen;
+    Viewport view;
+} WatchView;
+
+int watch_tasks(int show_completed);
+
+#endif // WATCH_H